@@ -0,0 +1,420 @@
+#include "engine.h"            // 被测的仿真引擎
+
+#include <benchmark/benchmark.h> // Google Benchmark
+#include <QBuffer>             // 流式加载/保存的内存设备
+#include <QFile>               // 读取 /proc/self/status、重置峰值内存
+#include <QJsonArray>          // 生成嵌套封装元件的内部电路
+#include <QJsonDocument>       // 存档的序列化与解析
+#include <random>              // 随机网表
+
+/**
+ * @file bench.cpp
+ * @brief 性能基准 turing-bench：用生成的电路测量仿真、加载与保存的性能。
+ * @details 工作负载：N 位行波进位加法器、SR 锁存器阵列、深层嵌套的封装元件、随机组合网表（默认10万门）。
+ * 指标：每次切换输入后 simulate() 的延迟、迭代到稳定的轮数、step() 的节拍吞吐量、JSON 加载/保存吞吐量、峰值常驻内存（VmHWM，仅 Linux）。
+ * 机器可读输出使用 Google Benchmark 自带的参数，例如：
+ *   turing-bench --benchmark_format=json --benchmark_out=bench.json
+ */
+
+/** 工作负载类型（基准参数 0） */
+enum Workload { RippleAdder, LatchArray, DeepNesting, RandomNetlist };
+
+/** 生成的电路：引擎及按 Y 坐标排序的输入源 */
+struct Circuit {
+    Engine engine;
+    QVector<Input*> inputs;
+};
+
+/** 创建元件并返回它（元件纵向排开，保证输入/输出的顺序稳定） */
+static Component* place(Engine& engine, ComponentType type, qreal x, qreal y)
+{
+    return engine.createComponent(type, QPointF(x, y));
+}
+
+/** 连接 from 的第 outIndex 个输出与 to 的第 inIndex 个输入 */
+static void link(Engine& engine, Component* from, int outIndex, Component* to, int inIndex)
+{
+    engine.createWire(from->outputPins()[outIndex], to->inputPins()[inIndex]);
+}
+
+/**
+ * @brief N 位行波进位加法器：每位一个全加器（2 个异或、2 个与、1 个或）。
+ */
+static void buildRippleAdder(Circuit& circuit, int bits)
+{
+    Engine& e = circuit.engine;
+    Component* carry = place(e, ComponentType::Input, 0, 0);
+    circuit.inputs.append(static_cast<Input*>(carry));
+    for (int i = 0; i < bits; ++i) {
+        const qreal y = 100.0 * (i + 1);
+        Component* a = place(e, ComponentType::Input, 0, y);
+        Component* b = place(e, ComponentType::Input, 0, y + 50);
+        circuit.inputs.append(static_cast<Input*>(a));
+        circuit.inputs.append(static_cast<Input*>(b));
+        Component* axb = place(e, ComponentType::Xor, 100, y);
+        Component* sum = place(e, ComponentType::Xor, 200, y);
+        Component* ab = place(e, ComponentType::And, 100, y + 50);
+        Component* cx = place(e, ComponentType::And, 200, y + 50);
+        Component* carryOut = place(e, ComponentType::Or, 300, y + 50);
+        Component* sumOut = place(e, ComponentType::Output, 400, y);
+        link(e, a, 0, axb, 0);
+        link(e, b, 0, axb, 1);
+        link(e, axb, 0, sum, 0);
+        link(e, carry, 0, sum, 1);
+        link(e, a, 0, ab, 0);
+        link(e, b, 0, ab, 1);
+        link(e, axb, 0, cx, 0);
+        link(e, carry, 0, cx, 1);
+        link(e, ab, 0, carryOut, 0);
+        link(e, cx, 0, carryOut, 1);
+        link(e, sum, 0, sumOut, 0);
+        carry = carryOut;
+    }
+    link(e, carry, 0, place(e, ComponentType::Output, 400, 100.0 * (bits + 1)), 0);
+}
+
+/**
+ * @brief SR 锁存器阵列：每个锁存器由两个交叉耦合的或非门构成，S/R 各接一个输入源。
+ */
+static void buildLatchArray(Circuit& circuit, int count)
+{
+    Engine& e = circuit.engine;
+    for (int i = 0; i < count; ++i) {
+        const qreal y = 100.0 * i;
+        Component* set = place(e, ComponentType::Input, 0, y);
+        Component* reset = place(e, ComponentType::Input, 0, y + 50);
+        circuit.inputs.append(static_cast<Input*>(set));
+        circuit.inputs.append(static_cast<Input*>(reset));
+        Component* q = place(e, ComponentType::Nor, 100, y);
+        Component* qn = place(e, ComponentType::Nor, 100, y + 50);
+        link(e, reset, 0, q, 0);
+        link(e, qn, 0, q, 1);
+        link(e, set, 0, qn, 0);
+        link(e, q, 0, qn, 1);
+        link(e, q, 0, place(e, ComponentType::Output, 200, y), 0);
+    }
+}
+
+/** 按存档格式生成一个组件对象 */
+static QJsonObject componentJson(int id, ComponentType type, qreal x, qreal y)
+{
+    QJsonObject object;
+    object["id"] = id;
+    object["type"] = static_cast<int>(type);
+    object["x"] = x;
+    object["y"] = y;
+    return object;
+}
+
+/** 按存档格式生成一条导线对象 */
+static QJsonObject wireJson(int startId, int startPin, int endId, int endPin)
+{
+    QJsonObject object;
+    object["start_comp_id"] = startId;
+    object["start_pin_index"] = startPin;
+    object["end_comp_id"] = endId;
+    object["end_pin_index"] = endPin;
+    return object;
+}
+
+/**
+ * @brief 深层嵌套：第 0 层是输入驱动的 SR 锁存器（时序电路，不会被编译成真值表），
+ * 第 k 层 = 输入 → 第 k-1 层 → 非门 → 输出。顶层放置一个第 depth 层的实例。
+ */
+static void buildDeepNesting(Circuit& circuit, int depth)
+{
+    // --- 第 0 层：S = 输入，R = 非(输入) ---
+    QJsonArray components{componentJson(1, ComponentType::Input, 0, 0),
+                          componentJson(2, ComponentType::Not, 50, 50),
+                          componentJson(3, ComponentType::Nor, 100, 0),
+                          componentJson(4, ComponentType::Nor, 100, 50),
+                          componentJson(5, ComponentType::Output, 200, 0)};
+    QJsonArray wires{wireJson(1, 0, 2, 0), wireJson(2, 0, 3, 0), wireJson(4, 0, 3, 1),
+                     wireJson(1, 0, 4, 0), wireJson(3, 0, 4, 1), wireJson(3, 0, 5, 0)};
+    QJsonObject level{{"components", components}, {"wires", wires}};
+
+    for (int k = 1; k <= depth; ++k) {
+        QJsonObject inner = componentJson(2, ComponentType::Encapsulated, 100, 0);
+        inner["name"] = QString("level%1").arg(k - 1);
+        inner["internal_circuit"] = level;
+        QJsonArray outerComponents{componentJson(1, ComponentType::Input, 0, 0), inner,
+                                   componentJson(3, ComponentType::Not, 200, 0),
+                                   componentJson(4, ComponentType::Output, 300, 0)};
+        QJsonArray outerWires{wireJson(1, 0, 2, 0), wireJson(2, 0, 3, 0), wireJson(3, 0, 4, 0)};
+        level = QJsonObject{{"components", outerComponents}, {"wires", outerWires}};
+    }
+
+    Engine& e = circuit.engine;
+    Component* input = place(e, ComponentType::Input, 0, 0);
+    circuit.inputs.append(static_cast<Input*>(input));
+    QJsonObject top = componentJson(0, ComponentType::Encapsulated, 100, 0);
+    top["name"] = QString("level%1").arg(depth);
+    top["internal_circuit"] = level;
+    Component* nested = e.createComponent(top);
+    link(e, input, 0, nested, 0);
+    link(e, nested, 0, place(e, ComponentType::Output, 300, 0), 0);
+}
+
+/**
+ * @brief 随机组合网表：64 个输入源，每个门的输入取自之前 1024 个输出中的随机一个（无反馈环）。
+ */
+static void buildRandomNetlist(Circuit& circuit, int gates)
+{
+    Engine& e = circuit.engine;
+    std::mt19937 rng(20240601u);
+    QVector<Component*> drivers;
+    for (int i = 0; i < 64; ++i) {
+        Component* input = place(e, ComponentType::Input, 0, 10.0 * i);
+        circuit.inputs.append(static_cast<Input*>(input));
+        drivers.append(input);
+    }
+    const int window = 1024;
+    for (int i = 0; i < gates; ++i) {
+        const auto type = static_cast<ComponentType>(static_cast<int>(ComponentType::And) + int(rng() % 7));
+        Component* gate = place(e, type, 100, 10.0 * i);
+        for (int k = 0; k < gate->inputPins().size(); ++k) {
+            const int lowest = qMax(0, int(drivers.size()) - window);
+            link(e, drivers[lowest + int(rng() % (drivers.size() - lowest))], 0, gate, k);
+        }
+        drivers.append(gate);
+    }
+    for (int i = 0; i < 64; ++i) {
+        link(e, drivers[drivers.size() - 1 - i], 0, place(e, ComponentType::Output, 200, 10.0 * i), 0);
+    }
+}
+
+/** 按基准参数生成电路 */
+static void buildWorkload(Circuit& circuit, int workload, int size)
+{
+    switch (workload) {
+    case RippleAdder: buildRippleAdder(circuit, size); break;
+    case LatchArray: buildLatchArray(circuit, size); break;
+    case DeepNesting: buildDeepNesting(circuit, size); break;
+    case RandomNetlist: buildRandomNetlist(circuit, size); break;
+    }
+}
+
+/** 把一个 "Vm..." 行（单位 kB）从 /proc/self/status 中读出；非 Linux 平台返回 0 */
+static double readProcStatusKb(const QByteArray& key)
+{
+    QFile status("/proc/self/status");
+    if (!status.open(QIODevice::ReadOnly)) return 0;
+    for (const QByteArray& line : status.readAll().split('\n')) {
+        if (line.startsWith(key)) {
+            return line.mid(key.size()).trimmed().split(' ').first().toDouble();
+        }
+    }
+    return 0;
+}
+
+/** 重置峰值常驻内存计数（Linux 4.0+ 支持，失败时忽略），使每个基准的峰值互不影响 */
+static void resetPeakMemory()
+{
+    QFile clearRefs("/proc/self/clear_refs");
+    if (clearRefs.open(QIODevice::WriteOnly)) { clearRefs.write("5"); }
+}
+
+/** 记录峰值常驻内存（kB） */
+static void reportPeakMemory(benchmark::State& state)
+{
+    state.counters["peak_rss_kb"] = readProcStatusKb("VmHWM:");
+}
+
+/**
+ * @brief 切换输入后仿真的延迟与迭代轮数。
+ * @details 参数：工作负载、规模、仿真模式（0 迭代求稳 / 1 活动驱动 / 2 分层求值）、是否展平层次。
+ * 每次迭代轮流翻转一个输入源并调用 simulate()。
+ */
+static void BM_ToggleSimulate(benchmark::State& state)
+{
+    resetPeakMemory();
+    Circuit circuit;
+    buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+    circuit.engine.setSimulationMode(static_cast<SimulationMode>(state.range(2)));
+    circuit.engine.setFlattenHierarchy(state.range(3) != 0);
+    circuit.engine.simulate(); // 编译网表并达到初始稳态，不计入测量
+
+    qint64 totalIterations = 0;
+    qint64 unstableRuns = 0;
+    int next = 0;
+    for (auto _ : state) {
+        circuit.inputs[next]->toggleState();
+        circuit.engine.simulate();
+        totalIterations += circuit.engine.lastIterationCount();
+        if (!circuit.engine.lastRunConverged()) ++unstableRuns;
+        next = (next + 1) % circuit.inputs.size();
+    }
+    state.counters["iterations_to_stable"] = benchmark::Counter(double(totalIterations), benchmark::Counter::kAvgIterations);
+    state.counters["unstable_runs"] = double(unstableRuns);
+    reportPeakMemory(state);
+}
+
+/**
+ * @brief 单位延迟节拍吞吐量：每次迭代翻转一个输入源再 step(kStepTicks)，与是否稳定无关。
+ * @details 参数：工作负载、规模。items_per_second 即每秒推进的节拍数。
+ */
+static void BM_Step(benchmark::State& state)
+{
+    static const int kStepTicks = 16;
+    resetPeakMemory();
+    Circuit circuit;
+    buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+    circuit.engine.simulate();
+
+    int next = 0;
+    for (auto _ : state) {
+        circuit.inputs[next]->toggleState();
+        circuit.engine.step(kStepTicks);
+        next = (next + 1) % circuit.inputs.size();
+    }
+    state.SetItemsProcessed(state.iterations() * kStepTicks);
+    reportPeakMemory(state);
+}
+
+/** JSON 保存吞吐量：saveCircuitToJson() 加序列化为紧凑文本 */
+static void BM_Save(benchmark::State& state)
+{
+    resetPeakMemory();
+    Circuit circuit;
+    buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+    circuit.engine.simulate();
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        const QByteArray text = QJsonDocument(circuit.engine.saveCircuitToJson()).toJson(QJsonDocument::Compact);
+        benchmark::DoNotOptimize(text.constData());
+        bytes += text.size();
+    }
+    state.SetBytesProcessed(bytes);
+    reportPeakMemory(state);
+}
+
+/** JSON 加载吞吐量：解析文本加 loadCircuitFromJson()（含加载后的首次仿真） */
+static void BM_Load(benchmark::State& state)
+{
+    resetPeakMemory();
+    QByteArray text;
+    {
+        Circuit circuit;
+        buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+        circuit.engine.simulate();
+        text = QJsonDocument(circuit.engine.saveCircuitToJson()).toJson(QJsonDocument::Compact);
+    }
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        Engine engine;
+        const bool loaded = engine.loadCircuitFromJson(QJsonDocument::fromJson(text).object());
+        benchmark::DoNotOptimize(loaded);
+        bytes += text.size();
+    }
+    state.SetBytesProcessed(bytes);
+    reportPeakMemory(state);
+}
+
+/** 流式 JSON 加载吞吐量：loadCircuitFromJsonStream()，不构造整棵 QJsonObject 树（含加载后的首次仿真） */
+static void BM_LoadStream(benchmark::State& state)
+{
+    QByteArray text;
+    {
+        Circuit circuit;
+        buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+        circuit.engine.simulate();
+        QBuffer buffer(&text);
+        buffer.open(QIODevice::WriteOnly);
+        circuit.engine.saveCircuitToJsonStream(&buffer);
+    }
+    resetPeakMemory();
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        QBuffer buffer(&text);
+        buffer.open(QIODevice::ReadOnly);
+        Engine engine;
+        const bool loaded = engine.loadCircuitFromJsonStream(&buffer);
+        benchmark::DoNotOptimize(loaded);
+        bytes += text.size();
+    }
+    state.SetBytesProcessed(bytes);
+    reportPeakMemory(state);
+}
+
+/** 二进制存档保存吞吐量：saveCircuitToBinary() */
+static void BM_SaveBinary(benchmark::State& state)
+{
+    resetPeakMemory();
+    Circuit circuit;
+    buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+    circuit.engine.simulate();
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        const QByteArray data = circuit.engine.saveCircuitToBinary();
+        benchmark::DoNotOptimize(data.constData());
+        bytes += data.size();
+    }
+    state.SetBytesProcessed(bytes);
+    reportPeakMemory(state);
+}
+
+/** 二进制存档加载吞吐量：loadCircuitFromBinary()（含加载后的首次仿真） */
+static void BM_LoadBinary(benchmark::State& state)
+{
+    resetPeakMemory();
+    QByteArray data;
+    {
+        Circuit circuit;
+        buildWorkload(circuit, int(state.range(0)), int(state.range(1)));
+        circuit.engine.simulate();
+        data = circuit.engine.saveCircuitToBinary();
+    }
+
+    qint64 bytes = 0;
+    for (auto _ : state) {
+        Engine engine;
+        const bool loaded = engine.loadCircuitFromBinary(data.constData(), data.size());
+        benchmark::DoNotOptimize(loaded);
+        bytes += data.size();
+    }
+    state.SetBytesProcessed(bytes);
+    reportPeakMemory(state);
+}
+
+/** 各工作负载的规模：加法器位数、锁存器个数、嵌套深度、随机门数 */
+static const QVector<QPair<int, int>> kWorkloadSizes{
+    {RippleAdder, 64}, {RippleAdder, 1024},
+    {LatchArray, 256}, {LatchArray, 4096},
+    {DeepNesting, 4}, {DeepNesting, 16},
+    {RandomNetlist, 100000},
+};
+
+/** 仿真基准：每个工作负载 × 三种模式；嵌套工作负载另外测量展平后的三种模式 */
+static void toggleArguments(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"workload", "size", "mode", "flatten"});
+    for (const auto& workload : kWorkloadSizes) {
+        for (int mode = 0; mode < 3; ++mode) {
+            benchmark->Args({workload.first, workload.second, mode, 0});
+            if (workload.first == DeepNesting) { benchmark->Args({workload.first, workload.second, mode, 1}); }
+        }
+    }
+}
+
+/** 加载/保存基准：每个工作负载一次 */
+static void fileArguments(benchmark::internal::Benchmark* benchmark)
+{
+    benchmark->ArgNames({"workload", "size"});
+    for (const auto& workload : kWorkloadSizes) {
+        benchmark->Args({workload.first, workload.second});
+    }
+}
+
+BENCHMARK(BM_ToggleSimulate)->Apply(toggleArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Step)->Apply(fileArguments)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_Save)->Apply(fileArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Load)->Apply(fileArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadStream)->Apply(fileArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_SaveBinary)->Apply(fileArguments)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_LoadBinary)->Apply(fileArguments)->Unit(benchmark::kMillisecond);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,61 @@
+#include "circuitloader.h" // 加载器声明
+#include "engine.h"        // Engine::loadCircuitFromFile
+#include <QtConcurrent>    // 在线程池中运行加载
+#include <QThreadPool>
+
+/** 构造加载器（尚未开始） */
+CircuitLoader::CircuitLoader(const QString& filePath, Engine* engine, QObject* parent)
+    : QObject(parent), m_filePath(filePath), m_engine(engine), m_bytesRead(0), m_totalBytes(0), m_canceled(0), m_loaded(false)
+{
+    m_progressTimer.setInterval(kProgressIntervalMs);
+    connect(&m_progressTimer, &QTimer::timeout, this, &CircuitLoader::reportProgress);
+    connect(&m_watcher, &QFutureWatcher<void>::finished, this, &CircuitLoader::onLoadFinished);
+}
+
+/** 析构：工作线程仍在使用引擎时先让它停下 */
+CircuitLoader::~CircuitLoader()
+{
+    m_canceled.storeRelaxed(1);
+    m_watcher.waitForFinished();
+}
+
+/** 开始加载：进度回调只更新原子变量，并在取消后返回 false */
+void CircuitLoader::start()
+{
+    Engine* engine = m_engine;
+    const QString filePath = m_filePath;
+    m_progressTimer.start();
+    m_watcher.setFuture(QtConcurrent::run(QThreadPool::globalInstance(), [this, engine, filePath]() {
+        m_loaded = engine->loadCircuitFromFile(filePath, [this](qint64 bytesRead, qint64 totalBytes) {
+            m_bytesRead.storeRelaxed(bytesRead);
+            m_totalBytes.storeRelaxed(totalBytes);
+            return m_canceled.loadRelaxed() == 0;
+        });
+    }));
+}
+
+/** @return 文件路径 */
+QString CircuitLoader::filePath() const { return m_filePath; }
+
+/** @return 目标引擎 */
+Engine* CircuitLoader::engine() const { return m_engine; }
+
+/** @return 是否已被取消 */
+bool CircuitLoader::wasCanceled() const { return m_canceled.loadRelaxed() != 0; }
+
+/** 请求取消 */
+void CircuitLoader::cancel() { m_canceled.storeRelaxed(1); }
+
+/** 转发进度 */
+void CircuitLoader::reportProgress()
+{
+    emit progress(m_bytesRead.loadRelaxed(), m_totalBytes.loadRelaxed());
+}
+
+/** 工作线程结束：停止转发进度并报告结果 */
+void CircuitLoader::onLoadFinished()
+{
+    m_progressTimer.stop();
+    reportProgress();
+    emit finished(m_loaded && !wasCanceled());
+}
@@ -0,0 +1,72 @@
+#ifndef CIRCUITLOADER_H
+#define CIRCUITLOADER_H
+#include <QObject>        // 信号槽基类
+#include <QFutureWatcher> // 监视在线程池中运行的加载
+#include <QTimer>         // 定期把进度转发到界面线程
+#include <QAtomicInteger> // 工作线程与界面线程共享的进度与取消标记
+
+class Engine;
+
+/**
+ * @file circuitloader.h
+ * @brief 电路加载器：在工作线程中读取、解析电路文件并构建引擎。
+ */
+
+/**
+ * @brief 后台加载一个电路文件到给定的引擎。
+ * @details 工作线程调用 Engine::loadCircuitFromFile()，进度回调只写原子变量；界面线程每 kProgressIntervalMs
+ * 毫秒读取一次并发出 progress()，因此解析再快也不会让事件队列堆积。cancel() 置位取消标记，
+ * 回调在下一批条目时返回 false，引擎随即清空并返回失败。
+ * 加载期间引擎只属于工作线程，调用方在 finished() 之前不得访问它。
+ */
+class CircuitLoader : public QObject {
+    Q_OBJECT
+public:
+    /**
+     * @param filePath 电路文件（.tcb 或 JSON）
+     * @param engine 目标引擎（非拥有；加载前会被清空）
+     */
+    CircuitLoader(const QString& filePath, Engine* engine, QObject* parent = nullptr);
+    /** 析构：取消并等待仍在运行的加载 */
+    ~CircuitLoader() override;
+
+    /** 在线程池中开始加载 */
+    void start();
+    /** 文件路径 */
+    QString filePath() const;
+    /** 目标引擎 */
+    Engine* engine() const;
+    /** 加载是否因 cancel() 而终止 */
+    bool wasCanceled() const;
+
+public slots:
+    /** 请求取消：工作线程在下一次报告进度时停止 */
+    void cancel();
+
+signals:
+    /** 进度：已读取的字节数与总字节数（未知时为 0） */
+    void progress(qint64 bytesRead, qint64 totalBytes);
+    /** 加载结束（界面线程）：loaded 为 false 时原因见 engine()->lastError() */
+    void finished(bool loaded);
+
+private slots:
+    /** 把工作线程写下的进度转发为 progress() 信号 */
+    void reportProgress();
+    /** 工作线程结束 */
+    void onLoadFinished();
+
+private:
+    /** 进度转发间隔（毫秒） */
+    static const int kProgressIntervalMs = 50;
+
+    QString m_filePath;
+    Engine* m_engine;                      // 目标引擎（非拥有）
+    QFutureWatcher<void> m_watcher;        // 监视工作线程
+    QTimer m_progressTimer;                // 定期转发进度
+    QAtomicInteger<qint64> m_bytesRead;    // 工作线程写、界面线程读
+    QAtomicInteger<qint64> m_totalBytes;
+    QAtomicInt m_canceled;                 // 界面线程写、工作线程读
+    bool m_loaded;                         // 工作线程写，finished 之后界面线程读
+};
+
+#endif // CIRCUITLOADER_H
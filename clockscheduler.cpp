@@ -0,0 +1,108 @@
+#include "clockscheduler.h" // 调度器声明
+#include "graphics.h"       // 驱动 GraphicsScene 的时钟节拍与重绘
+#include <QGuiApplication>  // 取得主屏幕
+#include <QScreen>          // 屏幕刷新率
+#include <QtMath>           // qFloor
+
+/** 构造调度器：定时器使用精确模式，重绘间隔取主屏幕刷新率（取不到时按 60 Hz） */
+ClockScheduler::ClockScheduler(QObject* parent)
+    : QObject(parent), m_targetRate(kDefaultRate), m_ticksDone(0), m_ticksSinceReport(0)
+{
+    m_timer.setTimerType(Qt::PreciseTimer);
+    m_timer.setInterval(1);
+    connect(&m_timer, &QTimer::timeout, this, &ClockScheduler::onTimeout);
+
+    qreal refreshRate = 60.0;
+    if (QScreen* screen = QGuiApplication::primaryScreen()) {
+        if (screen->refreshRate() > 1.0) { refreshRate = screen->refreshRate(); }
+    }
+    m_repaintIntervalNs = qint64(1e9 / refreshRate);
+}
+
+/** 切换被驱动的场景：先把旧场景积压的结果画出来 */
+void ClockScheduler::setScene(GraphicsScene* scene)
+{
+    if (m_scene == scene) return;
+    if (m_scene) { m_scene->flushPendingRepaint(); }
+    m_scene = scene;
+    restartClock();
+}
+
+/** @return 当前被驱动的场景 */
+GraphicsScene* ClockScheduler::scene() const { return m_scene; }
+
+/** 设置目标频率（至少 1 节拍/秒），从当前时刻起按新频率计算 */
+void ClockScheduler::setTargetRate(double ticksPerSecond)
+{
+    m_targetRate = qMax(1.0, ticksPerSecond);
+    restartClock();
+}
+
+/** @return 目标频率 */
+double ClockScheduler::targetRate() const { return m_targetRate; }
+
+/** 开始运行 */
+void ClockScheduler::start()
+{
+    if (m_timer.isActive()) return;
+    restartClock();
+    m_repaintClock.start();
+    m_reportClock.start();
+    m_ticksSinceReport = 0;
+    m_timer.start();
+}
+
+/** 停止运行，并把最后一批节拍的结果画出来 */
+void ClockScheduler::stop()
+{
+    m_timer.stop();
+    if (m_scene) { m_scene->flushPendingRepaint(); }
+}
+
+/** @return 是否正在运行 */
+bool ClockScheduler::isRunning() const { return m_timer.isActive(); }
+
+/** 重新开始计时：此前的节拍不再计入“应执行”的节拍数 */
+void ClockScheduler::restartClock()
+{
+    m_runClock.start();
+    m_ticksDone = 0;
+}
+
+/**
+ * @brief 定时器触发：按已过时间补上应执行的节拍。
+ * @details 每批 kTicksPerBatch 拍检查一次耗时，超过 kSliceBudgetMs 就把余下的积压丢弃，
+ * 让出 GUI 线程处理输入与绘制；重绘与频率报告分别按屏幕刷新周期和 1 秒节流。
+ */
+void ClockScheduler::onTimeout()
+{
+    if (!m_scene) return;
+
+    // --- 1. 应执行的节拍：已过时间 × 目标频率 − 已执行的节拍 ---
+    const qint64 due = qFloor(m_runClock.nsecsElapsed() * 1e-9 * m_targetRate) - m_ticksDone;
+    QElapsedTimer slice;
+    slice.start();
+    qint64 done = 0;
+    while (done < due) {
+        const int batch = int(qMin<qint64>(kTicksPerBatch, due - done));
+        m_scene->runClockTicks(batch);
+        done += batch;
+        if (slice.elapsed() >= kSliceBudgetMs) break;
+    }
+    m_ticksDone += qMax<qint64>(due, 0); // 没跑完的积压直接丢弃，不在下次触发时追赶
+    m_ticksSinceReport += done;
+
+    // --- 2. 重绘节流到屏幕刷新率 ---
+    if (m_repaintClock.nsecsElapsed() >= m_repaintIntervalNs) {
+        m_scene->flushPendingRepaint();
+        m_repaintClock.restart();
+    }
+
+    // --- 3. 每秒报告一次实际频率 ---
+    const qint64 reportNs = m_reportClock.nsecsElapsed();
+    if (reportNs >= 1000000000) {
+        emit ticksPerSecondMeasured(m_ticksSinceReport * 1e9 / reportNs);
+        m_ticksSinceReport = 0;
+        m_reportClock.restart();
+    }
+}
@@ -0,0 +1,72 @@
+#ifndef CLOCKSCHEDULER_H
+#define CLOCKSCHEDULER_H
+#include <QObject>        // 信号槽基类
+#include <QTimer>         // 驱动节拍的定时器
+#include <QElapsedTimer>  // 计算应执行的节拍数、节流重绘与统计实际频率
+#include <QPointer>       // 标签页关闭后自动置空的场景指针
+
+class GraphicsScene;
+
+/**
+ * @file clockscheduler.h
+ * @brief 时钟调度器：按目标频率推进场景所绑定引擎的时钟节拍。
+ */
+
+/**
+ * @brief 实时节拍调度器：每拍推进一次时钟并仿真到稳定，重绘按屏幕刷新率节流，并定期报告实际频率。
+ * @details 定时器每毫秒触发一次，按“已过时间 × 目标频率 − 已完成节拍”算出本次应补上的节拍，
+ * 因此 1 kHz 到 1 MHz 的目标频率都由同一套逻辑驱动。每次触发最多占用 kSliceBudgetMs 毫秒，
+ * 保证界面仍能响应；跟不上目标频率时丢弃积压，实际频率如实报告。
+ */
+class ClockScheduler : public QObject {
+    Q_OBJECT
+public:
+    /** 默认目标频率（节拍/秒） */
+    static constexpr double kDefaultRate = 1000.0;
+    /** 构造调度器（初始不运行） */
+    explicit ClockScheduler(QObject* parent = nullptr);
+
+    /** 设置被驱动的场景；运行中切换时从新场景的当前节拍继续 */
+    void setScene(GraphicsScene* scene);
+    /** 当前被驱动的场景 */
+    GraphicsScene* scene() const;
+    /** 设置目标频率（节拍/秒） */
+    void setTargetRate(double ticksPerSecond);
+    /** 目标频率（节拍/秒） */
+    double targetRate() const;
+    /** 开始运行 */
+    void start();
+    /** 停止运行，并重绘尚未显示的节拍结果 */
+    void stop();
+    /** 是否正在运行 */
+    bool isRunning() const;
+
+signals:
+    /** 大约每秒报告一次实际达到的节拍频率 */
+    void ticksPerSecondMeasured(double ticksPerSecond);
+
+private slots:
+    /** 定时器触发：补上应执行的节拍，必要时重绘与报告 */
+    void onTimeout();
+
+private:
+    /** 重新开始计时（启动、换场景或改频率时） */
+    void restartClock();
+
+    /** 单次触发最多占用的时间（毫秒） */
+    static const int kSliceBudgetMs = 8;
+    /** 每次批量执行的节拍数（两次检查时间之间） */
+    static const int kTicksPerBatch = 64;
+
+    QPointer<GraphicsScene> m_scene;  // 被驱动的场景（非拥有）
+    QTimer m_timer;                   // 每毫秒触发一次
+    double m_targetRate;              // 目标频率
+    QElapsedTimer m_runClock;         // 自 restartClock() 起的时间
+    qint64 m_ticksDone;               // 自 restartClock() 起已执行的节拍
+    QElapsedTimer m_repaintClock;     // 距上次重绘的时间
+    qint64 m_repaintIntervalNs;       // 重绘间隔（屏幕刷新周期）
+    QElapsedTimer m_reportClock;      // 距上次报告的时间
+    qint64 m_ticksSinceReport;        // 距上次报告执行的节拍
+};
+
+#endif // CLOCKSCHEDULER_H
@@ -0,0 +1,226 @@
+#include "componentlibrary.h"
+#include "engine.h"             // EncapsulatedDefinition
+
+#include <QCryptographicHash>   // 文件内容哈希
+#include <QDateTime>            // 文件修改时间
+#include <QDebug>
+#include <QDir>                 // 列出元件文件
+#include <QFile>                // 读取元件文件与索引
+#include <QFileInfo>            // 文件大小与修改时间
+#include <QJsonArray>           // 索引中的条目数组
+#include <QJsonDocument>        // 索引与元件文件的 JSON 解析
+#include <QJsonObject>
+
+const char* const ComponentLibrary::kIndexFileName = "library.index";
+
+/** 索引格式版本：字段含义变化时加 1，旧索引随之作废 */
+static const int kIndexVersion = 1;
+
+ComponentLibrary::ComponentLibrary(const QString& directory) : m_directory(directory) {}
+
+/** @return 元件库目录 */
+QString ComponentLibrary::directory() const { return m_directory; }
+
+/** @return 全部元件 */
+const QVector<ComponentLibrary::Entry>& ComponentLibrary::entries() const { return m_entries; }
+
+/** @return 名称对应的元件，没有时返回 nullptr */
+const ComponentLibrary::Entry* ComponentLibrary::entry(const QString& name) const
+{
+    const auto it = m_lookup.constFind(name);
+    return it == m_lookup.constEnd() ? nullptr : &m_entries[it.value()];
+}
+
+/** @return 最近一次失败的原因 */
+const QString& ComponentLibrary::lastError() const { return m_error; }
+
+/** 重建名称 → 下标表 */
+void ComponentLibrary::rebuildLookup()
+{
+    m_lookup.clear();
+    m_lookup.reserve(m_entries.size());
+    for (int i = 0; i < m_entries.size(); ++i) { m_lookup.insert(m_entries[i].name, i); }
+}
+
+/**
+ * @brief 与磁盘同步。
+ * @details 对每个 .json 文件：
+ * 1. 大小与修改时间都与缓存一致：直接沿用缓存（不读文件）；
+ * 2. 否则读取文件计算哈希：哈希一致只更新时间戳，不一致则作废引脚数与已解析的定义，留待首次使用时解析。
+ * 已删除的文件移出索引。
+ */
+void ComponentLibrary::refresh()
+{
+    if (!m_indexLoaded) {
+        loadIndex();
+        m_indexLoaded = true;
+    }
+
+    QVector<Entry> fresh;
+    bool dirty = false;
+    QDir dir(m_directory);
+    if (dir.exists()) {
+        const QFileInfoList files = dir.entryInfoList(QStringList() << "*.json", QDir::Files | QDir::NoDotAndDotDot, QDir::Name);
+        fresh.reserve(files.size());
+        for (const QFileInfo& fileInfo : files) {
+            const QString name = fileInfo.baseName();
+            const Entry* cached = entry(name);
+            Entry current = cached ? *cached : Entry();
+            current.name = name;
+            current.filePath = fileInfo.absoluteFilePath();
+
+            const qint64 size = fileInfo.size();
+            const qint64 modified = fileInfo.lastModified().toMSecsSinceEpoch();
+            if (cached && cached->size == size && cached->modified == modified) {
+                fresh.append(current);
+                continue;
+            }
+
+            // --- 修改时间变了：按内容哈希判断缓存是否仍然有效 ---
+            QByteArray hash;
+            QFile file(current.filePath);
+            if (file.open(QIODevice::ReadOnly)) {
+                hash = QCryptographicHash::hash(file.readAll(), QCryptographicHash::Sha1);
+            }
+            if (hash.isEmpty() || hash != current.hash) {
+                current.inputCount = -1;
+                current.outputCount = -1;
+                current.definition = nullptr;
+            }
+            current.hash = hash;
+            current.size = size;
+            current.modified = modified;
+            fresh.append(current);
+            dirty = true;
+        }
+    }
+
+    if (fresh.size() != m_entries.size()) dirty = true;
+    m_entries = fresh;
+    rebuildLookup();
+    if (dirty) saveIndex();
+}
+
+/**
+ * @brief 取得共享定义：已解析则直接返回，否则读取文件、解析并记下引脚数。
+ * @details 定义由 EncapsulatedDefinition 注册表按“名称#内容哈希”持有，与旧实现逐次解析得到的定义相同。
+ */
+const EncapsulatedDefinition* ComponentLibrary::definition(const QString& name)
+{
+    m_error.clear();
+    const auto it = m_lookup.constFind(name);
+    if (it == m_lookup.constEnd()) {
+        m_error = "元件库中没有元件: " + name;
+        return nullptr;
+    }
+    Entry& current = m_entries[it.value()];
+    if (current.definition) return current.definition;
+
+    // 1. 读取并解析文件
+    QFile file(current.filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_error = "无法读取元件文件: " + current.filePath;
+        return nullptr;
+    }
+    const QByteArray content = file.readAll();
+    const QJsonDocument document = QJsonDocument::fromJson(content);
+    if (document.isNull() || !document.isObject()) {
+        m_error = "元件文件格式无效: " + current.filePath;
+        return nullptr;
+    }
+    const EncapsulatedDefinition* parsed = EncapsulatedDefinition::obtain(current.name, document.object());
+    if (!parsed) {
+        m_error = "元件定义无效: " + current.filePath;
+        return nullptr;
+    }
+
+    // 2. 缓存定义，并把引脚数写进索引（下次启动时无需解析即可显示）
+    int inputs = 0;
+    int outputs = 0;
+    for (const EncapsulatedDefinition::Part& part : parsed->parts()) {
+        if (part.type == ComponentType::Input) ++inputs;
+        if (part.type == ComponentType::Output) ++outputs;
+    }
+    const QByteArray hash = QCryptographicHash::hash(content, QCryptographicHash::Sha1);
+    const bool changed = current.inputCount != inputs || current.outputCount != outputs || current.hash != hash;
+    current.definition = parsed;
+    current.inputCount = inputs;
+    current.outputCount = outputs;
+    current.hash = hash;
+    if (changed) saveIndex();
+    return parsed;
+}
+
+/** 删除元件文件并移出索引 */
+bool ComponentLibrary::remove(const QString& name)
+{
+    m_error.clear();
+    const auto it = m_lookup.constFind(name);
+    if (it == m_lookup.constEnd()) {
+        m_error = "元件库中没有元件: " + name;
+        return false;
+    }
+    QFile file(m_entries[it.value()].filePath);
+    if (!file.remove()) {
+        m_error = "无法从硬盘删除文件，请检查文件权限。";
+        return false;
+    }
+    m_entries.remove(it.value());
+    rebuildLookup();
+    saveIndex();
+    return true;
+}
+
+/**
+ * @brief 读取索引：{"version", "entries": [{name, size, modified, sha1, inputs, outputs}]}。
+ * @details 版本不符或文件损坏时忽略整个索引（所有元件按“已修改”处理）。
+ */
+void ComponentLibrary::loadIndex()
+{
+    m_entries.clear();
+    QFile file(QDir(m_directory).filePath(kIndexFileName));
+    if (!file.open(QIODevice::ReadOnly)) return;
+    const QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    if (root["version"].toInt() != kIndexVersion) return;
+
+    for (const QJsonValue& value : root["entries"].toArray()) {
+        const QJsonObject object = value.toObject();
+        Entry cached;
+        cached.name = object["name"].toString();
+        if (cached.name.isEmpty()) continue;
+        cached.size = object["size"].toInteger(-1);
+        cached.modified = object["modified"].toInteger(-1);
+        cached.hash = QByteArray::fromHex(object["sha1"].toString().toLatin1());
+        cached.inputCount = object["inputs"].toInt(-1);
+        cached.outputCount = object["outputs"].toInt(-1);
+        m_entries.append(cached);
+    }
+    rebuildLookup();
+}
+
+/** 写回索引；目录不存在（库为空）时不创建 */
+void ComponentLibrary::saveIndex() const
+{
+    QDir dir(m_directory);
+    if (!dir.exists()) return;
+
+    QJsonArray entries;
+    for (const Entry& current : m_entries) {
+        QJsonObject object;
+        object["name"] = current.name;
+        object["size"] = current.size;
+        object["modified"] = current.modified;
+        object["sha1"] = QString::fromLatin1(current.hash.toHex());
+        object["inputs"] = current.inputCount;
+        object["outputs"] = current.outputCount;
+        entries.append(object);
+    }
+    QJsonObject root;
+    root["version"] = kIndexVersion;
+    root["entries"] = entries;
+
+    QFile file(dir.filePath(kIndexFileName));
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(root).toJson(QJsonDocument::Compact)) < 0) {
+        qWarning() << "无法写入元件库索引:" << file.fileName();
+    }
+}
@@ -0,0 +1,89 @@
+#ifndef COMPONENTLIBRARY_H
+#define COMPONENTLIBRARY_H
+#include <QString>      // 元件名、路径与错误信息
+#include <QByteArray>   // 文件内容哈希
+#include <QVector>      // 按文件名排序的条目
+#include <QHash>        // 名称 → 条目下标
+
+class EncapsulatedDefinition;
+
+/**
+ * @file componentlibrary.h
+ * @brief 自定义元件库：带索引缓存的 components/ 目录，元件定义在首次使用时才解析。
+ */
+
+/**
+ * @brief 自定义元件库。
+ * @details 目录中的每个 .json 文件是一个元件。索引文件 kIndexFileName 按文件大小、修改时间与内容哈希
+ * 缓存每个元件的元数据（名称、引脚数），因此启动时只需读取索引并列出目录，不读取也不解析元件文件；
+ * 修改时间变了才读取文件比较哈希，哈希也变了才作废缓存的引脚数。
+ * 元件定义在第一次 definition() 时解析并登记到封装定义注册表，之后的放置直接复用，不再读盘。
+ */
+class ComponentLibrary {
+public:
+    /** 索引文件名（位于元件库目录中，扩展名不是 .json，不会被当作元件） */
+    static const char* const kIndexFileName;
+
+    /** 一个库元件 */
+    struct Entry {
+        /** 元件名（文件名去掉扩展名） */
+        QString name;
+        /** 文件的绝对路径 */
+        QString filePath;
+        /** 文件大小（字节） */
+        qint64 size = -1;
+        /** 文件修改时间（毫秒时间戳） */
+        qint64 modified = -1;
+        /** 文件内容的 SHA-1（尚未读取过时为空） */
+        QByteArray hash;
+        /** 输入引脚数（尚未解析时为 -1） */
+        int inputCount = -1;
+        /** 输出引脚数（尚未解析时为 -1） */
+        int outputCount = -1;
+        /** 已解析的共享定义（由注册表持有；尚未解析时为 nullptr） */
+        const EncapsulatedDefinition* definition = nullptr;
+    };
+
+    /** @param directory 元件库目录（不存在时视为空库） */
+    explicit ComponentLibrary(const QString& directory);
+
+    /** 元件库目录 */
+    QString directory() const;
+    /**
+     * @brief 与磁盘同步：首次调用时读取索引，然后列出目录，只重新读取修改时间变化的文件。
+     * @details 有变化时写回索引。
+     */
+    void refresh();
+    /** 按文件名排序的全部元件（refresh() 之后有效） */
+    const QVector<Entry>& entries() const;
+    /** 按名称查找元件，没有时返回 nullptr */
+    const Entry* entry(const QString& name) const;
+    /**
+     * @brief 取得元件的共享定义，首次调用时读取并解析文件。
+     * @return 失败（文件不可读、格式无效）时返回 nullptr，原因见 lastError()
+     */
+    const EncapsulatedDefinition* definition(const QString& name);
+    /**
+     * @brief 从磁盘删除元件文件并移出索引。
+     * @return 失败时返回 false，原因见 lastError()
+     */
+    bool remove(const QString& name);
+    /** 最近一次失败的原因 */
+    const QString& lastError() const;
+
+private:
+    /** 读取索引文件；文件不存在或损坏时视为空索引 */
+    void loadIndex();
+    /** 写回索引文件（失败只打印警告：索引只是缓存） */
+    void saveIndex() const;
+    /** 按 m_entries 重建名称表 */
+    void rebuildLookup();
+
+    QString m_directory;
+    QVector<Entry> m_entries;
+    QHash<QString, int> m_lookup;
+    bool m_indexLoaded = false;
+    QString m_error;
+};
+
+#endif // COMPONENTLIBRARY_H
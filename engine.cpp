@@ -1,17 +1,27 @@
 #include "engine.h"        // 引擎与组件/导线/引脚的声明
-#include "graphics.h"      // 访问 ComponentItem（用于计算引脚场景坐标）
-#include <QMessageBox>      // 弹出非法连接等警告
 #include <QDebug>           // 调试日志输出
 #include <QJsonObject>      // JSON 对象读写
 #include <QJsonArray>       // JSON 数组读写
+#include <QSet>             // 批量删除导线时的待删集合
 #include <algorithm>        // std::sort 等算法
+#include <limits>           // 存档ID的取值范围检查
+#include <cstring>          // std::memcpy/memcmp/memset 操作状态数组
+#include <QJsonDocument>    // 规范化封装定义后计算内容哈希
+#include <QCryptographicHash> // 封装定义的内容哈希
+#include <QThreadPool>      // 分层求值的并行波次
+#include <QtConcurrent>     // 把同一波次的调度块分给多个线程
+#include <QCborValue>       // 二进制存档中的封装定义
+#include <QFile>            // 存档文件读写与内存映射
+#include <QtEndian>         // 二进制存档的小端序编码
+#include "jsonstream.h"     // 流式 JSON 存档读写
+#include "waveform.h"       // 提交仿真时记录波形
 /**
  * @file engine.cpp
  * @brief 引擎与基础数据结构(Pin/Wire/Component)的实现，以及封装元件逻辑。
  */
 // === Pin 实现 ===
 /** Pin 构造函数 */
-Pin::Pin(Component* owner, PinType type, int index) : m_owner(owner), m_type(type), m_index(index), m_state(false) {}
+Pin::Pin(Component* owner, PinType type, int index) : m_owner(owner), m_type(type), m_index(index), m_state(false), m_stateIndex(-1) {}
 /** 获取引脚状态 */
 bool Pin::getState() const { return m_state; }
 /** 设置引脚状态 */
@@ -22,40 +32,10 @@ Component* Pin::owner() const { return m_owner; }
 Pin::PinType Pin::type() const { return m_type; }
 /** 获取引脚索引 */
 int Pin::index() const { return m_index; }
-
-/** 计算并返回场景坐标中的引脚位置 */
-QPointF Pin::getScenePos() const {
-    if (m_owner && m_owner->getGraphicsItem()) {
-        // =============================================================
-        // == 【核心修改】在这里加入与 ComponentItem 中完全相同的动态高度计算逻辑
-        // =============================================================
-
-        // 1. 从所属元件获取输入/输出引脚的总数
-        int numInputs = m_owner->inputPins().size();
-        int numOutputs = m_owner->outputPins().size();
-        int maxPins = qMax(numInputs, numOutputs);
-
-        // 2. 根据最大引脚数，动态计算元件的理论高度
-        qreal bodyHeight = 50.0; // 默认高度
-        if (maxPins > 4) {
-            // 使用与 ComponentItem::paint() 中完全相同的公式
-            bodyHeight = 10.0 * (maxPins + 1);
-        }
-
-        // =============================================================
-        // == 修改结束
-        // =============================================================
-
-        // 3. 使用这个动态计算出的 bodyHeight 来确定引脚的 Y 坐标
-        int pinCount = (m_type == Input) ? numInputs : numOutputs;
-        qreal yPos = bodyHeight * (m_index + 1) / (pinCount + 1); // <-- 将 50.0 替换为 bodyHeight
-
-        // 4. 剩下的逻辑保持不变
-        QPointF localPos = (m_type == Input) ? QPointF(0, yPos) : QPointF(100, yPos);
-        return m_owner->getGraphicsItem()->mapToScene(localPos);
-    }
-    return QPointF();
-}
+/** 获取稠密编号 */
+int Pin::stateIndex() const { return m_stateIndex; }
+/** 设置稠密编号 */
+void Pin::setStateIndex(int stateIndex) { m_stateIndex = stateIndex; }
 
 // === Wire 实现 ===
 /** Wire 构造函数：连接两个引脚 */
@@ -69,7 +49,7 @@ bool Wire::getState() const { return m_startPin->getState(); }
 
 // === Component 实现 ===
 /** Component 构造：根据数量创建输入/输出引脚 */
-Component::Component(ComponentType type, const QPointF& position, int numInputs, int numOutputs) : m_type(type), m_position(position), m_graphicsItem(nullptr) {
+Component::Component(ComponentType type, const QPointF& position, int numInputs, int numOutputs) : m_type(type), m_position(position), m_graphicsItem(nullptr), m_id(kInvalidId) {
     for (int i = 0; i < numInputs; ++i) m_inputPins.append(new Pin(this, Pin::Input, i));
     for (int i = 0; i < numOutputs; ++i) m_outputPins.append(new Pin(this, Pin::Output, i));
 }
@@ -77,6 +57,8 @@ Component::Component(ComponentType type, const QPointF& position, int numInputs,
 Component::~Component() { qDeleteAll(m_inputPins); qDeleteAll(m_outputPins); }
 /** 获取类型 */
 ComponentType Component::type() const { return m_type; }
+/** 获取稳定ID */
+quint32 Component::id() const { return m_id; }
 /** 读取输入引脚 */
 const QVector<Pin*>& Component::inputPins() const { return m_inputPins; }
 /** 读取输出引脚 */
@@ -98,12 +80,25 @@ Input::Input(const QPointF& pos) : Component(ComponentType::Input, pos, 0, 1), m
 void Input::evaluate() { if (!m_outputPins.isEmpty()) { m_outputPins[0]->setState(m_currentState); } }
 /** 翻转状态 */
 void Input::toggleState() { m_currentState = !m_currentState; evaluate(); }
+/** 获取当前内部状态 */
+bool Input::currentState() const { return m_currentState; }
 /** 设置状态并触发一次评估 */
 void Input::setState(bool state) {
     m_currentState = state;
     evaluate(); // <-- 加上这一行！
 }
 
+/** Clock 构造：0入1出 */
+Clock::Clock(const QPointF& pos, int period) : Component(ComponentType::Clock, pos, 0, 1), m_period(kDefaultPeriod) { setPeriod(period); }
+/** 电平由引擎按节拍读取（见 Engine::prepareSimulation） */
+void Clock::evaluate() { /* 电平由 levelAt() 给出 */ }
+/** 设置周期，不小于 kMinPeriod */
+void Clock::setPeriod(int period) { m_period = period < kMinPeriod ? int(kMinPeriod) : period; }
+/** 获取周期 */
+int Clock::period() const { return m_period; }
+/** 周期前半为低、后半为高 */
+bool Clock::levelAt(quint64 tick) const { return tick % quint64(m_period) >= quint64(m_period / 2); }
+
 /** Output 构造：1入0出 */
 Output::Output(const QPointF& pos) : Component(ComponentType::Output, pos, 1, 0) {}
 /** 输出端不主动改变状态，显示输入 */
@@ -145,10 +140,22 @@ XnorGate::XnorGate(const QPointF& pos) : Component(ComponentType::Xnor, pos, 2,
 void XnorGate::evaluate() { if (m_inputPins.size() == 2 && !m_outputPins.isEmpty()) m_outputPins[0]->setState(m_inputPins[0]->getState() == m_inputPins[1]->getState()); }
 
 // === Engine 实现 ===
-/** 引擎构造 */
-Engine::Engine() {}
-/** 析构：释放组件与导线 */
-Engine::~Engine() { qDeleteAll(m_components.values()); qDeleteAll(m_wires); }
+/** 引擎构造：默认使用迭代求稳模式 */
+Engine::Engine()
+    : m_simulationMode(SimulationMode::Iterative),
+    m_flattenHierarchy(false),
+    m_topologyDirty(true),
+    m_runTopologyChanged(false),
+    m_diagnoseRun(true),
+    m_lastRunConverged(true),
+    m_lastIterationCount(0),
+    m_maxIterations(kDefaultMaxIterations),
+    m_clockTick(0),
+    m_waveform(nullptr),
+    m_cyclePeriod(0)
+{}
+/** 析构：摘下波形记录器，释放组件与导线 */
+Engine::~Engine() { setWaveformRecorder(nullptr); qDeleteAll(m_components); qDeleteAll(m_wires); }
 
 /** 创建组件并注册到引擎 */
 Component* Engine::createComponent(ComponentType type, const QPointF& pos) {
@@ -163,8 +170,9 @@ Component* Engine::createComponent(ComponentType type, const QPointF& pos) {
     case ComponentType::Nor: newComponent = new NorGate(pos); break;
     case ComponentType::Xor: newComponent = new XorGate(pos); break;
     case ComponentType::Xnor: newComponent = new XnorGate(pos); break;
+    case ComponentType::Clock: newComponent = new Clock(pos); break;
     }
-    if (newComponent) { m_components.insert(reinterpret_cast<intptr_t>(newComponent), newComponent); }
+    if (newComponent) { insertComponent(newComponent); }
     return newComponent;
 }
 
@@ -179,17 +187,23 @@ Component* Engine::createComponent(const QJsonObject& compObject)
     QPointF pos(compObject["x"].toDouble(), compObject["y"].toDouble());
 
     if (type == ComponentType::Encapsulated) {
-        // 如果是封装元件，从 "internal_circuit" 字段获取其定义
-        QJsonObject internalJson = compObject["internal_circuit"].toObject();
-        QString name = compObject["name"].toString("封装元件");
+        // 如果是封装元件：新格式以 "definition" 引用共享定义，旧格式内嵌 "internal_circuit"
+        const EncapsulatedDefinition* definition = compObject.contains("definition")
+            ? EncapsulatedDefinition::find(compObject["definition"].toString())
+            : EncapsulatedDefinition::obtain(compObject["name"].toString("封装元件"),
+                                             compObject["internal_circuit"].toObject());
+        if (!definition) {
+            qWarning() << "JSON load error: encapsulated definition not found or invalid:" << compObject["name"].toString();
+            return nullptr;
+        }
 
-        // 1. 创建元件实例
-        Component* newComponent = new EncapsulatedComponent(pos, name, internalJson);
+        // 1. 创建元件实例（共享定义，不再重新解析内部JSON）
+        Component* newComponent = new EncapsulatedComponent(pos, definition);
 
         // 2. 【核心修复】创建后，必须手动将其注册到当前引擎实例中
         //    这样内部引擎在仿真时才能找到这个嵌套的子元件。
         if (newComponent) {
-            m_components.insert(reinterpret_cast<intptr_t>(newComponent), newComponent);
+            insertComponent(newComponent);
         }
 
         // 3. 返回创建的实例
@@ -197,338 +211,1541 @@ Component* Engine::createComponent(const QJsonObject& compObject)
     }
 
     // 对于其他简单元件，调用旧的创建函数 (该函数内部已经包含注册逻辑)
-    return createComponent(type, pos);
+    Component* newComponent = createComponent(type, pos);
+    if (newComponent && type == ComponentType::Clock) {
+        static_cast<Clock*>(newComponent)->setPeriod(compObject["period"].toInt(Clock::kDefaultPeriod));
+    }
+    return newComponent;
 }
 
 /**
  * @brief 创建导线：做多项合法性检查与端点类型规范化。
  * @param startPin 起点引脚（可为输入/输出，内部会规范为输出）
  * @param endPin 终点引脚（将规范为输入）
- * @return 创建成功返回新导线指针，失败返回nullptr
+ * @return 创建成功返回新导线指针，失败返回nullptr（原因见 lastError()）
  */
 Wire* Engine::createWire(Pin* startPin, Pin* endPin) {
+    m_lastError.clear();
     // 【修改】移除了 startPin->owner() == endPin->owner() 的检查
     if (!startPin || !endPin || startPin->type() == endPin->type()) {
         // 【修改】更新了提示信息，不再提及“自身”
-        QMessageBox::warning(nullptr, "非法连接", "不能连接同类型的引脚。");
+        m_lastError = "不能连接同类型的引脚。";
         return nullptr;
     }
     if (startPin->type() == Pin::Input) { std::swap(startPin, endPin); }
     if (startPin->type() != Pin::Output || endPin->type() != Pin::Input) {
-        QMessageBox::warning(nullptr, "非法连接", "必须由输出引脚连接到输入引脚。");
+        m_lastError = "必须由输出引脚连接到输入引脚。";
         return nullptr;
     }
     for (const auto& wire : m_wires) {
         if (wire->endPin() == endPin) {
-            QMessageBox::warning(nullptr, "非法连接", "该输入引脚已被占用。");
+            m_lastError = "该输入引脚已被占用。";
             return nullptr;
         }
     }
     Wire* newWire = new Wire(startPin, endPin);
     m_wires.append(newWire);
+    m_topologyDirty = true;
     return newWire;
 }
 
-/**
- * @brief 运行传播-评估循环，直到稳定或达到最大迭代次数。
- * @details 处理删除导线后的残留状态，通过在每轮开始清零非源头输入引脚修复。
- */
-void Engine::simulate()
+/** 按当前仿真模式运行一次稳定化仿真（在编译后的状态数组上进行，结束后同步回引脚对象） */
+SimulationResult Engine::simulate()
 {
-    const int maxIterations = 100;
-    bool stateChangedInLastIteration = true;
-
-    for (int i = 0; i < maxIterations && stateChangedInLastIteration; ++i) {
-        stateChangedInLastIteration = false;
-
-        QMap<Pin*, bool> oldPinStates;
-        for (auto const& [key, comp] : m_components.asKeyValueRange()) {
-            for (Pin* pin : comp->inputPins()) { oldPinStates[pin] = pin->getState(); }
-            for (Pin* pin : comp->outputPins()) { oldPinStates[pin] = pin->getState(); }
-        }
+    prepareSimulation();
+    runPreparedSimulation();
+    commitSimulation();
+    return m_lastResult;
+}
 
-        // --- 核心修复：先将所有非源头的输入引脚状态清零 ---
-        // 这是解决“删除导线后状态不更新”Bug的关键
-        for (auto const& [key, comp] : m_components.asKeyValueRange()) {
-            if (comp->type() != ComponentType::Input) {
-                for (Pin* pin : comp->inputPins()) {
-                    pin->setState(false);
-                }
-            }
-        }
+/** 恰好推进 ticks 个单位延迟节拍（不因稳定而提前结束） */
+void Engine::step(int ticks)
+{
+    if (ticks <= 0) return;
+    prepareSimulation();
+    m_diagnoseRun = false; // 逐拍推进不是求稳：不做振荡诊断，每拍只付出一轮求值的代价
+    simulateIterative(ticks, false);
+    commitSimulation();
+}
 
-        // --- 正常的传播与计算 ---
-        for (auto const& [key, comp] : m_components.asKeyValueRange()) {
-            if (comp->type() == ComponentType::Input) {
-                comp->evaluate();
-            }
-        }
-        for (auto wire : m_wires) {
-            wire->endPin()->setState(wire->startPin()->getState());
-        }
-        for (auto const& [key, comp] : m_components.asKeyValueRange()) {
-            if (comp->type() != ComponentType::Input) {
-                comp->evaluate();
-            }
-        }
+/** 逐拍推进直到稳定或达到 maxTicks 拍 */
+bool Engine::runUntilStable(int maxTicks)
+{
+    if (maxTicks <= 0) return m_lastRunConverged;
+    prepareSimulation();
+    simulateIterative(maxTicks);
+    commitSimulation();
+    return m_lastRunConverged;
+}
 
-        // --- 检查稳定 ---
-        for (auto const& [key, comp] : m_components.asKeyValueRange()) {
-            for (Pin* pin : comp->inputPins()) {
-                if (oldPinStates[pin] != pin->getState()) { stateChangedInLastIteration = true; break; }
-            }
-            if (stateChangedInLastIteration) break;
-            for (Pin* pin : comp->outputPins()) {
-                if (oldPinStates[pin] != pin->getState()) { stateChangedInLastIteration = true; break; }
-            }
-            if (stateChangedInLastIteration) break;
-        }
+/** 仿真第一步：拓扑变化时重新编译，记录起始状态，并一次性读取所有输入源的当前值 */
+void Engine::prepareSimulation()
+{
+    if (m_netlist.awaitingLookupTables && m_netlist.lookupTableGeneration != EncapsulatedDefinition::lookupTableGeneration()) {
+        m_topologyDirty = true; // 等待中的真值表可能已生成：重新编译，改为查表
+    }
+    m_runTopologyChanged = m_topologyDirty;
+    if (m_runTopologyChanged) { compileNetlist(); }
+    m_topologyDirty = false;
+    m_diagnoseRun = true;
+
+    m_runStartStates = m_netlist.states;
+    for (int i = 0; i < m_netlist.sourceGates.size(); ++i) {
+        Component* source = m_netlist.components[m_netlist.sourceGates[i]];
+        const bool level = source->type() == ComponentType::Clock
+            ? static_cast<Clock*>(source)->levelAt(m_clockTick)
+            : static_cast<Input*>(source)->currentState();
+        m_sourceValues[i] = level ? 1 : 0;
     }
 }
-/** @return 返回组件映射（键为指针地址） */
-const QMap<intptr_t, Component*>& Engine::getAllComponents() const { return m_components; }
-/** @return 返回所有导线的数组 */
-const QVector<Wire*>& Engine::getAllWires() const { return m_wires; }
 
-/** 删除组件：从Map移除并释放 */
-void Engine::deleteComponent(Component* component) {
-    if (!component) {
-        return; // 如果传入的是空指针，直接返回
+/** 仿真第二步：按仿真模式在状态数组上求稳（不访问本引擎的 Pin 对象，可在工作线程执行） */
+void Engine::runPreparedSimulation()
+{
+    switch (m_simulationMode) {
+    case SimulationMode::Iterative: simulateIterative(m_maxIterations); break;
+    case SimulationMode::EventDriven: simulateEventDriven(m_runTopologyChanged); break;
+    case SimulationMode::Levelized: simulateLevelized(); break;
     }
+}
+
+/** 时钟前进一拍（下一次仿真的准备阶段读取新电平） */
+void Engine::advanceClock() { ++m_clockTick; }
 
-    // 1. 使用元件的内存地址作为键，在 m_components 中查找并移除它
-    //    reinterpret_cast 用于将指针转换为整数类型的键
-    intptr_t componentKey = reinterpret_cast<intptr_t>(component);
-    if (m_components.remove(componentKey)) {
-        // 2. 如果成功移除了键值对，说明元件确实存在于Map中，
-        //    现在可以安全地释放它占用的内存了
-        delete component;
+/** @return 当前时钟节拍数 */
+quint64 Engine::clockTick() const { return m_clockTick; }
+
+/** 仿真第三步：把本次发生变化的引脚写回 Pin 对象，并整理收敛诊断 */
+void Engine::commitSimulation()
+{
+    syncPinsFromNetlist();
+    m_lastResult.iterations = m_lastIterationCount;
+    m_lastResult.converged = m_lastRunConverged || !m_diagnoseRun;
+    m_lastResult.cyclePeriod = m_lastResult.converged ? 0 : m_cyclePeriod;
+    m_lastResult.oscillatingPins.clear();
+    if (!m_lastResult.converged) {
+        std::sort(m_oscillatingPins.begin(), m_oscillatingPins.end());
+        m_lastResult.oscillatingPins.reserve(m_oscillatingPins.size());
+        for (int pin : m_oscillatingPins) { m_lastResult.oscillatingPins.append(m_netlist.pins[pin]); }
     }
 }
-/** 删除导线并释放 */
-void Engine::deleteWire(Wire* wire) { if (!wire) return; m_wires.removeAll(wire); delete wire; }
 
-/**
- * @brief 从JSON加载电路（先清空，再内部加载并simulate）。
- * @param json 完整电路的JSON对象（components + wires）
- * @return 成功返回true，失败返回false
- */
-bool Engine::loadCircuitFromJson(const QJsonObject& json)
+/** 设置仿真模式，并递归同步到封装元件的内部引擎 */
+void Engine::setSimulationMode(SimulationMode mode)
 {
-    // 使命A：清空！
-    clearAll();
-
-    // 调用底层函数完成加载
-    if (loadCircuitInternal(json)) {
-        // 加载成功后，运行一次仿真以更新所有引脚的初始状态
-        simulate();
-        return true;
+    // 切换后第一次仿真按全量方式执行，保证两种模式间的状态衔接
+    m_simulationMode = mode;
+    m_topologyDirty = true;
+    for (Component* comp : m_components) {
+        if (comp->type() == ComponentType::Encapsulated) {
+            static_cast<EncapsulatedComponent*>(comp)->m_internalEngine->setSimulationMode(mode);
+        }
     }
-
-    return false;
-}
-/** 清空所有组件与导线 */
-void Engine::clearAll() {
-    qDeleteAll(m_wires);
-    m_wires.clear();
-    qDeleteAll(m_components.values());
-    m_components.clear();
 }
 
-/**
- * @brief 将当前电路序列化为JSON：组件+导线。
- * @return 代表电路的JSON对象
- */
-QJsonObject Engine::saveCircuitToJson() const
-{
-    QJsonObject circuitJson; // 这是最终要返回的JSON总对象
-    QJsonArray componentsArray; // 用于存放所有元件信息的数组
-    QJsonArray wiresArray;      // 用于存放所有导线信息的数组
+/** @return 当前仿真模式 */
+SimulationMode Engine::simulationMode() const { return m_simulationMode; }
 
-    // 1. 遍历所有元件，将它们的信息序列化
-    for (Component* comp : m_components.values()) {
-        QJsonObject compObject;
-        // 使用元件在内存中的地址作为其独一无二的ID
-        compObject["id"] = reinterpret_cast<qint64>(comp);
-        compObject["type"] = static_cast<int>(comp->type());
-        compObject["x"] = comp->position().x();
-        compObject["y"] = comp->position().y();
+/** 设置迭代上限，并递归同步到封装元件的内部引擎 */
+void Engine::setMaxIterations(int iterations)
+{
+    m_maxIterations = qMax(1, iterations);
+    for (Component* comp : m_components) {
         if (comp->type() == ComponentType::Encapsulated) {
-            // 如果是封装元件，额外保存其内部电路的JSON定义
-            auto encapsulatedComp = static_cast<EncapsulatedComponent*>(comp);
-            compObject["name"] = encapsulatedComp->getName();
-            compObject["internal_circuit"] = encapsulatedComp->getInternalJson();
+            static_cast<EncapsulatedComponent*>(comp)->m_internalEngine->setMaxIterations(m_maxIterations);
         }
-        componentsArray.append(compObject);
     }
+}
 
-    // 2. 遍历所有导线，将它们的信息序列化
-    for (Wire* wire : m_wires) {
-        QJsonObject wireObject;
-        // 记录导线连接的起始元件ID和引脚索引
-        wireObject["start_comp_id"] = reinterpret_cast<qint64>(wire->startPin()->owner());
-        wireObject["start_pin_index"] = wire->startPin()->index();
-        // 记录导线连接的终止元件ID和引脚索引
-        wireObject["end_comp_id"] = reinterpret_cast<qint64>(wire->endPin()->owner());
-        wireObject["end_pin_index"] = wire->endPin()->index();
+/** @return 迭代上限 */
+int Engine::maxIterations() const { return m_maxIterations; }
 
-        wiresArray.append(wireObject);
-    }
+/** @return 上一次仿真是否在迭代上限内达到稳定 */
+bool Engine::lastRunConverged() const { return m_lastRunConverged; }
 
-    // 3. 将元件数组和导线数组放入总对象中
-    circuitJson["components"] = componentsArray;
-    circuitJson["wires"] = wiresArray;
+/** @return 上一次提交的收敛诊断 */
+const SimulationResult& Engine::lastSimulationResult() const { return m_lastResult; }
 
-    return circuitJson;
-}
-// ===============================================
-// === EncapsulatedComponent 实现
-// ===============================================
+/** @return 上一次仿真执行的迭代轮数 */
+int Engine::lastIterationCount() const { return m_lastIterationCount; }
 
-/** 构造封装元件：创建内部引擎并载入内部电路，随后构建引脚映射 */
-EncapsulatedComponent::EncapsulatedComponent(const QPointF& pos, const QString& name, const QJsonObject& internalCircuitJson)
-    : Component(ComponentType::Encapsulated, pos, 0, 0),
-    m_internalEngine(new Engine()),
-    m_internalCircuitJson(internalCircuitJson),
-    m_name(name)
-{
-    // 1. 加载内部电路到迷你引擎
-    m_internalEngine->loadCircuitInternal(m_internalCircuitJson);
+/** @return 最近一次失败操作的原因（成功时为空） */
+QString Engine::lastError() const { return m_lastError; }
 
-    // 2. 根据内部电路的 Input/Output 元件，建立引脚映射并创建外部引脚
-    buildPinMappings();
+/** @return 上一次同步回 Pin 对象时状态发生变化的引脚 */
+const QVector<Pin*>& Engine::lastChangedPins() const { return m_changedPins; }
+
+/** 换用波形记录器：先摘下旧的，再让新的登记当前电平 */
+void Engine::setWaveformRecorder(WaveformRecorder* recorder)
+{
+    if (m_waveform == recorder) return;
+    WaveformRecorder* previous = m_waveform;
+    m_waveform = nullptr;
+    if (previous) previous->detach();
+    if (recorder) recorder->attach(this);
+    m_waveform = recorder;
 }
+/** @return 当前挂着的波形记录器 */
+WaveformRecorder* Engine::waveformRecorder() const { return m_waveform; }
 
-/** 析构：释放内部引擎 */
-EncapsulatedComponent::~EncapsulatedComponent()
+/** 设置是否展平层次；内部引擎的网表随之失效，需要重新编译 */
+void Engine::setFlattenHierarchy(bool enabled)
 {
-    delete m_internalEngine;
+    if (m_flattenHierarchy == enabled) return;
+    m_flattenHierarchy = enabled;
+    markHierarchyDirty();
 }
 
-/** 获取封装元件名称 */
-QString EncapsulatedComponent::getName() const
+/** @return 是否展平层次 */
+bool Engine::flattenHierarchy() const { return m_flattenHierarchy; }
+
+/**
+ * @brief 判断电路是否含反馈环。
+ * @details 复用分层调度的强连通分量计算；未展平时，内部含反馈环的封装元件本身不会被识别，
+ * 需要完整判断时应先开启层次展平。
+ */
+bool Engine::hasFeedbackLoops()
 {
-    return m_name;
+    if (m_topologyDirty) { compileNetlist(); }
+    levelizeNetlist();
+    return m_netlist.blockCyclic.contains(true);
 }
 
+/** 批量仿真中每个引脚占用的 64 位字数（256 组输入/遍，便于编译器生成 AVX2 代码） */
+static const int kBatchWords = 4;
+/** 每遍批量仿真计算的输入向量组数 */
+static const int kBatchLanes = kBatchWords * 64;
+
 /**
- * @brief 构建外部引脚与内部Input/Output的映射，并按Y坐标排序保持一致。
- * @return 无返回值
+ * @brief 位并行批量仿真：每个引脚是 kBatchWords 个 64 位字，每一位对应一组输入。
+ * @details 基本门直接映射为按字的 AND/OR/XOR/NOT；每轮与迭代求稳完全相同（清零输入-驱动源-传播-计算），
+ * 直到所有组都稳定或达到迭代上限。已稳定的组在后续轮次中保持不变，因此与逐组仿真结果一致。
+ * 达到上限时，最后一轮仍有引脚变化的组在 settled 中标为 false，其输出是上限时刻的状态，调用方不应把它当作稳定结果。
  */
-void EncapsulatedComponent::buildPinMappings()
+bool Engine::simulateBatch(const QVector<QVector<bool>>& inputVectors, QVector<QVector<bool>>& outputVectors,
+                           QVector<bool>* settled)
 {
-    // --- 1. 先收集所有内部的 Input 和 Output 元件 ---
-    QVector<Component*> internalInputComps;
-    QVector<Component*> internalOutputComps;
+    outputVectors.clear();
+    if (settled) settled->clear();
+    // 拓扑变化时先编译；保留脏标记，让下一次 simulate() 仍按“拓扑刚变化”处理
+    if (m_topologyDirty) { compileNetlist(); }
+    const CompiledNetlist& net = m_netlist;
+    if (!net.encapsulatedGates.isEmpty()) {
+        qWarning() << "simulateBatch: 电路含时序封装元件，请先开启层次展平（setFlattenHierarchy）再批量仿真";
+        return false;
+    }
+
+    QVector<int> sourcePins;
+    for (Component* comp : orderedInputs()) { sourcePins.append(comp->outputPins()[0]->stateIndex()); }
+    QVector<int> sinkPins;
+    for (Component* comp : orderedOutputs()) { sinkPins.append(comp->inputPins()[0]->stateIndex()); }
+    for (const QVector<bool>& vector : inputVectors) {
+        if (vector.size() != sourcePins.size()) {
+            qWarning() << "simulateBatch: 输入向量长度" << vector.size() << "与输入源数量" << sourcePins.size() << "不符";
+            return false;
+        }
+    }
+
+    const int maxIterations = m_maxIterations;
+    const int pinCount = net.pins.size();
+    const size_t stateBytes = static_cast<size_t>(pinCount) * kBatchWords * sizeof(quint64);
+    QVector<quint64> words(pinCount * kBatchWords);
+    QVector<quint64> previous(pinCount * kBatchWords);
+    QVector<quint64> sourceWords(sourcePins.size() * kBatchWords);
+
+    for (int first = 0; first < inputVectors.size(); first += kBatchLanes) {
+        const int lanes = qMin(kBatchLanes, int(inputVectors.size()) - first);
+
+        // --- 1. 打包：当前状态广播到所有组；不足一遍的空位复用第一组输入 ---
+        for (int pin = 0; pin < pinCount; ++pin) {
+            const quint64 value = net.states[pin] ? ~quint64(0) : quint64(0);
+            for (int w = 0; w < kBatchWords; ++w) { words[pin * kBatchWords + w] = value; }
+        }
+        sourceWords.fill(0);
+        for (int lane = 0; lane < kBatchLanes; ++lane) {
+            const QVector<bool>& vector = inputVectors[first + (lane < lanes ? lane : 0)];
+            for (int i = 0; i < sourcePins.size(); ++i) {
+                if (vector[i]) { sourceWords[i * kBatchWords + lane / 64] |= quint64(1) << (lane % 64); }
+            }
+        }
+
+        // --- 2. 逐轮求稳（所有组同时） ---
+        quint64* s = words.data();
+        bool stateChanged = true;
+        for (int iteration = 0; iteration < maxIterations && stateChanged; ++iteration) {
+            std::memcpy(previous.data(), s, stateBytes);
+            std::memset(s, 0, static_cast<size_t>(net.inputPinCount) * kBatchWords * sizeof(quint64));
+            for (int i = 0; i < sourcePins.size(); ++i) {
+                for (int w = 0; w < kBatchWords; ++w) { s[sourcePins[i] * kBatchWords + w] = sourceWords[i * kBatchWords + w]; }
+            }
+            for (int wire = 0; wire < net.wireSources.size(); ++wire) {
+                const quint64* from = s + net.wireSources[wire] * kBatchWords;
+                quint64* to = s + net.wireSinks[wire] * kBatchWords;
+                for (int w = 0; w < kBatchWords; ++w) { to[w] = from[w]; }
+            }
+            for (int gate = 0; gate < net.ops.size(); ++gate) {
+                const int* in = net.inputPins.constData() + net.inputOffsets[gate];
+                const int* out = net.outputPins.constData() + net.outputOffsets[gate];
+                const GateOp op = net.ops[gate];
+                if (op == GateOp::Source || op == GateOp::Sink) continue;
+                if (op == GateOp::Lut) {
+                    // 查表门逐组查表：把各输入字的同一位拼成下标
+                    const int inputCount = net.inputOffsets[gate + 1] - net.inputOffsets[gate];
+                    const int outputCount = net.outputOffsets[gate + 1] - net.outputOffsets[gate];
+                    const QVector<quint32>& table = *net.lookupTables[gate];
+                    for (int k = 0; k < outputCount; ++k) {
+                        for (int w = 0; w < kBatchWords; ++w) { s[out[k] * kBatchWords + w] = 0; }
+                    }
+                    for (int lane = 0; lane < kBatchLanes; ++lane) {
+                        const int word = lane / 64;
+                        const int bit = lane % 64;
+                        quint32 index = 0;
+                        for (int k = 0; k < inputCount; ++k) {
+                            index |= quint32((s[in[k] * kBatchWords + word] >> bit) & 1) << k;
+                        }
+                        const quint32 value = table[index];
+                        for (int k = 0; k < outputCount; ++k) {
+                            s[out[k] * kBatchWords + word] |= quint64((value >> k) & 1) << bit;
+                        }
+                    }
+                    continue;
+                }
+                const quint64* a = s + in[0] * kBatchWords;
+                const quint64* b = (op == GateOp::Not || op == GateOp::Buf) ? a : s + in[1] * kBatchWords;
+                quint64* y = s + out[0] * kBatchWords;
+                switch (op) {
+                case GateOp::And:  for (int w = 0; w < kBatchWords; ++w) { y[w] = a[w] & b[w]; } break;
+                case GateOp::Or:   for (int w = 0; w < kBatchWords; ++w) { y[w] = a[w] | b[w]; } break;
+                case GateOp::Not:  for (int w = 0; w < kBatchWords; ++w) { y[w] = ~a[w]; } break;
+                case GateOp::Nand: for (int w = 0; w < kBatchWords; ++w) { y[w] = ~(a[w] & b[w]); } break;
+                case GateOp::Nor:  for (int w = 0; w < kBatchWords; ++w) { y[w] = ~(a[w] | b[w]); } break;
+                case GateOp::Xor:  for (int w = 0; w < kBatchWords; ++w) { y[w] = a[w] ^ b[w]; } break;
+                case GateOp::Xnor: for (int w = 0; w < kBatchWords; ++w) { y[w] = ~(a[w] ^ b[w]); } break;
+                case GateOp::Buf:  for (int w = 0; w < kBatchWords; ++w) { y[w] = a[w]; } break;
+                default: break;
+                }
+            }
+            stateChanged = std::memcmp(previous.constData(), s, stateBytes) != 0;
+        }
+
+        // --- 3. 未稳定的组：最后一轮中有任一引脚变化的位 ---
+        quint64 unsettled[kBatchWords] = {};
+        if (stateChanged) {
+            for (int k = 0; k < pinCount * kBatchWords; ++k) { unsettled[k % kBatchWords] |= previous[k] ^ s[k]; }
+        }
 
-    for (Component* comp : m_internalEngine->getAllComponents().values()) {
-        if (comp->type() == ComponentType::Input) {
-            internalInputComps.append(comp);
-        } else if (comp->type() == ComponentType::Output) {
-            internalOutputComps.append(comp);
+        // --- 4. 解包输出 ---
+        for (int lane = 0; lane < lanes; ++lane) {
+            QVector<bool> outputs(sinkPins.size());
+            for (int i = 0; i < sinkPins.size(); ++i) {
+                outputs[i] = (s[sinkPins[i] * kBatchWords + lane / 64] >> (lane % 64)) & 1;
+            }
+            outputVectors.append(outputs);
+            if (settled) settled->append(((unsettled[lane / 64] >> (lane % 64)) & 1) == 0);
         }
     }
+    return true;
+}
 
-    // --- 2. 【核心修改】根据 Y 坐标对它们进行排序 ---
-    // C++ Lambda 表达式用于定义一个临时的比较函数
-    std::sort(internalInputComps.begin(), internalInputComps.end(),
+/** @return 按 Y 坐标排序的输入源组件 */
+QVector<Component*> Engine::orderedInputs() const
+{
+    QVector<Component*> inputs;
+    for (Component* comp : m_components) {
+        if (comp->type() == ComponentType::Input) { inputs.append(comp); }
+    }
+    std::sort(inputs.begin(), inputs.end(),
               [](const Component* a, const Component* b) {
-                  return a->position().y() < b->position().y();
+                  if (a->position().y() != b->position().y()) return a->position().y() < b->position().y();
+                  return a->position().x() < b->position().x();
               }
               );
-    std::sort(internalOutputComps.begin(), internalOutputComps.end(),
+    return inputs;
+}
+
+/** @return 按 Y 坐标排序的输出端组件 */
+QVector<Component*> Engine::orderedOutputs() const
+{
+    QVector<Component*> outputs;
+    for (Component* comp : m_components) {
+        if (comp->type() == ComponentType::Output) { outputs.append(comp); }
+    }
+    std::sort(outputs.begin(), outputs.end(),
               [](const Component* a, const Component* b) {
-                  return a->position().y() < b->position().y();
+                  if (a->position().y() != b->position().y()) return a->position().y() < b->position().y();
+                  return a->position().x() < b->position().x();
               }
               );
+    return outputs;
+}
 
-    // --- 3. 按照排序后的顺序，建立引脚映射 ---
-    for (Component* comp : internalInputComps) {
-        m_internalInputs.append(comp->outputPins()[0]);
-    }
-    for (Component* comp : internalOutputComps) {
-        m_internalOutputs.append(comp->inputPins()[0]);
-    }
-
-    // --- 4. 根据最终的引脚数量，动态创建自己的外部引脚 ---
-    for (int i = 0; i < m_internalInputs.size(); ++i) {
-        m_inputPins.append(new Pin(this, Pin::Input, i));
+/**
+ * @brief 运行传播-评估循环，直到稳定或达到最大迭代次数。
+ * @details 处理删除导线后的残留状态，通过在每轮开始清零非源头输入引脚修复。
+ * 未稳定时把最后一轮变化的输出引脚记入 m_pendingOutputs，活动驱动模式的下一次仿真从这里接着传播。
+ */
+void Engine::simulateIterative(int maxRounds, bool stopWhenStable)
+{
+    const size_t stateBytes = static_cast<size_t>(m_netlist.states.size());
+    const int windowStart = m_diagnoseRun ? maxRounds - kOscillationWindow : maxRounds;
+    m_oscillatingPins.clear();
+    bool stateChangedInLastIteration = true;
+    int rounds = 0;
+
+    for (; rounds < maxRounds && (stateChangedInLastIteration || !stopWhenStable); ++rounds) {
+        // --- 快照 → 全量一轮 → 整块比较 ---
+        std::memcpy(m_previousStates.data(), m_netlist.states.constData(), stateBytes);
+        runFullRound();
+        stateChangedInLastIteration = std::memcmp(m_previousStates.constData(), m_netlist.states.constData(), stateBytes) != 0;
+        if (rounds >= windowStart) { recordOscillationRound(m_previousStates.constData()); }
     }
-    for (int i = 0; i < m_internalOutputs.size(); ++i) {
-        m_outputPins.append(new Pin(this, Pin::Output, i));
+    m_lastRunConverged = !stateChangedInLastIteration;
+    m_lastIterationCount = rounds;
+    finishOscillationWindow(m_lastRunConverged || !m_diagnoseRun);
+
+    m_pendingOutputs.clear();
+    if (stateChangedInLastIteration) {
+        const char* before = m_previousStates.constData();
+        const char* after = m_netlist.states.constData();
+        for (int pin = m_netlist.inputPinCount; pin < m_netlist.pins.size(); ++pin) {
+            if (before[pin] != after[pin]) { m_pendingOutputs.append(pin); }
+        }
     }
 }
 
 /**
- * @brief 评估封装元件：
- * 1) 同步外部输入到内部Input；2) 运行内部引擎；3) 回填内部Output到外部输出。
- * @return 无返回值
+ * @brief 活动驱动仿真：每个“单位延迟”节拍只处理上一拍状态发生变化的输出引脚的扇出。
+ * @details 与 simulateIterative() 的语义逐拍等价：
+ * - 每拍先把上一拍的输出沿导线送到输入（输出引脚充当“微型锁存器”），再计算输入发生变化的门；
+ * - 拓扑变化后的第一拍按全量方式执行（等价于迭代模式的一轮），以正确清零悬空输入；
+ * - 只要上一拍有任何引脚变化，内部尚未稳定的封装元件就会在下一拍再次评估，与迭代模式每轮都评估它的行为一致；
+ * - 因达到迭代上限而未传播的输出变化会保留到下一次调用继续传播。
  */
-void EncapsulatedComponent::evaluate()
+void Engine::simulateEventDriven(bool fullFirstRound)
 {
-    // 1. 将外部输入引脚的状态，传递给内部电路对应的 Input 元件
-    for (int i = 0; i < m_inputPins.size(); ++i) {
-        bool externalState = m_inputPins[i]->getState();
-        Component* internalInputComp = m_internalInputs[i]->owner();
-        // 我们需要一种方式来直接设置 Input 元件的状态
-        // 我们去给 Input 类加一个 setState 方法
-        static_cast<Input*>(internalInputComp)->setState(externalState);
+    CompiledNetlist& net = m_netlist;
+    const int maxIterations = m_maxIterations;
+    int iteration = 0;
+    QVector<int> changedOutputs;
+    bool inputsChanged = false;
+
+    if (fullFirstRound) {
+        // --- 拓扑变化后：先执行一轮全量迭代作为种子 ---
+        std::memcpy(m_previousStates.data(), net.states.constData(), static_cast<size_t>(net.states.size()));
+        runFullRound();
+
+        const char* before = m_previousStates.constData();
+        const char* after = net.states.constData();
+        inputsChanged = std::memcmp(before, after, static_cast<size_t>(net.inputPinCount)) != 0;
+        for (int pin = net.inputPinCount; pin < net.pins.size(); ++pin) {
+            if (before[pin] != after[pin]) { changedOutputs.append(pin); }
+        }
+        ++iteration;
+    } else {
+        // --- 拓扑未变：以上次遗留的变化和所有输入源作为种子（其状态可能已被 toggleState/setState 改变） ---
+        changedOutputs = m_pendingOutputs;
+        char* s = net.states.data();
+        for (int i = 0; i < net.sourceGates.size(); ++i) {
+            const int pin = net.outputPins[net.outputOffsets[net.sourceGates[i]]];
+            s[pin] = m_sourceValues[i];
+            changedOutputs.append(pin);
+        }
     }
 
-    // 2. 运行内部电路的仿真
-    m_internalEngine->simulate();
+    // 内部尚未稳定的封装元件，需要在后续节拍中继续评估
+    QVector<int> unsettled;
+    for (int gate : net.encapsulatedGates) {
+        if (!static_cast<EncapsulatedComponent*>(net.components[gate])->isInternallySettled()) {
+            unsettled.append(gate);
+        }
+    }
 
-    // 3. 从内部电路的 Output 元件获取状态，设置到自己的外部输出引脚上
-    for (int i = 0; i < m_outputPins.size(); ++i) {
-        bool internalState = m_internalOutputs[i]->getState();
-        m_outputPins[i]->setState(internalState);
+    // 拓扑未变时第一拍总是执行（对应迭代模式的第一轮）
+    bool stateChanged = (iteration == 0) || !changedOutputs.isEmpty() || inputsChanged;
+    QVector<int> dirtyGates;
+    QVector<char> oldOutputs;
+    char* marks = m_gateMarks.data();
+    const int windowStart = maxIterations - kOscillationWindow;
+    m_oscillatingPins.clear();
+
+    while (stateChanged && iteration < maxIterations) {
+        char* s = net.states.data();
+        const bool observed = iteration >= windowStart; // 观察窗口内：记录本拍翻转的引脚
+        if (observed) { std::memcpy(m_previousStates.data(), s, static_cast<size_t>(net.states.size())); }
+
+        // 1. 传播：只把发生变化的输出送往其扇出
+        dirtyGates.clear();
+        inputsChanged = false;
+        for (int source : changedOutputs) {
+            const char state = s[source];
+            for (int k = net.fanoutOffsets[source]; k < net.fanoutOffsets[source + 1]; ++k) {
+                const int sink = net.fanoutSinks[k];
+                if (s[sink] != state) {
+                    s[sink] = state;
+                    inputsChanged = true;
+                    const int owner = net.pinOwners[sink];
+                    if (!marks[owner]) { marks[owner] = 1; dirtyGates.append(owner); }
+                }
+            }
+        }
+        for (int gate : unsettled) {
+            if (!marks[gate]) { marks[gate] = 1; dirtyGates.append(gate); }
+        }
+        if (dirtyGates.isEmpty()) { stateChanged = false; break; }
+
+        // 2. 计算：只计算输入发生变化的门，收集新的变化输出
+        changedOutputs.clear();
+        unsettled.clear();
+        for (int gate : dirtyGates) {
+            marks[gate] = 0;
+            const int begin = net.outputOffsets[gate];
+            const int end = net.outputOffsets[gate + 1];
+            oldOutputs.resize(end - begin);
+            for (int k = begin; k < end; ++k) { oldOutputs[k - begin] = s[net.outputPins[k]]; }
+            evaluateGate(gate);
+            for (int k = begin; k < end; ++k) {
+                if (s[net.outputPins[k]] != oldOutputs[k - begin]) { changedOutputs.append(net.outputPins[k]); }
+            }
+            if (net.ops[gate] == GateOp::Encapsulated
+                && !static_cast<EncapsulatedComponent*>(net.components[gate])->isInternallySettled()) {
+                unsettled.append(gate);
+            }
+        }
+        ++iteration;
+        stateChanged = !changedOutputs.isEmpty() || inputsChanged;
+        if (observed) { recordOscillationRound(m_previousStates.constData()); }
     }
+    m_lastRunConverged = !stateChanged;
+    m_lastIterationCount = iteration;
+    m_pendingOutputs = stateChanged ? changedOutputs : QVector<int>();
+    finishOscillationWindow(m_lastRunConverged);
 }
 
-/** @return 内部电路定义JSON（只读引用） */
-const QJsonObject& EncapsulatedComponent::getInternalJson() const
+/** 一个波次的门数达到此值时才并行计算（太小的波次线程调度开销大于收益） */
+static const int kParallelWaveGates = 4096;
+
+/** 并行分层求值中交给一个线程的连续调度块 */
+struct LevelChunk {
+    int firstBlock;
+    int lastBlock;
+    /** 该段内的反馈环是否全部稳定 */
+    bool converged;
+    /** 该段内反馈环用到的最多迭代轮数 */
+    int rounds;
+    /** 该段内未稳定的反馈环中仍在翻转的引脚 */
+    QVector<int> oscillatingPins;
+    /** 该段内未稳定的反馈环的合并周期 */
+    int cyclePeriod;
+};
+
+/** 周期合并的上限：超过它视为未检测到周期 */
+static const int kMaxCombinedPeriod = 1 << 20;
+
+/** 合并两个独立反馈环的振荡周期：整体周期为最小公倍数；任一为 0（未检测到）或结果过大时为 0 */
+static int combineCyclePeriods(int a, int b)
+{
+    if (a <= 0 || b <= 0) return 0;
+    int x = a;
+    int y = b;
+    while (y != 0) {
+        const int r = x % y;
+        x = y;
+        y = r;
+    }
+    const qint64 lcm = qint64(a / x) * b;
+    return lcm > kMaxCombinedPeriod ? 0 : int(lcm);
+}
+
+/** 状态字节序列的 64 位 FNV-1a 哈希（振荡周期检测只比较各轮的哈希） */
+static quint64 stateHash(const char* data, int size)
 {
-    return m_internalCircuitJson;
+    quint64 hash = 14695981039346656037ULL;
+    for (int i = 0; i < size; ++i) {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+/** 最小的周期 p：最后一轮的状态与 p 轮之前相同（状态决定此后的演化，因此从那里起按 p 循环）；找不到返回 0 */
+static int findCyclePeriod(const QVector<quint64>& hashes)
+{
+    const int last = hashes.size() - 1;
+    for (int period = 1; period <= last; ++period) {
+        if (hashes[last - period] == hashes[last]) return period;
+    }
+    return 0;
 }
 
 /**
- * @brief 手动注册一个外部创建的组件（封装元件等）。
- * @param component 需要注册到引擎管理的组件指针
- * @return 无返回值
+ * @brief 分层求值：按调度块的拓扑序计算。
+ * @details 无环的门在上游全部算完后只计算一次（输入直接取自驱动引脚，悬空输入为0）；
+ * 反馈环内部保持“单位延迟”迭代：每轮先为环内所有门装载输入，再统一计算，直到环内引脚不再变化或达到上限。
+ * 同一波次的调度块互不依赖，门数足够多时切分给线程池并行计算；各块只写自己的引脚，结果与顺序计算完全相同。
  */
-void Engine::registerComponent(Component* component)
+void Engine::simulateLevelized()
 {
-    if (component) {
-        m_components.insert(reinterpret_cast<intptr_t>(component), component);
+    CompiledNetlist& net = m_netlist;
+    char* s = net.states.data();
+    bool converged = true;
+    int rounds = 1;
+    QVector<char> oldOutputs;
+    m_oscillatingPins.clear();
+    int cyclePeriod = 1; // 最小公倍数的单位元
+
+    for (int i = 0; i < net.sourceGates.size(); ++i) {
+        s[net.outputPins[net.outputOffsets[net.sourceGates[i]]]] = m_sourceValues[i];
+    }
+
+    for (int wave = 0; wave + 1 < net.waveOffsets.size(); ++wave) {
+        const int firstBlock = net.waveOffsets[wave];
+        const int lastBlock = net.waveOffsets[wave + 1];
+        const int gateCount = net.blockOffsets[lastBlock] - net.blockOffsets[firstBlock];
+        const int threadCount = QThreadPool::globalInstance()->maxThreadCount();
+
+        if (gateCount < kParallelWaveGates || threadCount < 2 || lastBlock - firstBlock < 2) {
+            for (int block = firstBlock; block < lastBlock; ++block) {
+                if (!evaluateLevelBlock(block, oldOutputs, rounds, m_oscillatingPins, cyclePeriod)) { converged = false; }
+            }
+            continue;
+        }
+
+        // --- 按门数把本波次切成若干段，每段交给一个线程 ---
+        QVector<LevelChunk> chunks;
+        const int chunkGates = (gateCount + threadCount - 1) / threadCount;
+        int chunkBegin = firstBlock;
+        for (int block = firstBlock; block < lastBlock; ++block) {
+            const bool lastOfWave = block + 1 == lastBlock;
+            if (lastOfWave || net.blockOffsets[block + 1] - net.blockOffsets[chunkBegin] >= chunkGates) {
+                chunks.append(LevelChunk{chunkBegin, block + 1, true, 1, QVector<int>(), 1});
+                chunkBegin = block + 1;
+            }
+        }
+        QtConcurrent::blockingMap(chunks, [this](LevelChunk& chunk) {
+            QVector<char> scratch;
+            for (int block = chunk.firstBlock; block < chunk.lastBlock; ++block) {
+                if (!evaluateLevelBlock(block, scratch, chunk.rounds, chunk.oscillatingPins, chunk.cyclePeriod)) {
+                    chunk.converged = false;
+                }
+            }
+        });
+        for (const LevelChunk& chunk : chunks) {
+            if (!chunk.converged) {
+                converged = false;
+                m_oscillatingPins += chunk.oscillatingPins;
+                cyclePeriod = combineCyclePeriods(cyclePeriod, chunk.cyclePeriod);
+            }
+            rounds = qMax(rounds, chunk.rounds);
+        }
     }
+    m_lastRunConverged = converged;
+    m_lastIterationCount = rounds;
+    m_cyclePeriod = converged ? 0 : cyclePeriod;
 }
+
 /**
- * @brief 内部加载函数：不清空现有内容，使用ID映射重建组件与导线。
- * @param json 完整电路JSON
- * @return 成功返回true，失败返回false
+ * @brief 计算一个调度块。
+ * @param block 调度块编号
+ * @param oldOutputs 反馈环迭代时暂存输出的缓冲区（每个线程一份）
+ * @param rounds [in,out] 取其与本块所用迭代轮数的较大值
+ * @param oscillatingPins [out] 反馈环未稳定时追加观察窗口内翻转过的环内引脚
+ * @param cyclePeriod [in,out] 反馈环未稳定时与环内输出的重复周期合并
+ * @return 无环块总是返回 true；反馈环在迭代上限内稳定返回 true
+ * @details 翻转标记只写本块的引脚，返回前清回，因此并发计算不同的块互不干扰。
  */
-bool Engine::loadCircuitInternal(const QJsonObject& json)
+bool Engine::evaluateLevelBlock(int block, QVector<char>& oldOutputs, int& rounds, QVector<int>& oscillatingPins, int& cyclePeriod)
 {
-    // 【核心】没有 clearAll()
-    if (!json.contains("components") || !json["components"].isArray()) {
-        qWarning("JSON load error: 'components' array not found or is not an array.");
-        return false;
+    CompiledNetlist& net = m_netlist;
+    const int maxIterations = m_maxIterations;
+    char* s = net.states.data();
+    const int begin = net.blockOffsets[block];
+    const int end = net.blockOffsets[block + 1];
+
+    // --- 无环：装载输入后计算一次 ---
+    if (!net.blockCyclic[block]) {
+        const int gate = net.levelOrder[begin];
+        for (int k = net.inputOffsets[gate]; k < net.inputOffsets[gate + 1]; ++k) {
+            const int pin = net.inputPins[k];
+            s[pin] = net.pinDrivers[pin] >= 0 ? s[net.pinDrivers[pin]] : 0;
+        }
+        evaluateGate(gate);
+        return true;
     }
 
-    QMap<qint64, Component*> idMap;
-    const QJsonArray componentsArray = json["components"].toArray();
-
-    for (const QJsonValue &compValue : componentsArray) {
-        QJsonObject compObject = compValue.toObject();
-        qint64 id = compObject["id"].toInteger();
-        Component* newComponent = createComponent(compObject);
-        if (newComponent) {
-            idMap[id] = newComponent;
-        } else {
-            // 清理已创建的元件以防内存泄漏
-            qDeleteAll(m_components.values());
-            m_components.clear();
-            return false;
+    // --- 反馈环：块内迭代求稳；观察窗口内记录翻转的引脚与每轮输出的哈希 ---
+    const int windowStart = maxIterations - kOscillationWindow;
+    char* toggled = m_toggledPins.data();
+    QVector<int> toggledPins;
+    QVector<quint64> hashes;
+    bool changed = true;
+    int iteration = 0;
+    for (; iteration < maxIterations && changed; ++iteration) {
+        const bool observed = iteration >= windowStart;
+        changed = false;
+        for (int i = begin; i < end; ++i) {
+            const int gate = net.levelOrder[i];
+            for (int k = net.inputOffsets[gate]; k < net.inputOffsets[gate + 1]; ++k) {
+                const int pin = net.inputPins[k];
+                const char value = net.pinDrivers[pin] >= 0 ? s[net.pinDrivers[pin]] : 0;
+                if (s[pin] != value) {
+                    s[pin] = value;
+                    changed = true;
+                    if (observed && !toggled[pin]) { toggled[pin] = 1; toggledPins.append(pin); }
+                }
+            }
+        }
+        quint64 hash = 14695981039346656037ULL;
+        for (int i = begin; i < end; ++i) {
+            const int gate = net.levelOrder[i];
+            const int first = net.outputOffsets[gate];
+            const int last = net.outputOffsets[gate + 1];
+            oldOutputs.resize(last - first);
+            for (int k = first; k < last; ++k) { oldOutputs[k - first] = s[net.outputPins[k]]; }
+            evaluateGate(gate);
+            for (int k = first; k < last; ++k) {
+                const int pin = net.outputPins[k];
+                if (s[pin] != oldOutputs[k - first]) {
+                    changed = true;
+                    if (observed && !toggled[pin]) { toggled[pin] = 1; toggledPins.append(pin); }
+                }
+                if (observed) { hash = (hash ^ static_cast<unsigned char>(s[pin])) * 1099511628211ULL; }
+            }
+        }
+        if (observed) { hashes.append(hash); }
+    }
+    rounds = qMax(rounds, iteration);
+
+    for (int pin : toggledPins) { toggled[pin] = 0; }
+    if (changed) {
+        oscillatingPins += toggledPins;
+        cyclePeriod = combineCyclePeriods(cyclePeriod, findCyclePeriod(hashes));
+    }
+    return !changed;
+}
+
+/**
+ * @brief 观察窗口内的一轮结束：标记与 before 相比翻转的引脚，并记录本轮结束时的状态哈希。
+ * @details 只在迭代上限前的最后 kOscillationWindow 轮调用，正常收敛的仿真不付出这部分代价。
+ */
+void Engine::recordOscillationRound(const char* before)
+{
+    const char* after = m_netlist.states.constData();
+    char* toggled = m_toggledPins.data();
+    const int pinCount = m_netlist.states.size();
+    for (int pin = 0; pin < pinCount; ++pin) {
+        if (before[pin] != after[pin] && !toggled[pin]) {
+            toggled[pin] = 1;
+            m_oscillatingPins.append(pin);
+        }
+    }
+    m_roundHashes.append(stateHash(after, pinCount));
+}
+
+/** 结束观察窗口：翻转标记清回全零；收敛时丢弃记录，否则保留振荡引脚并求周期 */
+void Engine::finishOscillationWindow(bool converged)
+{
+    char* toggled = m_toggledPins.data();
+    for (int pin : m_oscillatingPins) { toggled[pin] = 0; }
+    m_cyclePeriod = converged ? 0 : findCyclePeriod(m_roundHashes);
+    if (converged) { m_oscillatingPins.clear(); }
+    m_roundHashes.clear();
+}
+
+/**
+ * @brief 在状态数组上执行一轮全量迭代（与原始 simulate 单轮语义一致）。
+ * @details 所有输入引脚编号连续且输入源没有输入引脚，因此“清零非源头输入引脚”就是一次 memset。
+ */
+void Engine::runFullRound()
+{
+    CompiledNetlist& net = m_netlist;
+    char* s = net.states.data();
+
+    // --- 清零输入 → 驱动输入源 → 沿导线传播 → 计算所有门 ---
+    std::memset(s, 0, static_cast<size_t>(net.inputPinCount));
+    for (int i = 0; i < net.sourceGates.size(); ++i) {
+        s[net.outputPins[net.outputOffsets[net.sourceGates[i]]]] = m_sourceValues[i];
+    }
+    const int* sources = net.wireSources.constData();
+    const int* sinks = net.wireSinks.constData();
+    for (int w = 0; w < net.wireSources.size(); ++w) {
+        s[sinks[w]] = s[sources[w]];
+    }
+    for (int gate = 0; gate < net.ops.size(); ++gate) {
+        evaluateGate(gate);
+    }
+}
+
+/**
+ * @brief 在状态数组上计算一个门：基本门按运算类型直接计算，不经过虚函数。
+ * @details 封装元件仍需运行其内部引擎：先把外部输入写入其内部 Input 元件，计算后再把内部输出读回数组。
+ */
+void Engine::evaluateGate(int gate)
+{
+    CompiledNetlist& net = m_netlist;
+    char* s = net.states.data();
+    const int* in = net.inputPins.constData() + net.inputOffsets[gate];
+    const int* out = net.outputPins.constData() + net.outputOffsets[gate];
+
+    switch (net.ops[gate]) {
+    case GateOp::Source:
+    case GateOp::Sink:
+        break;
+    case GateOp::And:  s[out[0]] = s[in[0]] & s[in[1]]; break;
+    case GateOp::Or:   s[out[0]] = s[in[0]] | s[in[1]]; break;
+    case GateOp::Not:  s[out[0]] = !s[in[0]]; break;
+    case GateOp::Nand: s[out[0]] = !(s[in[0]] & s[in[1]]); break;
+    case GateOp::Nor:  s[out[0]] = !(s[in[0]] | s[in[1]]); break;
+    case GateOp::Xor:  s[out[0]] = s[in[0]] ^ s[in[1]]; break;
+    case GateOp::Xnor: s[out[0]] = !(s[in[0]] ^ s[in[1]]); break;
+    case GateOp::Buf:  s[out[0]] = s[in[0]]; break;
+    case GateOp::Lut: {
+        const int inputCount = net.inputOffsets[gate + 1] - net.inputOffsets[gate];
+        const int outputCount = net.outputOffsets[gate + 1] - net.outputOffsets[gate];
+        quint32 index = 0;
+        for (int k = 0; k < inputCount; ++k) { index |= quint32(s[in[k]]) << k; }
+        const quint32 value = net.lookupTables[gate]->at(index);
+        for (int k = 0; k < outputCount; ++k) { s[out[k]] = (value >> k) & 1; }
+        break;
+    }
+    case GateOp::Encapsulated: {
+        // 直接驱动内部 Input 元件、读取内部 Output 引脚，外部引脚对象留到提交阶段同步
+        auto encapsulated = static_cast<EncapsulatedComponent*>(net.components[gate]);
+        const QVector<Pin*>& internalInputs = encapsulated->m_internalInputs;
+        const QVector<Pin*>& internalOutputs = encapsulated->m_internalOutputs;
+        for (int k = 0; k < internalInputs.size(); ++k) {
+            static_cast<Input*>(internalInputs[k]->owner())->setState(s[in[k]] != 0);
+        }
+        encapsulated->m_internalEngine->simulate();
+        for (int k = 0; k < internalOutputs.size(); ++k) { s[out[k]] = internalOutputs[k]->getState() ? 1 : 0; }
+        break;
+    }
+    }
+}
+
+/**
+ * @brief 由 Component/Pin/Wire 对象编译结构数组网表。
+ * @details 引脚先编号所有输入引脚、再编号所有输出引脚；扇出表按输出引脚编号以 CSR 形式存放。
+ * 编译时从引脚对象读取当前状态，保证编辑前后的“微型锁存器”状态得以延续。
+ */
+void Engine::compileNetlist()
+{
+    CompiledNetlist& net = m_netlist;
+    net = CompiledNetlist();
+    QVector<NetlistGate> gates;
+    QVector<Wire*> wires;
+    // 先取代数再收集门：收集期间才生成完的表会让代数变化，下次仿真照样重新编译
+    net.lookupTableGeneration = EncapsulatedDefinition::lookupTableGeneration();
+    collectGates(this, nullptr, gates, wires);
+    for (const NetlistGate& gate : gates) {
+        if (gate.op != GateOp::Encapsulated) continue;
+        const EncapsulatedDefinition* definition = static_cast<const EncapsulatedComponent*>(gate.component)->m_definition;
+        if (definition && definition->lookupTableExpected()) { net.awaitingLookupTables = true; break; }
+    }
+
+    // 1. 引脚编号：先输入、后输出
+    for (const NetlistGate& gate : gates) {
+        for (Pin* pin : gate.inputs) { pin->setStateIndex(net.pins.size()); net.pins.append(pin); }
+    }
+    net.inputPinCount = net.pins.size();
+    for (const NetlistGate& gate : gates) {
+        for (Pin* pin : gate.outputs) { pin->setStateIndex(net.pins.size()); net.pins.append(pin); }
+    }
+
+    // 2. 门：运算类型与输入/输出引脚的 CSR 数组
+    net.pinOwners.resize(net.pins.size());
+    net.inputOffsets.append(0);
+    net.outputOffsets.append(0);
+    for (const NetlistGate& entry : gates) {
+        const int gate = net.ops.size();
+        net.ops.append(entry.op);
+        if (entry.op == GateOp::Source) { net.sourceGates.append(gate); }
+        if (entry.op == GateOp::Encapsulated) { net.encapsulatedGates.append(gate); }
+        net.lookupTables.append(entry.lookupTable);
+        net.components.append(entry.component);
+        for (Pin* pin : entry.inputs) { net.inputPins.append(pin->stateIndex()); net.pinOwners[pin->stateIndex()] = gate; }
+        for (Pin* pin : entry.outputs) { net.outputPins.append(pin->stateIndex()); net.pinOwners[pin->stateIndex()] = gate; }
+        net.inputOffsets.append(net.inputPins.size());
+        net.outputOffsets.append(net.outputPins.size());
+    }
+
+    // 3. 导线、驱动表与扇出表（计数 → 前缀和 → 填充）
+    net.fanoutOffsets.fill(0, net.pins.size() + 1);
+    net.pinDrivers.fill(-1, net.inputPinCount);
+    for (Wire* wire : wires) {
+        net.wireSources.append(wire->startPin()->stateIndex());
+        net.wireSinks.append(wire->endPin()->stateIndex());
+        net.pinDrivers[wire->endPin()->stateIndex()] = wire->startPin()->stateIndex();
+        ++net.fanoutOffsets[wire->startPin()->stateIndex() + 1];
+    }
+    for (int pin = 0; pin < net.pins.size(); ++pin) {
+        net.fanoutOffsets[pin + 1] += net.fanoutOffsets[pin];
+    }
+    net.fanoutSinks.resize(net.wireSources.size());
+    QVector<int> cursor = net.fanoutOffsets;
+    for (int w = 0; w < net.wireSources.size(); ++w) {
+        net.fanoutSinks[cursor[net.wireSources[w]]++] = net.wireSinks[w];
+    }
+
+    // 4. 状态数组与工作缓冲区
+    net.states.resize(net.pins.size());
+    for (int pin = 0; pin < net.pins.size(); ++pin) {
+        net.states[pin] = net.pins[pin]->getState() ? 1 : 0;
+    }
+    m_previousStates.resize(net.pins.size());
+    m_toggledPins = QByteArray(net.pins.size(), 0);
+    m_oscillatingPins.clear();
+    m_sourceValues.resize(net.sourceGates.size());
+    m_gateMarks = QByteArray(net.ops.size(), 0);
+    m_pendingOutputs.clear();
+
+    if (m_simulationMode == SimulationMode::Levelized) { levelizeNetlist(); }
+}
+
+/**
+ * @brief 在门级图（门 → 其输出驱动的门）上求强连通分量，生成分层调度。
+ * @details Tarjan 算法按“逆拓扑序”产出分量，最后整体反转即得拓扑序。
+ * 使用显式栈代替递归，避免长加法器链等深层电路导致栈溢出。
+ */
+void Engine::levelizeNetlist()
+{
+    CompiledNetlist& net = m_netlist;
+    const int gateCount = net.ops.size();
+
+    // 1. 门级后继表（CSR）
+    QVector<int> successorOffsets(gateCount + 1, 0);
+    QVector<int> successors;
+    for (int gate = 0; gate < gateCount; ++gate) {
+        for (int k = net.outputOffsets[gate]; k < net.outputOffsets[gate + 1]; ++k) {
+            const int pin = net.outputPins[k];
+            for (int f = net.fanoutOffsets[pin]; f < net.fanoutOffsets[pin + 1]; ++f) {
+                successors.append(net.pinOwners[net.fanoutSinks[f]]);
+            }
+        }
+        successorOffsets[gate + 1] = successors.size();
+    }
+
+    // 2. Tarjan 强连通分量
+    QVector<int> index(gateCount, -1);
+    QVector<int> lowLink(gateCount, 0);
+    QVector<bool> onStack(gateCount, false);
+    QVector<int> stack;
+    QVector<QPair<int, int>> callStack; // (门, 下一个待访问后继在 successors 中的位置)
+    QVector<int> reverseOrder;
+    QVector<int> reverseOffsets{0};
+    QVector<bool> reverseCyclic;
+    int counter = 0;
+
+    for (int root = 0; root < gateCount; ++root) {
+        if (index[root] != -1) continue;
+        index[root] = lowLink[root] = counter++;
+        stack.append(root);
+        onStack[root] = true;
+        callStack.append(qMakePair(root, successorOffsets[root]));
+
+        while (!callStack.isEmpty()) {
+            const int gate = callStack.last().first;
+            const int next = callStack.last().second;
+            if (next < successorOffsets[gate + 1]) {
+                callStack.last().second = next + 1;
+                const int successor = successors[next];
+                if (index[successor] == -1) {
+                    index[successor] = lowLink[successor] = counter++;
+                    stack.append(successor);
+                    onStack[successor] = true;
+                    callStack.append(qMakePair(successor, successorOffsets[successor]));
+                } else if (onStack[successor]) {
+                    lowLink[gate] = qMin(lowLink[gate], index[successor]);
+                }
+                continue;
+            }
+
+            // 该门的后继已全部访问：回溯，并在它是分量根时弹出整个分量
+            callStack.removeLast();
+            if (!callStack.isEmpty()) {
+                const int parent = callStack.last().first;
+                lowLink[parent] = qMin(lowLink[parent], lowLink[gate]);
+            }
+            if (lowLink[gate] == index[gate]) {
+                const int begin = reverseOrder.size();
+                int member;
+                do {
+                    member = stack.takeLast();
+                    onStack[member] = false;
+                    reverseOrder.append(member);
+                } while (member != gate);
+                bool cyclic = reverseOrder.size() - begin > 1;
+                for (int k = successorOffsets[gate]; k < successorOffsets[gate + 1] && !cyclic; ++k) {
+                    cyclic = successors[k] == gate; // 自环
+                }
+                reverseOffsets.append(reverseOrder.size());
+                reverseCyclic.append(cyclic);
+            }
+        }
+    }
+
+    // 3. 反转分量顺序得到拓扑序；每块的波次 = 上游块的最大波次 + 1
+    const int blockCount = reverseCyclic.size();
+    QVector<int> gateBlocks(gateCount);
+    QVector<int> blockWaves(blockCount, 0);
+    QVector<int> waveSizes;
+    for (int block = blockCount - 1; block >= 0; --block) {
+        for (int i = reverseOffsets[block]; i < reverseOffsets[block + 1]; ++i) { gateBlocks[reverseOrder[i]] = block; }
+    }
+    for (int block = blockCount - 1; block >= 0; --block) {
+        int wave = 0;
+        for (int i = reverseOffsets[block]; i < reverseOffsets[block + 1]; ++i) {
+            const int gate = reverseOrder[i];
+            for (int k = net.inputOffsets[gate]; k < net.inputOffsets[gate + 1]; ++k) {
+                const int driver = net.pinDrivers[net.inputPins[k]];
+                if (driver < 0) continue;
+                const int upstream = gateBlocks[net.pinOwners[driver]];
+                if (upstream != block) { wave = qMax(wave, blockWaves[upstream] + 1); }
+            }
+        }
+        blockWaves[block] = wave;
+        if (wave >= waveSizes.size()) { waveSizes.resize(wave + 1); }
+        ++waveSizes[wave];
+    }
+
+    // 4. 按波次重排调度块（同一波次内保持拓扑序），同一波次的块连续存放
+    QVector<int> waveCursor(waveSizes.size() + 1, 0);
+    for (int wave = 0; wave < waveSizes.size(); ++wave) { waveCursor[wave + 1] = waveCursor[wave] + waveSizes[wave]; }
+    net.waveOffsets = waveCursor;
+    QVector<int> scheduledBlocks(blockCount);
+    for (int block = blockCount - 1; block >= 0; --block) {
+        scheduledBlocks[waveCursor[blockWaves[block]]++] = block;
+    }
+    net.levelOrder.clear();
+    net.blockOffsets = QVector<int>{0};
+    net.blockCyclic.clear();
+    for (int block : scheduledBlocks) {
+        for (int i = reverseOffsets[block]; i < reverseOffsets[block + 1]; ++i) {
+            net.levelOrder.append(reverseOrder[i]);
+        }
+        net.blockOffsets.append(net.levelOrder.size());
+        net.blockCyclic.append(reverseCyclic[block]);
+    }
+}
+
+/**
+ * @brief 收集门与导线。
+ * @details 未展平时每个组件原样成为一个门。展平时封装元件本身不再成为门，而是递归收集其内部电路：
+ * - 内部 Input 元件 → Buf 门：输入为封装元件对应的外部输入引脚，输出为内部 Input 的输出引脚；
+ * - 内部 Output 元件 → Buf 门：输入为内部 Output 的输入引脚，输出为封装元件对应的外部输出引脚。
+ * 这样每个 Pin 对象恰好属于一个门，仿真结束后内外引脚都能按原对象同步状态。
+ */
+void Engine::collectGates(const Engine* engine, const EncapsulatedComponent* enclosing,
+                          QVector<NetlistGate>& gates, QVector<Wire*>& wires) const
+{
+    for (Component* comp : engine->m_components) {
+        NetlistGate gate{GateOp::Sink, comp, comp->inputPins(), comp->outputPins()};
+        switch (comp->type()) {
+        case ComponentType::Input:
+            gate.op = GateOp::Source;
+            if (enclosing) {
+                const int index = enclosing->m_internalInputs.indexOf(comp->outputPins()[0]);
+                gate.op = GateOp::Buf;
+                gate.inputs = QVector<Pin*>{enclosing->inputPins()[index]};
+            }
+            break;
+        case ComponentType::Output:
+            if (enclosing) {
+                const int index = enclosing->m_internalOutputs.indexOf(comp->inputPins()[0]);
+                gate.op = GateOp::Buf;
+                gate.outputs = QVector<Pin*>{enclosing->outputPins()[index]};
+            }
+            break;
+        case ComponentType::And: gate.op = GateOp::And; break;
+        case ComponentType::Or: gate.op = GateOp::Or; break;
+        case ComponentType::Not: gate.op = GateOp::Not; break;
+        case ComponentType::Nand: gate.op = GateOp::Nand; break;
+        case ComponentType::Nor: gate.op = GateOp::Nor; break;
+        case ComponentType::Xor: gate.op = GateOp::Xor; break;
+        case ComponentType::Xnor: gate.op = GateOp::Xnor; break;
+        case ComponentType::Clock: gate.op = GateOp::Source; break;
+        case ComponentType::Encapsulated: {
+            auto encapsulated = static_cast<const EncapsulatedComponent*>(comp);
+            if (m_flattenHierarchy) {
+                collectGates(encapsulated->m_internalEngine, encapsulated, gates, wires);
+                continue;
+            }
+            // 纯组合的小型定义直接查表，否则回退到内部引擎
+            gate.lookupTable = encapsulated->m_definition ? encapsulated->m_definition->lookupTable() : nullptr;
+            gate.op = gate.lookupTable ? GateOp::Lut : GateOp::Encapsulated;
+            break;
+        }
+        }
+        gates.append(gate);
+    }
+    wires += engine->m_wires;
+}
+
+/** 标记本引擎与所有内部引擎的拓扑已变化，下次仿真时各自重新编译并从 Pin 对象读取状态 */
+void Engine::markHierarchyDirty()
+{
+    m_topologyDirty = true;
+    for (Component* comp : m_components) {
+        if (comp->type() == ComponentType::Encapsulated) {
+            static_cast<EncapsulatedComponent*>(comp)->m_internalEngine->markHierarchyDirty();
+        }
+    }
+}
+
+/** 只把本次仿真中状态发生变化的引脚写回引脚对象（编辑视图） */
+void Engine::syncPinsFromNetlist()
+{
+    const char* before = m_runStartStates.constData();
+    const char* after = m_netlist.states.constData();
+    m_changedPins.clear();
+    for (int pin = 0; pin < m_netlist.pins.size(); ++pin) {
+        if (before[pin] != after[pin]) {
+            m_netlist.pins[pin]->setState(after[pin] != 0);
+            m_changedPins.append(m_netlist.pins[pin]);
+        }
+    }
+    if (m_waveform) m_waveform->recordCommit(m_changedPins);
+}
+
+/** 登记组件：分配稳定ID（优先复用空闲槽位）、让封装元件的内部引擎跟随当前仿真模式，并标记拓扑变化 */
+void Engine::insertComponent(Component* component)
+{
+    if (m_freeComponentIds.isEmpty()) {
+        component->m_id = quint32(m_componentSlots.size());
+        m_componentSlots.append(m_components.size());
+    } else {
+        component->m_id = m_freeComponentIds.takeLast();
+        m_componentSlots[component->m_id] = m_components.size();
+    }
+    m_components.append(component);
+    if (component->type() == ComponentType::Encapsulated) {
+        static_cast<EncapsulatedComponent*>(component)->m_internalEngine->setSimulationMode(m_simulationMode);
+        static_cast<EncapsulatedComponent*>(component)->m_internalEngine->setMaxIterations(m_maxIterations);
+    }
+    m_topologyDirty = true;
+}
+/** @return 返回所有组件的紧凑数组 */
+const QVector<Component*>& Engine::getAllComponents() const { return m_components; }
+/** @return 返回所有导线的数组 */
+const QVector<Wire*>& Engine::getAllWires() const { return m_wires; }
+
+/** @return ID对应的组件；越界或槽位空闲时返回 nullptr */
+Component* Engine::componentById(quint32 id) const
+{
+    if (id >= quint32(m_componentSlots.size()) || m_componentSlots[id] < 0) return nullptr;
+    return m_components[m_componentSlots[id]];
+}
+
+/** 删除组件：用末尾组件填补它在紧凑数组中的位置，回收其ID并释放 */
+void Engine::deleteComponent(Component* component) {
+    if (!component || componentById(component->id()) != component) {
+        return; // 空指针或不属于本引擎的组件，直接返回
+    }
+
+    // 1. 把末尾的组件移到被删组件的位置，并更新它的槽位（O(1)，其余组件不动）
+    const int index = m_componentSlots[component->id()];
+    Component* last = m_components.last();
+    m_components[index] = last;
+    m_componentSlots[last->id()] = index;
+    m_components.removeLast();
+
+    // 2. 释放槽位（ID留待复用）与元件本身
+    m_componentSlots[component->id()] = -1;
+    m_freeComponentIds.append(component->id());
+    if (m_waveform) m_waveform->forgetComponent(component);
+    delete component;
+    m_changedPins.clear(); // 列表中可能有被删组件的引脚
+    m_lastResult.oscillatingPins.clear();
+    m_topologyDirty = true;
+}
+/** 删除导线并释放 */
+void Engine::deleteWire(Wire* wire) { if (!wire) return; m_wires.removeAll(wire); delete wire; m_topologyDirty = true; }
+/** 批量删除导线并释放：先标记，再一次性压缩导线数组 */
+void Engine::deleteWires(const QVector<Wire*>& wires)
+{
+    if (wires.isEmpty()) return;
+    const QSet<Wire*> doomed(wires.begin(), wires.end());
+    m_wires.erase(std::remove_if(m_wires.begin(), m_wires.end(), [&doomed](Wire* wire) { return doomed.contains(wire); }),
+                  m_wires.end());
+    qDeleteAll(doomed);
+    m_topologyDirty = true;
+}
+
+/**
+ * @brief 从JSON加载电路（先清空，再内部加载并simulate）。
+ * @param json 完整电路的JSON对象（components + wires）
+ * @return 成功返回true，失败返回false
+ */
+bool Engine::loadCircuitFromJson(const QJsonObject& json)
+{
+    // 使命A：清空！
+    clearAll();
+    m_lastError.clear();
+
+    // 调用底层函数完成加载
+    if (loadCircuitInternal(json)) {
+        // 加载成功后，运行一次仿真以更新所有引脚的初始状态
+        simulate();
+        return true;
+    }
+
+    if (m_lastError.isEmpty()) { m_lastError = "电路数据无效或引用了缺失的封装定义。"; }
+    return false;
+}
+/** 清空所有组件与导线 */
+void Engine::clearAll() {
+    if (m_waveform) m_waveform->forgetAllPins();
+    qDeleteAll(m_wires);
+    m_wires.clear();
+    qDeleteAll(m_components);
+    m_components.clear();
+    m_componentSlots.clear();
+    m_freeComponentIds.clear();
+    m_netlist = CompiledNetlist();
+    m_pendingOutputs.clear();
+    m_oscillatingPins.clear();
+    m_changedPins.clear();
+    m_lastResult = SimulationResult();
+    m_clockTick = 0;
+    m_topologyDirty = true;
+}
+
+/** 存档顶层的标记键：存在时组件的 "id" 是稳定ID，加载时沿用；旧存档以指针地址或数组下标为ID */
+static const char kStableIdsKey[] = "stable_ids";
+
+/**
+ * @brief 将当前电路序列化为JSON：组件+导线。
+ * @return 代表电路的JSON对象
+ */
+QJsonObject Engine::saveCircuitToJson() const
+{
+    QJsonObject circuitJson; // 这是最终要返回的JSON总对象
+    QJsonArray componentsArray; // 用于存放所有元件信息的数组
+    QJsonArray wiresArray;      // 用于存放所有导线信息的数组
+    QVector<const EncapsulatedDefinition*> usedDefinitions; // 子定义在前，每个定义只出现一次
+
+    // 1. 按稳定ID的顺序遍历所有元件，将它们的信息序列化
+    for (Component* comp : componentsInIdOrder()) {
+        QJsonObject compObject;
+        // 以元件的稳定ID作为存档ID：与内存地址无关，删除其他元件也不会改变它
+        compObject["id"] = savedIdOf(comp);
+        compObject["type"] = static_cast<int>(comp->type());
+        compObject["x"] = comp->position().x();
+        compObject["y"] = comp->position().y();
+        if (comp->type() == ComponentType::Clock) { compObject["period"] = static_cast<Clock*>(comp)->period(); }
+        if (comp->type() == ComponentType::Encapsulated) {
+            // 如果是封装元件，只保存对共享定义的引用；定义本身在 definitions 段中只写一次
+            auto encapsulatedComp = static_cast<EncapsulatedComponent*>(comp);
+            compObject["name"] = encapsulatedComp->getName();
+            if (encapsulatedComp->definition()) {
+                compObject["definition"] = encapsulatedComp->definition()->key();
+                collectDefinitions(encapsulatedComp->definition(), usedDefinitions);
+            }
+        }
+        componentsArray.append(compObject);
+    }
+
+    // 2. 遍历所有导线，将它们的信息序列化
+    for (Wire* wire : m_wires) {
+        QJsonObject wireObject;
+        // 记录导线连接的起始元件ID和引脚索引
+        wireObject["start_comp_id"] = savedIdOf(wire->startPin()->owner());
+        wireObject["start_pin_index"] = wire->startPin()->index();
+        // 记录导线连接的终止元件ID和引脚索引
+        wireObject["end_comp_id"] = savedIdOf(wire->endPin()->owner());
+        wireObject["end_pin_index"] = wire->endPin()->index();
+
+        wiresArray.append(wireObject);
+    }
+
+    // 3. 将元件数组和导线数组放入总对象中，并标明ID是稳定ID
+    circuitJson[kStableIdsKey] = true;
+    circuitJson["components"] = componentsArray;
+    circuitJson["wires"] = wiresArray;
+
+    // 4. 写出用到的封装定义（每个只写一次）
+    if (!usedDefinitions.isEmpty()) {
+        QJsonArray definitionsArray;
+        for (const EncapsulatedDefinition* definition : usedDefinitions) {
+            QJsonObject definitionObject;
+            definitionObject["key"] = definition->key();
+            definitionObject["name"] = definition->name();
+            definitionObject["circuit"] = definition->circuitJson();
+            definitionsArray.append(definitionObject);
+        }
+        circuitJson["definitions"] = definitionsArray;
+    }
+
+    return circuitJson;
+}
+
+/** 深度优先收集定义及其子定义，子定义排在父定义之前，重复的只保留第一次 */
+void Engine::collectDefinitions(const EncapsulatedDefinition* definition,
+                                QVector<const EncapsulatedDefinition*>& ordered)
+{
+    if (ordered.contains(definition)) return;
+    for (const EncapsulatedDefinition::Part& part : definition->parts()) {
+        if (part.definition) { collectDefinitions(part.definition, ordered); }
+    }
+    ordered.append(definition);
+}
+
+/**
+ * @brief 按共享定义的蓝图创建内部组件与导线。
+ * @return 蓝图中的引脚序号越界时回滚并返回 false
+ */
+bool Engine::instantiateDefinition(const EncapsulatedDefinition& definition)
+{
+    QVector<Component*> parts;
+    for (const EncapsulatedDefinition::Part& part : definition.parts()) {
+        Component* comp = nullptr;
+        if (part.type == ComponentType::Encapsulated) {
+            comp = new EncapsulatedComponent(part.position, part.definition);
+            insertComponent(comp);
+        } else {
+            comp = createComponent(part.type, part.position);
+        }
+        parts.append(comp);
+    }
+    for (const EncapsulatedDefinition::Link& link : definition.links()) {
+        Component* startComp = parts[link.startPart];
+        Component* endComp = parts[link.endPart];
+        if (link.startPin >= startComp->outputPins().size() || link.endPin >= endComp->inputPins().size()) {
+            qWarning() << "Encapsulated definition" << definition.name() << "has an invalid pin index.";
+            clearAll();
+            return false;
+        }
+        m_wires.append(new Wire(startComp->outputPins()[link.startPin], endComp->inputPins()[link.endPin]));
+    }
+    m_topologyDirty = true;
+    return true;
+}
+// ===============================================
+// === EncapsulatedComponent 实现
+// ===============================================
+
+/** 构造封装元件：从注册表取得（或创建）共享定义，再按定义构造 */
+EncapsulatedComponent::EncapsulatedComponent(const QPointF& pos, const QString& name, const QJsonObject& internalCircuitJson)
+    : EncapsulatedComponent(pos, EncapsulatedDefinition::obtain(name, internalCircuitJson))
+{
+    if (!m_definition) { m_name = name; }
+}
+
+/** 构造封装元件：按共享定义的蓝图实例化内部引擎，随后构建引脚映射 */
+EncapsulatedComponent::EncapsulatedComponent(const QPointF& pos, const EncapsulatedDefinition* definition)
+    : Component(ComponentType::Encapsulated, pos, 0, 0),
+    m_internalEngine(new Engine()),
+    m_definition(definition),
+    m_name(definition ? definition->name() : QString("封装元件"))
+{
+    // 1. 按蓝图实例化内部电路（定义已解析，无需再读JSON）
+    if (m_definition) {
+        m_internalEngine->instantiateDefinition(*m_definition);
+    }
+
+    // 2. 根据内部电路的 Input/Output 元件，建立引脚映射并创建外部引脚
+    buildPinMappings();
+}
+
+/** 析构：释放内部引擎 */
+EncapsulatedComponent::~EncapsulatedComponent()
+{
+    delete m_internalEngine;
+}
+
+/** 获取封装元件名称 */
+QString EncapsulatedComponent::getName() const
+{
+    return m_name;
+}
+
+/**
+ * @brief 构建外部引脚与内部Input/Output的映射，并按Y坐标排序保持一致。
+ * @return 无返回值
+ */
+void EncapsulatedComponent::buildPinMappings()
+{
+    // --- 1. 按 Y 坐标排序收集内部的 Input 和 Output 元件，并建立引脚映射 ---
+    for (Component* comp : m_internalEngine->orderedInputs()) {
+        m_internalInputs.append(comp->outputPins()[0]);
+    }
+    for (Component* comp : m_internalEngine->orderedOutputs()) {
+        m_internalOutputs.append(comp->inputPins()[0]);
+    }
+
+    // --- 2. 根据最终的引脚数量，动态创建自己的外部引脚 ---
+    for (int i = 0; i < m_internalInputs.size(); ++i) {
+        m_inputPins.append(new Pin(this, Pin::Input, i));
+    }
+    for (int i = 0; i < m_internalOutputs.size(); ++i) {
+        m_outputPins.append(new Pin(this, Pin::Output, i));
+    }
+}
+
+/**
+ * @brief 评估封装元件：
+ * 1) 同步外部输入到内部Input；2) 运行内部引擎；3) 回填内部Output到外部输出。
+ * @return 无返回值
+ */
+void EncapsulatedComponent::evaluate()
+{
+    // 1. 将外部输入引脚的状态，传递给内部电路对应的 Input 元件
+    for (int i = 0; i < m_inputPins.size(); ++i) {
+        bool externalState = m_inputPins[i]->getState();
+        Component* internalInputComp = m_internalInputs[i]->owner();
+        // 我们需要一种方式来直接设置 Input 元件的状态
+        // 我们去给 Input 类加一个 setState 方法
+        static_cast<Input*>(internalInputComp)->setState(externalState);
+    }
+
+    // 2. 运行内部电路的仿真
+    m_internalEngine->simulate();
+
+    // 3. 从内部电路的 Output 元件获取状态，设置到自己的外部输出引脚上
+    for (int i = 0; i < m_outputPins.size(); ++i) {
+        bool internalState = m_internalOutputs[i]->getState();
+        m_outputPins[i]->setState(internalState);
+    }
+}
+
+/** @return 内部引擎上一次仿真是否在迭代上限内达到稳定 */
+bool EncapsulatedComponent::isInternallySettled() const
+{
+    return m_internalEngine->m_lastRunConverged;
+}
+
+/** @return 内部电路定义JSON（只读引用）；没有定义时返回空对象 */
+const QJsonObject& EncapsulatedComponent::getInternalJson() const
+{
+    static const QJsonObject emptyCircuit;
+    return m_definition ? m_definition->circuitJson() : emptyCircuit;
+}
+
+/** @return 共享定义（可能为空） */
+const EncapsulatedDefinition* EncapsulatedComponent::definition() const
+{
+    return m_definition;
+}
+
+/**
+ * @brief 手动注册一个外部创建的组件（封装元件等）。
+ * @param component 需要注册到引擎管理的组件指针
+ * @return 无返回值
+ */
+void Engine::registerComponent(Component* component)
+{
+    if (component) {
+        insertComponent(component);
+    }
+}
+/** @return 组件的稳定ID，即保存时写出的ID */
+qint64 Engine::savedIdOf(const Component* component) const { return component->id(); }
+
+/** @return 按稳定ID升序排列的组件（保存时的顺序：删除一个组件不会改变其余组件的位置） */
+QVector<Component*> Engine::componentsInIdOrder() const
+{
+    QVector<Component*> components;
+    components.reserve(m_components.size());
+    for (int index : m_componentSlots) {
+        if (index >= 0) { components.append(m_components[index]); }
+    }
+    return components;
+}
+
+/**
+ * @brief 加载完成后让组件沿用存档中的稳定ID，重新加载后 id() 与保存前一致。
+ * @details 一次性按存档ID重建槽位表（O(组件数 + 最大ID)），ID之间的空洞进入空闲列表留待复用。
+ * 只在刚清空后加载的引擎上调用；ID重复或越界时保持新分配的ID。
+ * @param savedIds 与 m_components 一一对应的存档ID
+ */
+void Engine::restoreSavedIds(const QVector<qint64>& savedIds)
+{
+    if (savedIds.size() != m_components.size()) return;
+    qint64 maxId = -1;
+    for (qint64 id : savedIds) {
+        if (id < 0 || id >= std::numeric_limits<int>::max()) return;
+        maxId = qMax(maxId, id);
+    }
+
+    QVector<int> idSlots(int(maxId + 1), -1);
+    for (int index = 0; index < savedIds.size(); ++index) {
+        int& slot = idSlots[int(savedIds[index])];
+        if (slot >= 0) return; // ID重复：存档无效，保持新分配的ID
+        slot = index;
+    }
+    m_freeComponentIds.clear();
+    for (int id = idSlots.size() - 1; id >= 0; --id) {
+        if (idSlots[id] < 0) { m_freeComponentIds.append(quint32(id)); }
+        else { m_components[idSlots[id]]->m_id = quint32(id); }
+    }
+    m_componentSlots = std::move(idSlots);
+}
+
+/**
+ * @brief 加载时“存档ID → 新组件”的映射。
+ * @details 新存档的ID是组件的稳定ID（槽位编号，稠密且复用），用数组 O(1) 查找；
+ * 旧存档以指针地址为ID，数值巨大且稀疏，退回哈希表。
+ */
+class SavedIdMap {
+public:
+    /** 登记一个存档ID对应的新组件 */
+    void insert(qint64 id, Component* component)
+    {
+        if (id >= 0 && id < m_dense.size() + kDenseSlack) {
+            if (id >= m_dense.size()) { m_dense.resize(int(id) + 1, nullptr); }
+            m_dense[int(id)] = component;
+        } else {
+            m_sparse.insert(id, component);
+        }
+    }
+    /** 查找存档ID对应的组件，不存在时返回 nullptr */
+    Component* value(qint64 id) const
+    {
+        if (id >= 0 && id < m_dense.size() && m_dense[int(id)]) { return m_dense[int(id)]; }
+        return m_sparse.value(id, nullptr);
+    }
+
+private:
+    /** 允许紧凑数组一次向前跳过的最大ID间隔（超过则视为旧式的稀疏ID） */
+    static const int kDenseSlack = 1024;
+    QVector<Component*> m_dense;
+    QHash<qint64, Component*> m_sparse;
+};
+
+/**
+ * @brief 内部加载函数：不清空现有内容，使用ID映射重建组件与导线。
+ * @param json 完整电路JSON
+ * @return 成功返回true，失败返回false
+ */
+bool Engine::loadCircuitInternal(const QJsonObject& json)
+{
+    // 【核心】没有 clearAll()
+    m_topologyDirty = true;
+    if (!json.contains("components") || !json["components"].isArray()) {
+        qWarning("JSON load error: 'components' array not found or is not an array.");
+        return false;
+    }
+
+    // 新格式：先注册 definitions 段中的共享定义，组件再按键引用
+    if (json.contains("definitions") && !EncapsulatedDefinition::registerSection(json["definitions"].toArray())) {
+        qWarning("JSON load error: invalid 'definitions' section.");
+        return false;
+    }
+
+    SavedIdMap idMap;
+    QVector<qint64> savedIds; // 与 m_components 一一对应
+    const QJsonArray componentsArray = json["components"].toArray();
+
+    for (const QJsonValue &compValue : componentsArray) {
+        QJsonObject compObject = compValue.toObject();
+        qint64 id = compObject["id"].toInteger();
+        Component* newComponent = createComponent(compObject);
+        if (newComponent) {
+            savedIds.append(id);
+            idMap.insert(id, newComponent);
+        } else {
+            // 清理已创建的元件以防内存泄漏
+            clearAll();
+            return false;
         }
     }
 
@@ -557,5 +1774,821 @@ bool Engine::loadCircuitInternal(const QJsonObject& json)
         }
 
     }
+    if (json[kStableIdsKey].toBool()) { restoreSavedIds(savedIds); }
+    return true;
+}
+
+// ===============================================
+// === 流式 JSON 存档
+// ===============================================
+
+/** 流式加载时每创建这么多条目调用一次进度回调 */
+static const int kStreamProgressInterval = 4096;
+
+/**
+ * @brief 以流式方式写出电路JSON：定义 → 组件 → 导线，逐条写出。
+ * @details 条目内容与 saveCircuitToJson() 相同，只是不再先拼出整棵树；写入失败时记录 lastError()。
+ */
+bool Engine::saveCircuitToJsonStream(QIODevice* device) const
+{
+    m_lastError.clear();
+    QVector<const EncapsulatedDefinition*> usedDefinitions; // 子定义在前，每个定义只出现一次
+    for (Component* comp : m_components) {
+        if (comp->type() == ComponentType::Encapsulated) {
+            const EncapsulatedDefinition* definition = static_cast<EncapsulatedComponent*>(comp)->definition();
+            if (definition) { collectDefinitions(definition, usedDefinitions); }
+        }
+    }
+
+    JsonStreamWriter writer(device);
+    writer.beginObject();
+    writer.writeKey(kStableIdsKey);
+    writer.writeValue(true);
+
+    // 1. 封装定义在最前面，加载时组件可以立即引用它们
+    if (!usedDefinitions.isEmpty()) {
+        writer.writeKey("definitions");
+        writer.beginArray();
+        for (const EncapsulatedDefinition* definition : usedDefinitions) {
+            QJsonObject definitionObject;
+            definitionObject["key"] = definition->key();
+            definitionObject["name"] = definition->name();
+            definitionObject["circuit"] = definition->circuitJson();
+            writer.writeValue(definitionObject);
+        }
+        writer.endArray();
+    }
+
+    // 2. 组件
+    writer.writeKey("components");
+    writer.beginArray();
+    for (Component* comp : componentsInIdOrder()) {
+        QJsonObject compObject;
+        compObject["id"] = savedIdOf(comp);
+        compObject["type"] = static_cast<int>(comp->type());
+        compObject["x"] = comp->position().x();
+        compObject["y"] = comp->position().y();
+        if (comp->type() == ComponentType::Clock) { compObject["period"] = static_cast<Clock*>(comp)->period(); }
+        if (comp->type() == ComponentType::Encapsulated) {
+            auto encapsulatedComp = static_cast<EncapsulatedComponent*>(comp);
+            compObject["name"] = encapsulatedComp->getName();
+            if (encapsulatedComp->definition()) { compObject["definition"] = encapsulatedComp->definition()->key(); }
+        }
+        writer.writeValue(compObject);
+    }
+    writer.endArray();
+
+    // 3. 导线
+    writer.writeKey("wires");
+    writer.beginArray();
+    for (Wire* wire : m_wires) {
+        QJsonObject wireObject;
+        wireObject["start_comp_id"] = savedIdOf(wire->startPin()->owner());
+        wireObject["start_pin_index"] = wire->startPin()->index();
+        wireObject["end_comp_id"] = savedIdOf(wire->endPin()->owner());
+        wireObject["end_pin_index"] = wire->endPin()->index();
+        writer.writeValue(wireObject);
+    }
+    writer.endArray();
+
+    writer.endObject();
+    if (!writer.flush()) {
+        m_lastError = "写入文件失败：" + device->errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 从JSON流边解析边建图。
+ * @details
+ * - components/wires 数组中的每个元素单独物化为 QJsonObject，处理完立即丢弃；
+ * - definitions 段整体读入后注册（定义本来就要以规范化JSON常驻注册表）；
+ * - 引用尚未注册定义的封装元件、端点尚未创建的导线先暂存，相关段读完后再补建；
+ * - 其他顶层键直接跳过，不做物化。
+ */
+bool Engine::loadCircuitFromJsonStream(QIODevice* device, const LoadProgress& progress)
+{
+    clearAll();
+    m_lastError.clear();
+    auto fail = [this](const QString& reason) {
+        clearAll();
+        m_lastError = reason;
+        qWarning() << "JSON load error:" << reason;
+        return false;
+    };
+
+    const qint64 totalBytes = device->size();
+    JsonStreamReader reader(device);
+    SavedIdMap idMap;
+    QVector<qint64> savedIds;                 // 与 m_components 一一对应
+    bool stableIds = false;                   // 顶层标记可能出现在任意位置，读完后再沿用ID
+    QVector<QJsonObject> deferredComponents;  // 引用的定义尚未读到
+    QVector<QJsonObject> deferredWires;       // 端点组件尚未读到
+    bool sawComponents = false;
+    int created = 0;
+
+    // 创建一个组件；引用的定义还没注册时暂存（返回 true 表示无错误）
+    auto addComponent = [&](const QJsonObject& compObject, bool allowDefer) {
+        if (allowDefer && compObject.contains("definition")
+            && !EncapsulatedDefinition::find(compObject["definition"].toString())) {
+            deferredComponents.append(compObject);
+            return true;
+        }
+        Component* newComponent = createComponent(compObject);
+        if (!newComponent) return false;
+        savedIds.append(compObject["id"].toInteger());
+        idMap.insert(compObject["id"].toInteger(), newComponent);
+        return true;
+    };
+    // 创建一条导线；端点组件还没创建时暂存（返回 true 表示无错误）
+    auto addWire = [&](const QJsonObject& wireObject, bool allowDefer) {
+        Component* startComp = idMap.value(wireObject["start_comp_id"].toInteger());
+        Component* endComp = idMap.value(wireObject["end_comp_id"].toInteger());
+        if ((!startComp || !endComp) && allowDefer) {
+            deferredWires.append(wireObject);
+            return true;
+        }
+        const int startPinIndex = wireObject["start_pin_index"].toInt();
+        const int endPinIndex = wireObject["end_pin_index"].toInt();
+        if (!startComp || !endComp || startPinIndex < 0 || endPinIndex < 0
+            || startPinIndex >= startComp->outputPins().size() || endPinIndex >= endComp->inputPins().size()) {
+            return false;
+        }
+        m_wires.append(new Wire(startComp->outputPins()[startPinIndex], endComp->inputPins()[endPinIndex]));
+        return true;
+    };
+    auto reportProgress = [&]() {
+        return !progress || ++created % kStreamProgressInterval != 0 || progress(reader.bytesConsumed(), totalBytes);
+    };
+
+    // --- 1. 顶层对象：逐个键处理 ---
+    if (reader.readNext() != JsonStreamReader::BeginObject) {
+        return fail(reader.hasError() ? reader.errorString() : "文件不是一个有效的JSON对象。");
+    }
+    for (JsonStreamReader::Token token = reader.readNext(); token == JsonStreamReader::Key; token = reader.readNext()) {
+        const QString key = reader.key();
+        const JsonStreamReader::Token first = reader.readNext();
+
+        if (key == "components" || key == "wires") {
+            const bool isComponents = key == "components";
+            if (first != JsonStreamReader::BeginArray) { return fail(QString("'%1' 不是数组。").arg(key)); }
+            sawComponents = sawComponents || isComponents;
+            for (JsonStreamReader::Token element = reader.readNext(); element != JsonStreamReader::EndArray;
+                 element = reader.readNext()) {
+                bool ok = false;
+                const QJsonObject object = reader.readValue(element, &ok).toObject();
+                if (!ok) { return fail(reader.errorString()); }
+                if (isComponents ? !addComponent(object, true) : !addWire(object, true)) {
+                    return fail(isComponents ? "组件数据无效或引用了缺失的封装定义。" : "导线引用了不存在的组件或引脚。");
+                }
+                if (!reportProgress()) { return fail("加载已取消。"); }
+            }
+        } else if (key == "definitions") {
+            bool ok = false;
+            const QJsonArray definitions = reader.readValue(first, &ok).toArray();
+            if (!ok) { return fail(reader.errorString()); }
+            if (!EncapsulatedDefinition::registerSection(definitions)) { return fail("'definitions' 段无效。"); }
+        } else if (key == kStableIdsKey) {
+            bool ok = false;
+            stableIds = reader.readValue(first, &ok).toBool();
+            if (!ok) { return fail(reader.errorString()); }
+        } else if (!reader.skipValue(first)) {
+            return fail(reader.errorString());
+        }
+    }
+    if (reader.hasError() || reader.readNext() != JsonStreamReader::EndOfDocument) {
+        return fail(reader.hasError() ? reader.errorString() : "文件不是一个有效的JSON对象。");
+    }
+    if (!sawComponents) { return fail("缺少 'components' 数组。"); }
+
+    // --- 2. 补建暂存的条目：此时所有定义和组件都已读到 ---
+    for (const QJsonObject& compObject : deferredComponents) {
+        if (!addComponent(compObject, false)) { return fail("组件数据无效或引用了缺失的封装定义。"); }
+    }
+    for (const QJsonObject& wireObject : deferredWires) {
+        if (!addWire(wireObject, false)) { return fail("导线引用了不存在的组件或引脚。"); }
+    }
+    if (progress && !progress(reader.bytesConsumed(), totalBytes)) { return fail("加载已取消。"); }
+    if (stableIds) { restoreSavedIds(savedIds); }
+
+    m_topologyDirty = true;
+    simulate();
+    return true;
+}
+
+// ===============================================
+// === 二进制存档（.tcb）
+// ===============================================
+//
+// 布局（小端序，各段起点按 8 字节对齐）：
+//   文件头      magic "TCBF" | 版本 | 4 个段的 (偏移, 条目数)
+//   字符串表    (条目数+1) 个 u32 字节偏移 | UTF-8 字节
+//   组件数组    每项 24 字节：f64 x | f64 y | u32 类型 | u32 参数（封装元件为定义序号，时钟为周期，其余为 0xFFFFFFFF）
+//               （不记录组件ID：加载后按序号重新编号，保留 id() 的只有 JSON 存档）
+//   导线数组    每项 16 字节：u32 起点组件序号 | u32 起点引脚 | u32 终点组件序号 | u32 终点引脚
+//   定义表      每项 16 字节：u32 键字符串 | u32 名称字符串 | u32 CBOR 偏移 | u32 CBOR 长度（子定义在前）
+//   定义数据    各定义规范化内部电路的 CBOR 编码
+
+/** 文件魔数 */
+static const char kBinaryMagic[4] = {'T', 'C', 'B', 'F'};
+/** 当前格式版本 */
+static const quint32 kBinaryVersion = 1;
+/** 文件头大小：魔数、版本、4 个段的 (偏移, 条目数) */
+static const int kBinaryHeaderSize = 4 + 4 + 4 * 8;
+/** 组件记录大小 */
+static const int kBinaryComponentSize = 24;
+/** 导线记录大小 */
+static const int kBinaryWireSize = 16;
+/** 定义记录大小 */
+static const int kBinaryDefinitionSize = 16;
+/** “没有定义”的定义序号 */
+static const quint32 kNoDefinition = 0xFFFFFFFFu;
+
+/** 以小端序追加一个整数 */
+template <typename T>
+static void appendLittleEndian(QByteArray& out, T value)
+{
+    char bytes[sizeof(T)];
+    qToLittleEndian(value, bytes);
+    out.append(bytes, sizeof(T));
+}
+
+/** 以小端序追加一个双精度浮点数（按位解释为 64 位整数） */
+static void appendLittleEndianDouble(QByteArray& out, double value)
+{
+    quint64 bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    appendLittleEndian(out, bits);
+}
+
+/** 读取小端序双精度浮点数 */
+static double readLittleEndianDouble(const char* data)
+{
+    const quint64 bits = qFromLittleEndian<quint64>(data);
+    double value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/** 补零到 8 字节对齐 */
+static void alignTo8(QByteArray& out)
+{
+    while (out.size() % 8 != 0) { out.append('\0'); }
+}
+
+/** 在文件头的第 section 个段位置写入 (偏移, 条目数) */
+static void patchSection(QByteArray& out, int section, quint32 offset, quint32 count)
+{
+    qToLittleEndian(offset, out.data() + 8 + section * 8);
+    qToLittleEndian(count, out.data() + 8 + section * 8 + 4);
+}
+
+/**
+ * @brief 把电路编码为二进制存档。
+ * @details 组件以数组序号互相引用，不再需要 "start_comp_id" 等字符串键；封装定义只以 CBOR 保存一次。
+ * 组件按稳定ID的顺序写出，删除一个组件不会改变其余组件的相对顺序（序号是去掉空洞后的名次）。
+ */
+QByteArray Engine::saveCircuitToBinary() const
+{
+    // --- 1. 收集定义与字符串（组件按稳定ID排序，序号为名次） ---
+    const QVector<Component*> components = componentsInIdOrder();
+    QVector<quint32> ordinals(m_componentSlots.size());
+    for (int i = 0; i < components.size(); ++i) { ordinals[components[i]->id()] = quint32(i); }
+    QVector<const EncapsulatedDefinition*> usedDefinitions;
+    for (int i = 0; i < components.size(); ++i) {
+        if (components[i]->type() == ComponentType::Encapsulated) {
+            const EncapsulatedDefinition* definition = static_cast<EncapsulatedComponent*>(components[i])->definition();
+            if (definition) { collectDefinitions(definition, usedDefinitions); }
+        }
+    }
+    QStringList strings;
+    for (const EncapsulatedDefinition* definition : usedDefinitions) {
+        strings << definition->key() << definition->name();
+    }
+
+    QByteArray out;
+    out.append(kBinaryMagic, 4);
+    appendLittleEndian(out, kBinaryVersion);
+    out.append(QByteArray(kBinaryHeaderSize - 8, '\0'));
+
+    // --- 2. 字符串表 ---
+    patchSection(out, 0, quint32(out.size()), quint32(strings.size()));
+    QByteArray stringBytes;
+    QVector<quint32> stringOffsets{0};
+    for (const QString& string : strings) {
+        stringBytes += string.toUtf8();
+        stringOffsets.append(quint32(stringBytes.size()));
+    }
+    for (quint32 offset : stringOffsets) { appendLittleEndian(out, offset); }
+    out += stringBytes;
+    alignTo8(out);
+
+    // --- 3. 组件数组 ---
+    patchSection(out, 1, quint32(out.size()), quint32(components.size()));
+    for (Component* comp : components) {
+        quint32 parameter = kNoDefinition;
+        if (comp->type() == ComponentType::Encapsulated) {
+            const int index = usedDefinitions.indexOf(static_cast<EncapsulatedComponent*>(comp)->definition());
+            if (index >= 0) { parameter = quint32(index); }
+        } else if (comp->type() == ComponentType::Clock) {
+            parameter = quint32(static_cast<Clock*>(comp)->period());
+        }
+        appendLittleEndianDouble(out, comp->position().x());
+        appendLittleEndianDouble(out, comp->position().y());
+        appendLittleEndian(out, quint32(comp->type()));
+        appendLittleEndian(out, parameter);
+    }
+
+    // --- 4. 导线数组 ---
+    patchSection(out, 2, quint32(out.size()), quint32(m_wires.size()));
+    for (Wire* wire : m_wires) {
+        appendLittleEndian(out, ordinals[wire->startPin()->owner()->id()]);
+        appendLittleEndian(out, quint32(wire->startPin()->index()));
+        appendLittleEndian(out, ordinals[wire->endPin()->owner()->id()]);
+        appendLittleEndian(out, quint32(wire->endPin()->index()));
+    }
+
+    // --- 5. 定义表与 CBOR 数据（数据紧跟在表之后） ---
+    patchSection(out, 3, quint32(out.size()), quint32(usedDefinitions.size()));
+    QByteArray cborBytes;
+    const quint32 dataStart = quint32(out.size() + usedDefinitions.size() * kBinaryDefinitionSize);
+    for (int i = 0; i < usedDefinitions.size(); ++i) {
+        const QByteArray cbor = QCborValue::fromJsonValue(usedDefinitions[i]->circuitJson()).toCbor();
+        appendLittleEndian(out, quint32(2 * i));
+        appendLittleEndian(out, quint32(2 * i + 1));
+        appendLittleEndian(out, quint32(dataStart + cborBytes.size()));
+        appendLittleEndian(out, quint32(cbor.size()));
+        cborBytes += cbor;
+    }
+    out += cborBytes;
+    return out;
+}
+
+/**
+ * @brief 从二进制存档加载电路（先清空）。
+ * @details 所有段都先做越界检查；只有注册表中尚不存在的定义才会解码 CBOR，其余直接复用。
+ * @param data 存档数据（可以是 QFile::map 的映射区，本函数不持有它）
+ * @param size 数据长度
+ */
+bool Engine::loadCircuitFromBinary(const char* data, qint64 size)
+{
+    clearAll();
+    m_lastError.clear();
+    auto fail = [this](const QString& reason) {
+        clearAll();
+        m_lastError = reason;
+        qWarning() << "Binary load error:" << reason;
+        return false;
+    };
+
+    // --- 1. 文件头 ---
+    if (size < kBinaryHeaderSize || std::memcmp(data, kBinaryMagic, 4) != 0) {
+        return fail("不是有效的二进制电路文件。");
+    }
+    if (qFromLittleEndian<quint32>(data + 4) != kBinaryVersion) {
+        return fail("不支持的二进制电路文件版本。");
+    }
+    quint32 offsets[4];
+    quint32 counts[4];
+    const int recordSizes[4] = {4, kBinaryComponentSize, kBinaryWireSize, kBinaryDefinitionSize};
+    for (int section = 0; section < 4; ++section) {
+        offsets[section] = qFromLittleEndian<quint32>(data + 8 + section * 8);
+        counts[section] = qFromLittleEndian<quint32>(data + 8 + section * 8 + 4);
+        // 字符串表的偏移数组比条目数多一项
+        const qint64 records = qint64(counts[section]) + (section == 0 ? 1 : 0);
+        if (qint64(offsets[section]) + records * recordSizes[section] > size) {
+            return fail("二进制电路文件已损坏（段越界）。");
+        }
+    }
+
+    // --- 2. 字符串表 ---
+    const char* stringOffsets = data + offsets[0];
+    const char* stringBytes = stringOffsets + (qint64(counts[0]) + 1) * 4;
+    const qint64 stringBytesAvailable = size - (stringBytes - data);
+    auto stringAt = [&](quint32 index, QString& result) {
+        if (index >= counts[0]) return false;
+        const quint32 begin = qFromLittleEndian<quint32>(stringOffsets + index * 4);
+        const quint32 end = qFromLittleEndian<quint32>(stringOffsets + (index + 1) * 4);
+        if (begin > end || end > stringBytesAvailable) return false;
+        result = QString::fromUtf8(stringBytes + begin, int(end - begin));
+        return true;
+    };
+
+    // --- 3. 定义：只解码注册表中还没有的 ---
+    const char* definitionRecords = data + offsets[3];
+    QStringList definitionKeys;
+    QJsonArray missingDefinitions;
+    for (quint32 i = 0; i < counts[3]; ++i) {
+        const char* record = definitionRecords + i * kBinaryDefinitionSize;
+        QString key;
+        QString name;
+        if (!stringAt(qFromLittleEndian<quint32>(record), key) || !stringAt(qFromLittleEndian<quint32>(record + 4), name)) {
+            return fail("二进制电路文件已损坏（字符串越界）。");
+        }
+        definitionKeys.append(key);
+        if (EncapsulatedDefinition::find(key)) continue;
+        const quint32 cborOffset = qFromLittleEndian<quint32>(record + 8);
+        const quint32 cborSize = qFromLittleEndian<quint32>(record + 12);
+        if (qint64(cborOffset) + cborSize > size) {
+            return fail("二进制电路文件已损坏（定义越界）。");
+        }
+        QJsonObject entry;
+        entry["key"] = key;
+        entry["name"] = name;
+        entry["circuit"] = QCborValue::fromCbor(data + cborOffset, cborSize).toJsonValue().toObject();
+        missingDefinitions.append(entry);
+    }
+    if (!missingDefinitions.isEmpty() && !EncapsulatedDefinition::registerSection(missingDefinitions)) {
+        return fail("二进制电路文件中的封装定义无效。");
+    }
+    QVector<const EncapsulatedDefinition*> definitions;
+    for (const QString& key : definitionKeys) {
+        definitions.append(EncapsulatedDefinition::find(key));
+    }
+
+    // --- 4. 组件 ---
+    QVector<Component*> components;
+    components.reserve(int(counts[1]));
+    for (quint32 i = 0; i < counts[1]; ++i) {
+        const char* record = data + offsets[1] + qint64(i) * kBinaryComponentSize;
+        const QPointF pos(readLittleEndianDouble(record), readLittleEndianDouble(record + 8));
+        const quint32 type = qFromLittleEndian<quint32>(record + 16);
+        const quint32 parameter = qFromLittleEndian<quint32>(record + 20);
+        if (type > quint32(ComponentType::Clock)) {
+            return fail("二进制电路文件已损坏（未知的元件类型）。");
+        }
+        Component* comp = nullptr;
+        if (ComponentType(type) == ComponentType::Encapsulated) {
+            if (parameter >= quint32(definitions.size()) || !definitions[parameter]) {
+                return fail("二进制电路文件引用了缺失的封装定义。");
+            }
+            comp = new EncapsulatedComponent(pos, definitions[parameter]);
+            insertComponent(comp);
+        } else {
+            comp = createComponent(ComponentType(type), pos);
+            if (ComponentType(type) == ComponentType::Clock) { static_cast<Clock*>(comp)->setPeriod(int(qMin(parameter, quint32(0x7FFFFFFF)))); }
+        }
+        components.append(comp);
+    }
+
+    // --- 5. 导线 ---
+    m_wires.reserve(int(counts[2]));
+    for (quint32 i = 0; i < counts[2]; ++i) {
+        const char* record = data + offsets[2] + qint64(i) * kBinaryWireSize;
+        const quint32 startComp = qFromLittleEndian<quint32>(record);
+        const quint32 startPin = qFromLittleEndian<quint32>(record + 4);
+        const quint32 endComp = qFromLittleEndian<quint32>(record + 8);
+        const quint32 endPin = qFromLittleEndian<quint32>(record + 12);
+        if (startComp >= counts[1] || endComp >= counts[1]
+            || startPin >= quint32(components[startComp]->outputPins().size())
+            || endPin >= quint32(components[endComp]->inputPins().size())) {
+            return fail("二进制电路文件已损坏（导线端点无效）。");
+        }
+        m_wires.append(new Wire(components[startComp]->outputPins()[startPin], components[endComp]->inputPins()[endPin]));
+    }
+
+    m_topologyDirty = true;
+    simulate();
+    return true;
+}
+
+/** @return 文件路径是否使用二进制存档扩展名 */
+static bool isBinaryCircuitPath(const QString& filePath)
+{
+    return filePath.endsWith(".tcb", Qt::CaseInsensitive);
+}
+
+/**
+ * @brief 按扩展名保存：.tcb 写二进制存档，其余以流式方式写缩进的 JSON。
+ * @return 失败时返回 false，原因见 lastError()
+ */
+bool Engine::saveCircuitToFile(const QString& filePath) const
+{
+    m_lastError.clear();
+    QFile file(filePath);
+    if (!file.open(QIODevice::WriteOnly)) {
+        m_lastError = "无法打开文件进行写入：" + file.errorString();
+        return false;
+    }
+    if (!isBinaryCircuitPath(filePath)) {
+        return saveCircuitToJsonStream(&file);
+    }
+    const QByteArray bytes = saveCircuitToBinary();
+    if (file.write(bytes) != bytes.size()) {
+        m_lastError = "写入文件失败：" + file.errorString();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief 按扩展名加载：.tcb 通过内存映射直接解析二进制存档，其余按 JSON 流边读边建图。
+ * @return 失败时返回 false，原因见 lastError()
+ */
+bool Engine::loadCircuitFromFile(const QString& filePath, const LoadProgress& progress)
+{
+    m_lastError.clear();
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        m_lastError = "无法打开文件进行读取：" + file.errorString();
+        return false;
+    }
+    if (isBinaryCircuitPath(filePath)) {
+        // 二进制存档加载很快，只在开始前给一次取消的机会
+        const qint64 size = file.size();
+        if (progress && !progress(0, size)) {
+            m_lastError = "加载已取消。";
+            return false;
+        }
+        // 映射失败（如空文件或不支持映射的设备）时退回整块读取
+        bool loaded = false;
+        if (uchar* mapped = file.map(0, size)) {
+            loaded = loadCircuitFromBinary(reinterpret_cast<const char*>(mapped), size);
+            file.unmap(mapped);
+        } else {
+            const QByteArray bytes = file.readAll();
+            loaded = loadCircuitFromBinary(bytes.constData(), bytes.size());
+        }
+        if (loaded && progress) { progress(size, size); }
+        return loaded;
+    }
+
+    return loadCircuitFromJsonStream(&file, progress);
+}
+
+// ===============================================
+// === EncapsulatedDefinition 实现
+// ===============================================
+
+/** @return 名称 */
+QString EncapsulatedDefinition::name() const { return m_name; }
+/** @return 注册表键 */
+QString EncapsulatedDefinition::key() const { return m_key; }
+/** @return 规范化后的内部电路 */
+const QJsonObject& EncapsulatedDefinition::circuitJson() const { return m_circuitJson; }
+/** @return 组件蓝图 */
+const QVector<EncapsulatedDefinition::Part>& EncapsulatedDefinition::parts() const { return m_parts; }
+/** @return 导线蓝图 */
+const QVector<EncapsulatedDefinition::Link>& EncapsulatedDefinition::links() const { return m_links; }
+
+/** 生成真值表所允许的最大输入数（表项数为 2^n） */
+static const int kMaxLookupInputs = 16;
+/** 生成真值表所允许的最大输出数（表项为32位） */
+static const int kMaxLookupOutputs = 32;
+
+/** @return 真值表；仍在生成或不可查表时返回 nullptr */
+const QVector<quint32>* EncapsulatedDefinition::lookupTable() const
+{
+    return m_tableState.loadAcquire() == TableReady ? &m_lookupTable : nullptr;
+}
+
+/** @return 真值表已生成或仍在生成 */
+bool EncapsulatedDefinition::lookupTableExpected() const { return m_tableState.loadAcquire() != TableUnavailable; }
+
+/** @return 真值表代数计数器（进程内全局） */
+QAtomicInt& EncapsulatedDefinition::tableGeneration()
+{
+    static QAtomicInt generation;
+    return generation;
+}
+
+/** @return 当前的真值表代数 */
+int EncapsulatedDefinition::lookupTableGeneration() { return tableGeneration().loadAcquire(); }
+
+/**
+ * @brief 在线程池中生成真值表。
+ * @details 16 个输入的定义要穷举 65536 组输入，不能在界面线程的 prepareSimulation() 里同步完成；
+ * 生成期间实例按 GateOp::Encapsulated 走内部仿真，表发布后代数加一，引擎下次仿真时重新编译为查表门。
+ */
+void EncapsulatedDefinition::scheduleLookupTable(const QSharedPointer<EncapsulatedDefinition>& definition)
+{
+    int inputCount = 0;
+    int outputCount = 0;
+    for (const Part& part : definition->m_parts) {
+        if (part.type == ComponentType::Input) ++inputCount;
+        if (part.type == ComponentType::Output) ++outputCount;
+    }
+    if (inputCount > kMaxLookupInputs || outputCount > kMaxLookupOutputs) {
+        definition->m_tableState.storeRelease(TableUnavailable);
+        return;
+    }
+    QThreadPool::globalInstance()->start([definition]() {
+        const bool built = definition->buildLookupTable();
+        definition->m_tableState.storeRelease(built ? TableReady : TableUnavailable);
+        if (built) { tableGeneration().fetchAndAddOrdered(1); }
+    });
+}
+
+/**
+ * @brief 在临时引擎中实例化本定义（展平所有子定义），确认无反馈环后用批量仿真穷举输入组合。
+ * @details 无反馈环的电路在稳定之后，结果与初始状态无关，因此表项与逐个实例内部仿真的结果一致。
+ * 展平会在每层封装边界插入缓冲门，深层嵌套的定义可能需要超过默认上限的轮数才能稳定，
+ * 因此迭代上限按分层调度的波次数（即逻辑深度）放宽；仍有任一组未稳定时不生成真值表，实例回退到内部仿真。
+ * 在后台线程执行，只写 m_lookupTable，由调用方发布；输入/输出数已由 scheduleLookupTable() 检查。
+ */
+bool EncapsulatedDefinition::buildLookupTable()
+{
+    int inputCount = 0;
+    int outputCount = 0;
+    for (const Part& part : m_parts) {
+        if (part.type == ComponentType::Input) ++inputCount;
+        if (part.type == ComponentType::Output) ++outputCount;
+    }
+
+    Engine engine;
+    if (!engine.instantiateDefinition(*this)) return false;
+    engine.setFlattenHierarchy(true);
+    if (engine.hasFeedbackLoops()) return false;
+    // 单位延迟下每轮至少向前传播一级门，深度 + 1 轮达到稳定，再多一轮确认无变化
+    const int depth = engine.m_netlist.waveOffsets.size() - 1;
+    engine.setMaxIterations(qMax(engine.maxIterations(), depth + 2));
+
+    // 穷举：第 i 组输入的第 k 位对应第 k 个输入
+    QVector<QVector<bool>> inputVectors;
+    const int combinations = 1 << inputCount;
+    for (int i = 0; i < combinations; ++i) {
+        QVector<bool> vector(inputCount);
+        for (int k = 0; k < inputCount; ++k) { vector[k] = (i >> k) & 1; }
+        inputVectors.append(vector);
+    }
+    QVector<QVector<bool>> outputVectors;
+    QVector<bool> settled;
+    if (!engine.simulateBatch(inputVectors, outputVectors, &settled)) return false;
+    if (settled.contains(false)) {
+        qWarning() << "封装定义" << m_name << "在迭代上限内未能稳定，不生成真值表";
+        return false;
+    }
+
+    m_lookupTable.resize(combinations);
+    for (int i = 0; i < combinations; ++i) {
+        quint32 value = 0;
+        for (int k = 0; k < outputCount; ++k) {
+            if (outputVectors[i][k]) { value |= quint32(1) << k; }
+        }
+        m_lookupTable[i] = value;
+    }
+    return true;
+}
+
+/** @return 全局注册表（首次使用时创建，程序退出时释放） */
+QHash<QString, QSharedPointer<EncapsulatedDefinition>>& EncapsulatedDefinition::registry()
+{
+    static QHash<QString, QSharedPointer<EncapsulatedDefinition>> definitions;
+    return definitions;
+}
+
+/** @return 注册表的互斥锁 */
+QRecursiveMutex& EncapsulatedDefinition::registryMutex()
+{
+    static QRecursiveMutex mutex;
+    return mutex;
+}
+
+/** 查找或创建定义（对外接口，不依赖任何存档的 definitions 段）；整个“查找-解析-登记”过程持锁，同一定义只会登记一次 */
+const EncapsulatedDefinition* EncapsulatedDefinition::obtain(const QString& name, const QJsonObject& circuitJson)
+{
+    QMutexLocker locker(&registryMutex());
+    return obtain(name, circuitJson, QHash<QString, QJsonObject>(), 0);
+}
+
+/** @return 键对应的定义，未注册返回 nullptr */
+const EncapsulatedDefinition* EncapsulatedDefinition::find(const QString& key)
+{
+    QMutexLocker locker(&registryMutex());
+    return registry().value(key).data();
+}
+
+/** 注册 definitions 段：条目之间可以任意顺序互相引用 */
+bool EncapsulatedDefinition::registerSection(const QJsonArray& section)
+{
+    QMutexLocker locker(&registryMutex());
+    QHash<QString, QJsonObject> entries;
+    for (const QJsonValue& value : section) {
+        const QJsonObject entry = value.toObject();
+        entries.insert(entry["key"].toString(), entry);
+    }
+    for (auto it = entries.constBegin(); it != entries.constEnd(); ++it) {
+        if (!resolve(it.key(), entries, 0)) { return false; }
+    }
     return true;
 }
+
+/**
+ * @brief 解析引用：已注册则直接返回；否则从 definitions 段中取出条目创建。
+ * @details 若条目中记录的键与重新计算的内容哈希不一致（如手工编辑过），把记录的键登记为别名。
+ */
+const EncapsulatedDefinition* EncapsulatedDefinition::resolve(const QString& key, const QHash<QString, QJsonObject>& section, int depth)
+{
+    if (const EncapsulatedDefinition* existing = find(key)) { return existing; }
+    if (!section.contains(key)) { return nullptr; }
+    const QJsonObject entry = section.value(key);
+    const EncapsulatedDefinition* definition = obtain(entry["name"].toString("封装元件"), entry["circuit"].toObject(), section, depth + 1);
+    if (definition && definition->key() != key) {
+        registry().insert(key, registry().value(definition->key()));
+    }
+    return definition;
+}
+
+/**
+ * @brief 规范化内部电路、计算内容哈希并在注册表中查找；未命中时解析出蓝图并登记。
+ * @details 规范化：组件ID改为数组序号；嵌套封装元件一律改为 {"name", "definition": 子定义键}。
+ * 子定义键本身含内容哈希，因此父定义的哈希覆盖了整棵子树。
+ */
+const EncapsulatedDefinition* EncapsulatedDefinition::obtain(const QString& name, const QJsonObject& circuitJson,
+                                                             const QHash<QString, QJsonObject>& section, int depth)
+{
+    const int maxDepth = 64;
+    if (depth > maxDepth) {
+        qWarning() << "Encapsulated definition" << name << "is nested too deeply.";
+        return nullptr;
+    }
+    if (!circuitJson.contains("components") || !circuitJson["components"].isArray()) {
+        qWarning() << "Encapsulated definition" << name << "has no 'components' array.";
+        return nullptr;
+    }
+
+    // 0. 元件库文件本身也可能带有 definitions 段：合并进来供嵌套引用解析
+    QHash<QString, QJsonObject> entries = section;
+    for (const QJsonValue& value : circuitJson["definitions"].toArray()) {
+        const QJsonObject entry = value.toObject();
+        entries.insert(entry["key"].toString(), entry);
+    }
+
+    // 1. 规范化组件，同时生成组件蓝图
+    QVector<Part> parts;
+    QHash<qint64, int> idToIndex;
+    QJsonArray components;
+    for (const QJsonValue& value : circuitJson["components"].toArray()) {
+        const QJsonObject compObject = value.toObject();
+        const int typeValue = compObject["type"].toInt(-1);
+        if (typeValue == static_cast<int>(ComponentType::Clock)) {
+            // 时钟的节拍属于顶层引擎，封装元件的内部引擎不会推进它
+            qWarning() << "Encapsulated definition" << name << "contains a clock, which cannot be encapsulated.";
+            return nullptr;
+        }
+        if (typeValue < static_cast<int>(ComponentType::Input) || typeValue > static_cast<int>(ComponentType::Encapsulated)) {
+            qWarning() << "Encapsulated definition" << name << "has an unknown component type" << typeValue;
+            return nullptr;
+        }
+        Part part{static_cast<ComponentType>(typeValue),
+                  QPointF(compObject["x"].toDouble(), compObject["y"].toDouble()), nullptr};
+        QJsonObject normalized;
+        normalized["id"] = parts.size();
+        normalized["type"] = typeValue;
+        normalized["x"] = part.position.x();
+        normalized["y"] = part.position.y();
+        if (part.type == ComponentType::Encapsulated) {
+            part.definition = compObject.contains("definition")
+                ? resolve(compObject["definition"].toString(), entries, depth)
+                : obtain(compObject["name"].toString("封装元件"), compObject["internal_circuit"].toObject(), entries, depth + 1);
+            if (!part.definition) { return nullptr; }
+            normalized["name"] = part.definition->name();
+            normalized["definition"] = part.definition->key();
+        }
+        idToIndex.insert(compObject["id"].toInteger(), parts.size());
+        parts.append(part);
+        components.append(normalized);
+    }
+
+    // 2. 规范化导线，同时生成导线蓝图
+    QVector<Link> links;
+    QJsonArray wires;
+    for (const QJsonValue& value : circuitJson["wires"].toArray()) {
+        const QJsonObject wireObject = value.toObject();
+        const qint64 startId = wireObject["start_comp_id"].toInteger();
+        const qint64 endId = wireObject["end_comp_id"].toInteger();
+        if (!idToIndex.contains(startId) || !idToIndex.contains(endId)) {
+            qWarning() << "Encapsulated definition" << name << "has a wire to an unknown component.";
+            return nullptr;
+        }
+        Link link{idToIndex.value(startId), wireObject["start_pin_index"].toInt(),
+                  idToIndex.value(endId), wireObject["end_pin_index"].toInt()};
+        if (link.startPin < 0 || link.endPin < 0) { return nullptr; }
+        QJsonObject normalized;
+        normalized["start_comp_id"] = link.startPart;
+        normalized["start_pin_index"] = link.startPin;
+        normalized["end_comp_id"] = link.endPart;
+        normalized["end_pin_index"] = link.endPin;
+        links.append(link);
+        wires.append(normalized);
+    }
+
+    // 3. 计算键并查找；命中则复用已有定义
+    QJsonObject normalizedCircuit;
+    normalizedCircuit["components"] = components;
+    normalizedCircuit["wires"] = wires;
+    const QByteArray content = QJsonDocument(normalizedCircuit).toJson(QJsonDocument::Compact);
+    const QString key = name + "#" + QString::fromLatin1(QCryptographicHash::hash(content, QCryptographicHash::Sha1).toHex());
+    if (const EncapsulatedDefinition* existing = find(key)) { return existing; }
+
+    QSharedPointer<EncapsulatedDefinition> definition(new EncapsulatedDefinition());
+    definition->m_name = name;
+    definition->m_key = key;
+    definition->m_circuitJson = normalizedCircuit;
+    definition->m_parts = parts;
+    definition->m_links = links;
+    registry().insert(key, definition);
+    scheduleLookupTable(definition);
+    return definition.data();
+}
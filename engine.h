@@ -3,7 +3,12 @@
 #include <QJsonObject>  // JSON 序列化/反序列化的数据结构
 #include <QVector>      // 动态数组容器（用于保存引脚/导线等）
 #include <QPointF>      // 场景中的二维坐标
-#include <QMap>         // 组件映射（以指针地址为键）
+#include <QByteArray>   // 编译网表中的引脚状态数组
+#include <QHash>        // 封装定义注册表
+#include <QSharedPointer> // 注册表持有共享定义
+#include <QAtomicInteger> // 封装定义真值表的后台生成状态
+#include <QRecursiveMutex> // 保护封装定义注册表
+#include <functional>   // 流式加载的进度回调
 
 /**
  * @brief 前向声明以减少编译依赖。
@@ -13,6 +18,9 @@ class Component;
 class Wire;
 class ComponentItem;
 class EncapsulatedComponent;
+class EncapsulatedDefinition;
+class WaveformRecorder;
+class QIODevice;
 // ===============================================
 // 枚举与类的定义 (严格按照成熟版本)
 // ===============================================
@@ -22,9 +30,110 @@ class EncapsulatedComponent;
  * - Input/Output: 输入输出端
  * - And/Or/Not/Nand/Nor/Xor/Xnor: 基本逻辑门
  * - Encapsulated: 封装组件（内部含子电路）
+ * - Clock: 时钟源，按引擎的时钟节拍周期性翻转（追加在末尾，旧存档中的类型编号不变）
  */
 enum class ComponentType {
-    Input, Output, And, Or, Not, Nand, Nor, Xor, Xnor, Encapsulated
+    Input, Output, And, Or, Not, Nand, Nor, Xor, Xnor, Encapsulated, Clock
+};
+
+/**
+ * @brief 仿真模式。
+ * - Iterative: 迭代求稳，每轮清零输入、全量评估、全量传播（原始实现）
+ * - EventDriven: 活动驱动，只沿状态真正发生变化的输出引脚的扇出传播
+ * - Levelized: 分层求值，按拓扑序单遍计算无环部分，只在强连通分量（反馈环）内迭代
+ * @details 前两种模式都遵循“单位延迟”语义，对锁存器/触发器给出相同结果；
+ * 分层求值在无环部分采用“零延迟”，稳定结果与前两者一致，只是不再逐级等待。
+ */
+enum class SimulationMode {
+    Iterative, EventDriven, Levelized
+};
+
+/**
+ * @brief 编译网表中的门运算类型。
+ * @details 与 ComponentType 分离：它描述“仿真内核如何计算”，而非“编辑器里是什么元件”。
+ * - Source: 输入源，输出取自 Input 元件的当前状态或 Clock 元件在当前节拍的电平
+ * - Sink: 只接收信号、不产生输出（Output 元件）
+ * - And...Xnor: 基本逻辑门，直接在状态数组上计算
+ * - Buf: 缓冲，输出等于输入（展平层次时代替封装边界上的内部 Input/Output 元件）
+ * - Encapsulated: 封装元件，回退到其内部引擎计算
+ * - Lut: 纯组合的小型封装元件，按预先计算的真值表查表
+ */
+enum class GateOp : quint8 {
+    Source, Sink, And, Or, Not, Nand, Nor, Xor, Xnor, Buf, Encapsulated, Lut
+};
+
+/**
+ * @brief 编译后的网表：结构数组（SoA）布局，仿真只在这些连续数组上运行。
+ * @details `Component`/`Pin`/`Wire` 对象仍是面向编辑的视图，拓扑变化后由 `Engine` 重新编译。
+ * 引脚编号先排所有输入引脚 [0, inputPinCount)，再排所有输出引脚 [inputPinCount, pins.size())，
+ * 因此“清零所有输入引脚”是一次 memset，“检查稳定”是一次 memcmp。
+ */
+struct CompiledNetlist {
+    /** 门编号 → 运算类型 */
+    QVector<GateOp> ops;
+    /** 门 g 的输入引脚编号位于 inputPins[inputOffsets[g], inputOffsets[g+1]) */
+    QVector<int> inputOffsets;
+    /** 所有门的输入引脚编号（按门连续存放） */
+    QVector<int> inputPins;
+    /** 门 g 的输出引脚编号位于 outputPins[outputOffsets[g], outputOffsets[g+1]) */
+    QVector<int> outputOffsets;
+    /** 所有门的输出引脚编号（按门连续存放） */
+    QVector<int> outputPins;
+    /** 导线源引脚编号 */
+    QVector<int> wireSources;
+    /** 导线汇引脚编号 */
+    QVector<int> wireSinks;
+    /** 输出引脚 p 驱动的输入引脚位于 fanoutSinks[fanoutOffsets[p], fanoutOffsets[p+1]) */
+    QVector<int> fanoutOffsets;
+    /** 扇出表中的输入引脚编号 */
+    QVector<int> fanoutSinks;
+    /** 引脚编号 → 所属门编号 */
+    QVector<int> pinOwners;
+    /** 所有输入源门的编号 */
+    QVector<int> sourceGates;
+    /** 所有封装门的编号（不含查表门） */
+    QVector<int> encapsulatedGates;
+    /** 门编号 → 真值表（仅查表门非空；第 i 项的第 k 位是输入组合 i 时第 k 个输出） */
+    QVector<const QVector<quint32>*> lookupTables;
+    /** 是否有封装门在等待后台生成的真值表（生成后下次仿真重新编译，改为查表） */
+    bool awaitingLookupTables = false;
+    /** 编译时的真值表代数（见 EncapsulatedDefinition::lookupTableGeneration()） */
+    int lookupTableGeneration = 0;
+    /** 输入引脚编号 → 驱动它的输出引脚编号（悬空为 -1） */
+    QVector<int> pinDrivers;
+    /** 分层调度：按拓扑序排列的门编号，同一强连通分量的门连续存放（仅分层求值模式编译） */
+    QVector<int> levelOrder;
+    /** 第 b 个调度块的门位于 levelOrder[blockOffsets[b], blockOffsets[b+1]) */
+    QVector<int> blockOffsets;
+    /** 调度块是否为反馈环（多门强连通分量或自环），需在块内迭代求稳 */
+    QVector<bool> blockCyclic;
+    /** 第 w 个波次的调度块位于 [waveOffsets[w], waveOffsets[w+1])；同一波次的块互不依赖，可并行计算 */
+    QVector<int> waveOffsets;
+    /** 输入引脚总数（也是第一个输出引脚的编号） */
+    int inputPinCount = 0;
+    /** 引脚状态（每个引脚1字节，0/1） */
+    QByteArray states;
+    /** 门编号 → 组件（读取输入源状态、封装元件回退计算） */
+    QVector<Component*> components;
+    /** 引脚编号 → 引脚对象（把结果同步回编辑视图） */
+    QVector<Pin*> pins;
+};
+
+/**
+ * @brief 编译网表时的中间描述：一个门及其输入/输出引脚对象。
+ * @details 未展平时每个组件对应一个门；展平层次时，封装元件内部的组件也逐一成为门。
+ */
+struct NetlistGate {
+    /** 运算类型 */
+    GateOp op;
+    /** 来源组件（展平后可能是某个封装元件内部的组件） */
+    Component* component;
+    /** 输入引脚 */
+    QVector<Pin*> inputs;
+    /** 输出引脚 */
+    QVector<Pin*> outputs;
+    /** 真值表（仅查表门有效） */
+    const QVector<quint32>* lookupTable = nullptr;
 };
 
 /**
@@ -51,9 +160,16 @@ public:
     PinType type() const;
     /** 获取引脚索引 */
     int index() const;
+    /**
+     * @brief 获取引脚在所属引擎中的稠密编号。
+     * @details 由 `Engine` 编译网表时统一分配，即 `CompiledNetlist::states` 的下标；未分配时为 -1。
+     */
+    int stateIndex() const;
+    /** 设置稠密编号（仅供 Engine 使用） */
+    void setStateIndex(int stateIndex);
     /**
      * @brief 在场景坐标系中的位置。
-     * @details 依赖其所属 `ComponentItem` 的几何映射。
+     * @details 依赖其所属 `ComponentItem` 的几何映射，因此实现位于 graphics.cpp，引擎库本身不依赖图形层。
      */
     QPointF getScenePos() const;
 private:
@@ -65,6 +181,8 @@ private:
     int m_index;
     /** 当前逻辑电平 */
     bool m_state;
+    /** 引擎分配的稠密编号 */
+    int m_stateIndex;
 };
 
 /**
@@ -125,6 +243,10 @@ public:
     void setPosition(const QPointF& pos);
     /** 获取组件位置 */
     QPointF position() const;
+    /** 获取组件在所属引擎中的稳定ID（槽位下标）；尚未登记时为 kInvalidId */
+    quint32 id() const;
+    /** 无效ID */
+    static const quint32 kInvalidId = 0xFFFFFFFFu;
 protected:
     /** 组件类型 */
     ComponentType m_type;
@@ -136,6 +258,9 @@ protected:
     QVector<Pin*> m_outputPins;
     /** 对应的图形项指针（非拥有） */
     ComponentItem* m_graphicsItem;
+    /** 稳定ID，由 Engine 登记时分配、删除时回收 */
+    quint32 m_id;
+    friend class Engine;
 };
 
 // --- 具体元件类声明 ---
@@ -152,10 +277,37 @@ public:
     void toggleState();
     /** 设置当前状态并立即计算 */
     void setState(bool state);
+    /** 获取当前内部状态 */
+    bool currentState() const;
 private:
     /** 当前内部状态 */
     bool m_currentState;
 };
+/**
+ * @brief 时钟源组件：输出电平由所属引擎的时钟节拍决定，每个周期前半为低、后半为高。
+ * @details 时钟本身不保存节拍，引擎每次仿真时按 Engine::clockTick() 读取 levelAt()；
+ * 因此同一电路中的多个时钟总是相位对齐，存档/加载后从第 0 拍重新开始。
+ */
+class Clock : public Component {
+public:
+    /** 默认周期（节拍数）：每拍翻转一次 */
+    static const int kDefaultPeriod = 2;
+    /** 允许的最小周期 */
+    static const int kMinPeriod = 2;
+    /** 构造时钟组件 */
+    Clock(const QPointF& pos, int period = kDefaultPeriod);
+    /** 电平由引擎在仿真时读取，这里无需计算 */
+    void evaluate() override;
+    /** 设置周期（节拍数，小于 kMinPeriod 时取 kMinPeriod） */
+    void setPeriod(int period);
+    /** 获取周期（节拍数） */
+    int period() const;
+    /** 第 tick 拍时的输出电平 */
+    bool levelAt(quint64 tick) const;
+private:
+    /** 周期（节拍数） */
+    int m_period;
+};
 /** 输出端组件，显示输入状态。*/
 class Output : public Component { public: /** 构造输出组件 */ Output(const QPointF& pos); /** 输出由输入决定 */ void evaluate() override; };
 /** 与门 */
@@ -173,11 +325,31 @@ class XorGate : public Component { public: /** 构造异或门 */ XorGate(const
 /** 同或门 */
 class XnorGate : public Component { public: /** 构造同或门 */ XnorGate(const QPointF& pos); /** 计算同或 */ void evaluate() override; };
 
+/**
+ * @brief 一次仿真的收敛诊断（Engine::simulate() 的返回值，提交后也可由 Engine::lastSimulationResult() 取得）。
+ * @details 未收敛时记录迭代上限前最后 Engine::kOscillationWindow 轮中仍在翻转的引脚；
+ * 若这些轮次里电路状态出现重复，则给出重复的周期。分层求值按反馈环分别检测，整体周期为各环周期的最小公倍数。
+ */
+struct SimulationResult {
+    /** 执行的迭代轮数（同 Engine::lastIterationCount()） */
+    int iterations = 0;
+    /** 是否在迭代上限内达到稳定（Engine::step() 不做收敛诊断，恒为 true） */
+    bool converged = true;
+    /** 仍在翻转的引脚，按网表编号排序（收敛时为空；指针在下一次修改电路前有效） */
+    QVector<Pin*> oscillatingPins;
+    /** 检测到的振荡周期（单位延迟节拍数）；收敛或未检测到周期时为 0 */
+    int cyclePeriod = 0;
+};
+
 /**
  * @brief 引擎，负责组件/导线的创建、删除与逻辑仿真，以及JSON序列化。
  */
 class Engine {
 public:
+    /** 默认迭代上限（足以处理常见的振荡电路，又不会让界面卡死） */
+    static const int kDefaultMaxIterations = 100;
+    /** 振荡诊断的观察窗口：迭代上限前的最后这么多轮记录翻转的引脚与状态哈希（可检测的最长周期比它小 1） */
+    static const int kOscillationWindow = 32;
     /** 构造函数 */
     Engine();
     /** 析构函数，释放组件与导线 */
@@ -196,40 +368,391 @@ public:
      * @brief 创建一条导线并注册。
      * @param startPin 起点（输出引脚）
      * @param endPin 终点（输入引脚）
+     * @return 非法连接时返回 nullptr，原因见 lastError()
      */
     Wire* createWire(Pin* startPin, Pin* endPin);
-    /** 运行一次稳定化仿真 */
-    void simulate();
-    /** 获取所有组件映射（键为指针地址） */
-    const QMap<intptr_t, Component*>& getAllComponents() const;
+    /**
+     * @brief 运行一次稳定化仿真（按当前仿真模式分派），等价于依次调用下面三个阶段。
+     * @return 收敛诊断：迭代轮数、是否稳定，以及未稳定时仍在翻转的引脚与振荡周期
+     */
+    SimulationResult simulate();
+    /**
+     * @brief 恰好推进 ticks 个单位延迟节拍（每拍一轮“清零输入-驱动源-传播-计算”），不论电路是否已稳定。
+     * @details 与仿真模式无关，总按迭代求稳的单位延迟语义执行，因此可以逐拍观察锁存器、振荡环等时序行为；
+     * 结束后照常同步 Pin 对象与 lastChangedPins()，lastRunConverged() 表示最后一拍是否已无变化；
+     * 不记录振荡诊断（lastSimulationResult() 的引脚列表为空），逐拍推进的吞吐量不受观察窗口影响。
+     * 封装元件（未展平时）在每拍内部仍求稳到底。
+     */
+    void step(int ticks = 1);
+    /**
+     * @brief 按单位延迟语义逐拍推进，直到某一拍不再产生变化或推进了 maxTicks 拍。
+     * @return 在 maxTicks 拍内稳定返回 true；拍数见 lastIterationCount()
+     */
+    bool runUntilStable(int maxTicks);
+    /** 仿真第一步（GUI 线程）：必要时编译网表，记录起始状态并读取所有输入源 */
+    void prepareSimulation();
+    /**
+     * @brief 仿真第二步（可在工作线程执行）：只读写网表状态数组与封装元件的内部引擎，不访问本引擎的 Pin 对象。
+     * @details 运行期间调用方不得修改电路（增删组件/导线、切换模式）；切换输入源不受影响，在下一次仿真中生效。
+     */
+    void runPreparedSimulation();
+    /**
+     * @brief 把时钟推进一个节拍：只改变各 Clock 元件在下一次仿真中读到的电平，调用方随后 simulate()。
+     * @details 由界面的时钟调度器按目标频率调用；节拍数在 clearAll() 后归零。
+     */
+    void advanceClock();
+    /** 当前时钟节拍数 */
+    quint64 clockTick() const;
+    /** 仿真第三步（GUI 线程）：把变化的引脚同步回 Pin 对象，并记录到 lastChangedPins() */
+    void commitSimulation();
+    /**
+     * @brief 上一次 commitSimulation()（或 simulate()）中状态发生变化的引脚。
+     * @details 界面据此只重绘受影响的元件与导线；删除组件或清空电路后列表被清空，指针在下一次修改电路前有效。
+     */
+    const QVector<Pin*>& lastChangedPins() const;
+    /**
+     * @brief 挂上波形记录器（非拥有；传 nullptr 摘下）。
+     * @details 挂上时登记所有顶层输出引脚的当前电平，之后每次 commitSimulation() 记录一个采样。
+     * 记录器先于引擎销毁时会自行摘下；引擎先销毁时记录器保留已记录的波形。
+     */
+    void setWaveformRecorder(WaveformRecorder* recorder);
+    /** 当前挂着的波形记录器 */
+    WaveformRecorder* waveformRecorder() const;
+    /** 设置仿真模式（会同步到所有封装元件的内部引擎） */
+    void setSimulationMode(SimulationMode mode);
+    /** 获取当前仿真模式 */
+    SimulationMode simulationMode() const;
+    /** 设置每次仿真的迭代上限（会同步到所有封装元件的内部引擎） */
+    void setMaxIterations(int iterations);
+    /** 获取迭代上限 */
+    int maxIterations() const;
+    /** 上一次仿真是否在迭代上限内达到稳定 */
+    bool lastRunConverged() const;
+    /**
+     * @brief 上一次 commitSimulation()（或 simulate()、step()）的收敛诊断。
+     * @details 删除组件或清空电路后引脚列表被清空。
+     */
+    const SimulationResult& lastSimulationResult() const;
+    /**
+     * @brief 上一次仿真执行的迭代轮数（迭代求稳/活动驱动为单位延迟节拍数；
+     * 分层求值为 1 与各反馈环内迭代轮数中的最大值）。
+     */
+    int lastIterationCount() const;
+    /** 最近一次失败操作（如非法连线）的原因，供界面或命令行提示；成功时为空 */
+    QString lastError() const;
+    /**
+     * @brief 位并行批量仿真：把多组输入向量打包进 64 位字的各个位，每遍同时计算 256 组。
+     * @param inputVectors 每组输入，位序同 orderedInputs()
+     * @param outputVectors [out] 每组输入对应的输出，位序同 orderedOutputs()
+     * @param settled [out，可选] 每组输入是否在迭代上限内稳定；未稳定的组输出的是达到上限时的状态
+     * @return 参数有效返回 true（不代表所有组都已稳定，见 settled）；电路含未展平的封装元件或向量长度不符时返回 false
+     * @details 每组输入都从电路当前状态出发、按迭代求稳语义独立求稳，
+     * 结果与逐组调用 Input::setState + simulate() 并在每组之间恢复状态一致；电路自身状态不被修改。
+     */
+    bool simulateBatch(const QVector<QVector<bool>>& inputVectors, QVector<QVector<bool>>& outputVectors,
+                       QVector<bool>* settled = nullptr);
+    /**
+     * @brief 设置是否把封装元件的内部电路展平到本引擎的网表中一起仿真。
+     * @details 展平后不再逐层调用内部引擎的 simulate()，内部引脚的状态仍会同步回各自的 Pin 对象。
+     */
+    void setFlattenHierarchy(bool enabled);
+    /** 是否展平层次 */
+    bool flattenHierarchy() const;
+    /** 电路（连同展平后的所有封装元件内部）是否含有反馈环，即是否为时序电路 */
+    bool hasFeedbackLoops();
+    /** 按 Y 坐标排序的输入源组件（即封装后外部输入引脚的顺序） */
+    QVector<Component*> orderedInputs() const;
+    /** 按 Y 坐标排序的输出端组件（即封装后外部输出引脚的顺序） */
+    QVector<Component*> orderedOutputs() const;
+    /**
+     * @brief 获取所有组件（紧凑数组）。
+     * @details 顺序是确定的：按登记顺序排列，删除组件时用末尾的组件填补空位；加载存档后与存档中的顺序一致。
+     */
+    const QVector<Component*>& getAllComponents() const;
+    /** 按稳定ID查找组件，O(1)；ID无效或组件已删除时返回 nullptr */
+    Component* componentById(quint32 id) const;
     /** 获取所有导线 */
     const QVector<Wire*>& getAllWires() const;
-    /** 删除一个组件（连带移除Map记录） */
+    /** 删除一个组件：用末尾的组件填补它在紧凑数组中的空位，并释放它的ID（其余组件的ID不变） */
     void deleteComponent(Component* component);
     /** 删除一条导线 */
     void deleteWire(Wire* wire);
+    /** 批量删除导线：只遍历一次导线数组，删除高扇出组件的全部导线时不再是 O(导线数 × 扇出) */
+    void deleteWires(const QVector<Wire*>& wires);
     /** 从JSON加载电路（会先清空） */
     bool loadCircuitFromJson(const QJsonObject& json);
     /** 清理所有组件与导线 */
     void clearAll();
     /** 手动注册外部创建的组件（如封装元件） */
     void registerComponent(Component* component);
-    /** 保存完整电路为JSON */
+    /** 保存完整电路为JSON；组件ID即稳定ID，加载后 id() 不变 */
     QJsonObject saveCircuitToJson() const;
+    /**
+     * @brief 保存为紧凑的二进制存档（.tcb）：字符串表、定长的组件/导线数组、去重的封装定义（CBOR）。
+     * @details 布局与版本号见 engine.cpp；所有整数为小端序，组件以数组序号互相引用。
+     * 存档不记录组件ID：加载后ID按组件在存档中的序号重新分配（0..n-1），只有JSON存档保留 id()。
+     */
+    QByteArray saveCircuitToBinary() const;
+    /**
+     * @brief 从二进制存档加载电路（会先清空）。
+     * @param data 存档数据，可直接来自 QFile::map，加载过程中不会整体复制
+     * @param size 数据长度
+     * @return 格式或版本不符、数据越界时返回 false，原因见 lastError()
+     */
+    bool loadCircuitFromBinary(const char* data, qint64 size);
+    /** 流式加载的进度回调：参数为已读取的字节数与总字节数（未知时为 0），返回 false 表示取消加载 */
+    using LoadProgress = std::function<bool(qint64 bytesRead, qint64 totalBytes)>;
+    /**
+     * @brief 边解析边建图地从JSON流加载电路（会先清空），不构造整棵 QJsonObject 树。
+     * @details 组件和导线逐个物化、逐个创建，峰值内存接近最终网表本身；
+     * 引用了尚未读到的定义或组件的条目会暂存到对应段读完为止（旧存档中 definitions 段排在 components 之后）。
+     * @param device 已以只读方式打开的设备
+     * @param progress 每创建一批条目调用一次，可用于显示进度或取消
+     * @return 语法错误、数据无效或被取消时返回 false，原因见 lastError()
+     */
+    bool loadCircuitFromJsonStream(QIODevice* device, const LoadProgress& progress = LoadProgress());
+    /**
+     * @brief 以流式方式把电路写成JSON，不构造整棵 QJsonObject 树。
+     * @details 段的顺序为 definitions → components → wires，使流式加载无需暂存任何条目。
+     */
+    bool saveCircuitToJsonStream(QIODevice* device) const;
+    /** 按扩展名保存到文件：.tcb 为二进制存档，其余为 JSON */
+    bool saveCircuitToFile(const QString& filePath) const;
+    /**
+     * @brief 按扩展名从文件加载：.tcb 以内存映射方式读取二进制存档，其余按 JSON 流式解析。
+     * @details 可在工作线程中调用（只要没有其他线程同时访问本引擎）；封装定义注册表由互斥锁保护。
+     * @param progress 进度回调，返回 false 取消加载；二进制存档只在开始和结束时报告
+     */
+    bool loadCircuitFromFile(const QString& filePath, const LoadProgress& progress = LoadProgress());
     /** 保存给定组件集合为JSON（保留接口） */
     QJsonObject saveComponentsToJson(const QVector<Component*>& components) const;
     friend class EncapsulatedComponent;
+    friend class EncapsulatedDefinition;
 private:
-    /** 组件集合（拥有） */
-    QMap<intptr_t, Component*> m_components;
+    /** 组件集合（拥有）：槽位映射的紧凑数组 */
+    QVector<Component*> m_components;
+    /** 槽位表：组件ID → 在 m_components 中的下标，空闲槽位为 -1 */
+    QVector<int> m_componentSlots;
+    /** 空闲的组件ID，登记新组件时优先复用 */
+    QVector<quint32> m_freeComponentIds;
     /** 导线集合（拥有） */
     QVector<Wire*> m_wires;
+    /** 当前仿真模式 */
+    SimulationMode m_simulationMode;
+    /** 是否展平层次 */
+    bool m_flattenHierarchy;
+    /** 拓扑是否在上次仿真后发生过变化（增删组件/导线） */
+    bool m_topologyDirty;
+    /** 本次仿真准备时拓扑是否刚变化（供运行阶段的活动驱动模式使用） */
+    bool m_runTopologyChanged;
+    /** 本次仿真是否做振荡诊断（simulate()/runUntilStable() 为 true；step() 只推进节拍，为 false） */
+    bool m_diagnoseRun;
+    /** 上一次 simulate() 是否在迭代上限内达到稳定 */
+    bool m_lastRunConverged;
+    /** 上一次仿真执行的迭代轮数 */
+    int m_lastIterationCount;
+    /** 每次仿真的迭代上限 */
+    int m_maxIterations;
+    /** 最近一次失败操作的原因（保存等 const 操作也会记录） */
+    mutable QString m_lastError;
+    /** 编译后的结构数组网表（仿真只在它上面运行） */
+    CompiledNetlist m_netlist;
+    /** 当前时钟节拍数（Clock 元件据此给出电平） */
+    quint64 m_clockTick;
+    /** 本次 simulate() 开始时的引脚状态（结束时据此只同步变化的引脚） */
+    QByteArray m_runStartStates;
+    /** 上一次同步时状态发生变化的引脚 */
+    QVector<Pin*> m_changedPins;
+    /** 波形记录器（非拥有） */
+    WaveformRecorder* m_waveform;
+    /** 一轮仿真开始前的引脚状态快照 */
+    QByteArray m_previousStates;
+    /** 本次 simulate() 中各输入源门的状态（与 sourceGates 一一对应） */
+    QByteArray m_sourceValues;
+    /** 活动驱动仿真中“门已在待计算列表中”的标记（每个门1字节） */
+    QByteArray m_gateMarks;
+    /** 达到迭代上限时尚未传播出去的输出引脚编号（下次活动驱动仿真继续传播） */
+    QVector<int> m_pendingOutputs;
+    /** 观察窗口内翻转过的引脚标记（每个引脚1字节；每次仿真结束时清回全零） */
+    QByteArray m_toggledPins;
+    /** 本次仿真观察窗口内翻转过的引脚编号（未收敛时即振荡的引脚） */
+    QVector<int> m_oscillatingPins;
+    /** 观察窗口内每轮结束时的状态哈希 */
+    QVector<quint64> m_roundHashes;
+    /** 本次仿真检测到的振荡周期（0 表示未检测到） */
+    int m_cyclePeriod;
+    /** 上一次提交的收敛诊断 */
+    SimulationResult m_lastResult;
+
+    /**
+     * @brief 迭代求稳：每轮全量清零、评估、传播。
+     * @param maxRounds 最多执行的轮数
+     * @param stopWhenStable 某轮无变化时是否提前结束（step() 传 false，恰好执行 maxRounds 轮）
+     */
+    void simulateIterative(int maxRounds, bool stopWhenStable = true);
+    /**
+     * @brief 活动驱动：仅对输入发生变化的门进行计算。
+     * @param fullFirstRound 拓扑刚变化时，第一拍按全量方式执行
+     */
+    void simulateEventDriven(bool fullFirstRound);
+    /** 分层求值：按拓扑序单遍计算无环部分，只在反馈环内迭代 */
+    void simulateLevelized();
+    /**
+     * @brief 计算一个分层调度块，返回其是否稳定（可在多个线程中对不同的块并发调用）。
+     * @param oscillatingPins [out] 未稳定时追加块内仍在翻转的引脚
+     * @param cyclePeriod [in,out] 未稳定时与块内检测到的周期合并（取最小公倍数）
+     */
+    bool evaluateLevelBlock(int block, QVector<char>& oldOutputs, int& rounds, QVector<int>& oscillatingPins, int& cyclePeriod);
+    /** 计算强连通分量并生成按波次排列的分层调度（Tarjan 算法，显式栈） */
+    void levelizeNetlist();
+    /** 在状态数组上执行一轮“清零输入-驱动源-传播-计算”的全量迭代 */
+    void runFullRound();
+    /** 观察窗口内的一轮结束：与 before 比较标记翻转的引脚，并记录状态哈希 */
+    void recordOscillationRound(const char* before);
+    /** 结束观察：清回翻转标记；未收敛时保留振荡引脚并按状态哈希求周期 */
+    void finishOscillationWindow(bool converged);
+    /** 在状态数组上计算一个门 */
+    void evaluateGate(int gate);
+    /** 由组件/导线对象编译结构数组网表，并从引脚对象读取初始状态 */
+    void compileNetlist();
+    /**
+     * @brief 收集某个引擎中的门与导线（展平时递归进入封装元件）。
+     * @param engine 被收集的引擎
+     * @param enclosing 该引擎所属的封装元件（顶层为 nullptr）
+     * @param gates [out] 门列表
+     * @param wires [out] 导线列表
+     */
+    void collectGates(const Engine* engine, const EncapsulatedComponent* enclosing,
+                      QVector<NetlistGate>& gates, QVector<Wire*>& wires) const;
+    /** 把本引擎及所有内部引擎标记为拓扑已变化（展平开关切换后重新编译） */
+    void markHierarchyDirty();
+    /** 把状态数组中本次仿真发生变化的引脚同步回引脚对象，并记录到 m_changedPins */
+    void syncPinsFromNetlist();
+    /** 将组件登记到Map，并同步仿真模式、标记拓扑变化 */
+    void insertComponent(Component* component);
+    /** 组件的存档ID：即它的稳定ID，删除其他组件不会改变它 */
+    qint64 savedIdOf(const Component* component) const;
+    /** 按稳定ID升序排列的组件（保存顺序） */
+    QVector<Component*> componentsInIdOrder() const;
+    /** 加载完成后让组件沿用JSON存档中的稳定ID（savedIds 与 m_components 一一对应） */
+    void restoreSavedIds(const QVector<qint64>& savedIds);
+    /** 按共享定义的蓝图实例化内部电路（不再解析JSON） */
+    bool instantiateDefinition(const EncapsulatedDefinition& definition);
+    /** 按“子定义在前”的顺序收集电路中用到的所有封装定义（递归） */
+    static void collectDefinitions(const EncapsulatedDefinition* definition,
+                                   QVector<const EncapsulatedDefinition*>& ordered);
     /**
      * @brief 内部加载函数（不清空已存在内容）。
      * @details 用于封装元件内部引擎的构建。
      */
     bool loadCircuitInternal(const QJsonObject& json);
 };
+/**
+ * @brief 封装元件的共享定义（解析一次，不可变）。
+ * @details 注册表以“名称#内容哈希”为键：同名且内容相同的内部电路只规范化、解析一次，
+ * 所有实例引用同一份定义，实例自身只持有内部引擎中的引脚状态。保存电路时每个定义只写出一次。
+ * 规范化后的内部电路中，组件ID改为数组序号，嵌套的封装元件以 "definition" 键引用子定义。
+ */
+class EncapsulatedDefinition {
+public:
+    /** 蓝图中的一个组件 */
+    struct Part {
+        /** 组件类型 */
+        ComponentType type;
+        /** 组件位置 */
+        QPointF position;
+        /** 子定义（仅封装元件有效） */
+        const EncapsulatedDefinition* definition;
+    };
+    /** 蓝图中的一条导线（以组件序号与引脚序号表示） */
+    struct Link {
+        int startPart;
+        int startPin;
+        int endPart;
+        int endPin;
+    };
+
+    /** 获取名称 */
+    QString name() const;
+    /** 获取注册表键（名称#内容哈希） */
+    QString key() const;
+    /** 获取规范化后的内部电路JSON */
+    const QJsonObject& circuitJson() const;
+    /** 获取组件蓝图 */
+    const QVector<Part>& parts() const;
+    /** 获取导线蓝图 */
+    const QVector<Link>& links() const;
+    /**
+     * @brief 获取真值表（不阻塞，线程安全）。
+     * @details 注册定义时即在线程池中开始生成，仅当定义（含所有子定义）无反馈环、输入不超过16个、输出不超过32个时生成；
+     * 表项下标的第 k 位是第 k 个输入（按 Y 坐标排序），表项的第 k 位是第 k 个输出。
+     * @return 真值表；仍在生成、时序电路或规模过大时返回 nullptr，调用方应回退到内部仿真
+     */
+    const QVector<quint32>* lookupTable() const;
+    /** 真值表已生成或仍在生成（false 表示该定义不会有真值表） */
+    bool lookupTableExpected() const;
+    /** 真值表代数：每生成完一张真值表加一，引擎据此发现等待中的表已可用 */
+    static int lookupTableGeneration();
+
+    /**
+     * @brief 查找或创建定义。
+     * @param name 名称
+     * @param circuitJson 内部电路（可含 definitions 段、嵌套的 internal_circuit 或 definition 引用）
+     * @return 共享定义；JSON 无效时返回 nullptr
+     */
+    static const EncapsulatedDefinition* obtain(const QString& name, const QJsonObject& circuitJson);
+    /** 按键查找已注册的定义，未找到返回 nullptr */
+    static const EncapsulatedDefinition* find(const QString& key);
+    /**
+     * @brief 注册存档 definitions 段中的所有定义。
+     * @return 全部有效返回 true
+     */
+    static bool registerSection(const QJsonArray& section);
+
+private:
+    /** 仅由注册表创建 */
+    EncapsulatedDefinition() = default;
+    /** 全局注册表（键 → 定义） */
+    static QHash<QString, QSharedPointer<EncapsulatedDefinition>>& registry();
+    /**
+     * @brief 保护注册表的互斥锁（可重入：obtain 解析嵌套定义时会再次进入）。
+     * @details 后台线程打开文件时会与界面线程同时查找、登记定义。
+     */
+    static QRecursiveMutex& registryMutex();
+    /**
+     * @brief obtain 的内部实现。
+     * @param section 当前存档的 definitions 段（键 → 条目），用于解析尚未注册的引用
+     * @param depth 嵌套深度（防止恶意数据无限递归）
+     */
+    static const EncapsulatedDefinition* obtain(const QString& name, const QJsonObject& circuitJson,
+                                                const QHash<QString, QJsonObject>& section, int depth);
+    /** 解析一个 definition 引用：先查注册表，再查当前存档的 definitions 段 */
+    static const EncapsulatedDefinition* resolve(const QString& key, const QHash<QString, QJsonObject>& section, int depth);
+
+    /** 名称 */
+    QString m_name;
+    /** 注册表键 */
+    QString m_key;
+    /** 规范化后的内部电路 */
+    QJsonObject m_circuitJson;
+    /** 组件蓝图 */
+    QVector<Part> m_parts;
+    /** 导线蓝图 */
+    QVector<Link> m_links;
+    /** 真值表的生成状态 */
+    enum TableState { TablePending, TableReady, TableUnavailable };
+    /** 当前的 TableState（后台线程生成完毕后以 release 语义发布） */
+    QAtomicInt m_tableState{TablePending};
+    /** 真值表（发布为 TableReady 之后只读） */
+    QVector<quint32> m_lookupTable;
+    /** 用批量仿真穷举所有输入组合，生成真值表；不可查表时返回 false */
+    bool buildLookupTable();
+    /** 在线程池中为刚登记的定义生成真值表；显然不可查表的定义直接标为不可用 */
+    static void scheduleLookupTable(const QSharedPointer<EncapsulatedDefinition>& definition);
+    /** 真值表代数计数器 */
+    static QAtomicInt& tableGeneration();
+};
+
 /**
  * @brief 封装组件：包含一套内部电路，外部以若干输入/输出引脚暴露。
  */
@@ -242,26 +765,39 @@ public:
      * @param internalCircuitJson 内部电路定义
      */
     EncapsulatedComponent(const QPointF& pos, const QString& name, const QJsonObject& internalCircuitJson);
+    /**
+     * @brief 由共享定义构造封装组件（不解析JSON）。
+     * @param pos 外部组件位置
+     * @param definition 共享定义（为空时内部电路为空）
+     */
+    EncapsulatedComponent(const QPointF& pos, const EncapsulatedDefinition* definition);
     /** 析构函数，释放内部引擎 */
     ~EncapsulatedComponent() override;
 
     /** 核心评估：同步外部输入→内部，运行内部仿真，再回填外部输出 */
     void evaluate() override;
 
-    /** 获取内部电路JSON（只读引用） */
+    /** 获取内部电路JSON（只读引用，即共享定义中的规范化电路） */
     const QJsonObject& getInternalJson() const;
 
+    /** 获取共享定义 */
+    const EncapsulatedDefinition* definition() const;
+
     /** 获取封装组件名称 */
     QString getName() const;
 
+    /** 内部电路在上一次评估中是否已达到稳定 */
+    bool isInternallySettled() const;
+
+    friend class Engine;
 private:
     /** 根据内部电路自动构建外部引脚与内部引脚的映射 */
     void buildPinMappings();
 
     /** 内部迷你引擎（拥有） */
     Engine* m_internalEngine;
-    /** 内部电路定义（用于序列化） */
-    QJsonObject m_internalCircuitJson;
+    /** 共享定义（非拥有，由注册表持有） */
+    const EncapsulatedDefinition* m_definition;
     /** 组件名称 */
     QString m_name;
 
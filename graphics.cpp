@@ -4,17 +4,66 @@
 #include <QGraphicsSceneMouseEvent>   // 场景鼠标事件
 #include <QDebug>                     // 调试输出
 #include <QStyleOptionGraphicsItem>   // 绘制选中态等风格信息
+#include <QThreadPool>                // 仿真运行所在的线程池
+#include <QtConcurrent>               // 把仿真提交到线程池
+#include <QMessageBox>                // 提示非法连接
+#include <QtMath>                     // qFloor：引脚网格的单元坐标
+#include <QSet>                       // 需要重绘的元件去重
+#include <QInputDialog>               // 设置时钟周期
+#include <QElapsedTimer>              // 分批重建的时间片计时
+
+/** 低于此缩放级别（QStyleOptionGraphicsItem::levelOfDetailFromTransform）时改用简化绘制：元件画成纯色矩形、导线由场景批量绘制 */
+static const qreal kLowDetailLevel = 0.4;
+
+/** 当前画笔变换是否处于简化绘制的缩放级别 */
+static bool isLowDetail(const QPainter* painter)
+{
+    return QStyleOptionGraphicsItem::levelOfDetailFromTransform(painter->worldTransform()) < kLowDetailLevel;
+}
 /**
  * @file graphics.cpp
  * @brief 前端图形项(ComponentItem/WireItem)与交互场景(GraphicsScene)的实现。
  */
 
+// ===============================================
+// === Pin 场景坐标（依赖图形项，因此在图形层实现）
+// ===============================================
+
+/** 引脚在所属元件图形项局部坐标中的位置（与 ComponentItem::paint 的引脚布局一致） */
+static QPointF pinLocalPos(const Pin* pin)
+{
+    // 1. 从所属元件获取输入/输出引脚的总数
+    const Component* owner = pin->owner();
+    int numInputs = owner->inputPins().size();
+    int numOutputs = owner->outputPins().size();
+    int maxPins = qMax(numInputs, numOutputs);
+
+    // 2. 根据最大引脚数，动态计算元件的理论高度（与 ComponentItem::paint() 中完全相同的公式）
+    qreal bodyHeight = 50.0; // 默认高度
+    if (maxPins > 4) {
+        bodyHeight = 10.0 * (maxPins + 1);
+    }
+
+    // 3. 使用这个动态计算出的 bodyHeight 来确定引脚的 Y 坐标
+    int pinCount = (pin->type() == Pin::Input) ? numInputs : numOutputs;
+    qreal yPos = bodyHeight * (pin->index() + 1) / (pinCount + 1);
+    return (pin->type() == Pin::Input) ? QPointF(0, yPos) : QPointF(100, yPos);
+}
+
+/** 计算并返回场景坐标中的引脚位置 */
+QPointF Pin::getScenePos() const {
+    if (m_owner && m_owner->getGraphicsItem()) {
+        return m_owner->getGraphicsItem()->mapToScene(pinLocalPos(this));
+    }
+    return QPointF();
+}
+
 // ===============================================
 // === ComponentItem 实现
 // ===============================================
 
 /** 通过后端组件数据构造，并建立双向绑定 */
-ComponentItem::ComponentItem(Component* data) : m_componentData(data) {
+ComponentItem::ComponentItem(Component* data) : m_componentData(data), m_oscillating(false) {
     setPos(data->position());
     setFlags(ItemIsMovable | ItemIsSelectable | ItemSendsGeometryChanges);
     data->setGraphicsItem(this);
@@ -54,6 +103,27 @@ void ComponentItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *opt
 
     // 使用动态计算的高度来定义元件主体的矩形
     QRectF bodyRect(0, 0, 100, bodyHeight);
+
+    // --- 缩小到看不清文字时：只画一个不抗锯齿的纯色矩形（输入/输出按状态着色，选中时高亮） ---
+    if (isLowDetail(painter)) {
+        static const QColor lowDetailBody("#c8c8c8");
+        static const QColor lowDetailSelected("#66ccff");
+        static const QColor lowDetailHigh("#4CAF50");
+        static const QColor lowDetailLow("#F44336");
+        static const QColor lowDetailOscillating("#FF9800");
+        QColor fill = lowDetailBody;
+        if (option->state & QStyle::State_Selected) {
+            fill = lowDetailSelected;
+        } else if (m_oscillating) {
+            fill = lowDetailOscillating;
+        } else if ((m_componentData->type() == ComponentType::Input || m_componentData->type() == ComponentType::Clock) && numOutputs > 0) {
+            fill = m_componentData->outputPins()[0]->getState() ? lowDetailHigh : lowDetailLow;
+        } else if (m_componentData->type() == ComponentType::Output && numInputs > 0) {
+            fill = m_componentData->inputPins()[0]->getState() ? lowDetailHigh : lowDetailLow;
+        }
+        painter->fillRect(bodyRect, fill);
+        return;
+    }
     painter->setRenderHint(QPainter::Antialiasing);
 
     // 绘制主体
@@ -77,6 +147,13 @@ void ComponentItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *opt
         }
     }
 
+    // 绘制振荡标记：未收敛时仍在翻转的元件
+    if (m_oscillating) {
+        painter->setPen(QPen(QColor("#FF9800"), 3, Qt::DashLine));
+        painter->setBrush(Qt::NoBrush);
+        painter->drawRoundedRect(bodyRect.adjusted(-4, -4, 4, 4), 7, 7);
+    }
+
     // 准备文字和状态
     painter->setPen(Qt::black);
     QString text;
@@ -116,6 +193,21 @@ void ComponentItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *opt
         painter->drawText(QRectF(50,0,50,50), Qt::AlignCenter, text);
         break;
 
+    case ComponentType::Clock:
+        // 左半按当前电平着色（同输入源），右半显示周期
+        text = QString("时钟\n周期 %1").arg(static_cast<Clock*>(m_componentData)->period());
+        state = m_componentData->outputPins()[0]->getState();
+        painter->setBrush(state ? QColor("#4CAF50") : QColor("#F44336"));
+        painter->setPen(Qt::NoPen);
+        painter->drawRect(0, 0, 50, 50);
+        painter->setPen(Qt::white);
+        painter->setFont(QFont("Arial", 10, QFont::Bold));
+        painter->drawText(QRectF(0,0,50,50), Qt::AlignCenter, state ? "1" : "0");
+        painter->setFont(QFont());
+        painter->setPen(Qt::black);
+        painter->drawText(QRectF(50,0,50,50), Qt::AlignCenter, text);
+        break;
+
     case ComponentType::And: text = "与门"; break;
     case ComponentType::Or: text = "或门"; break;
     case ComponentType::Not: text = "非门"; break;
@@ -133,7 +225,7 @@ void ComponentItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *opt
     }
 
     // 为普通逻辑门统一绘制文字
-    if (m_componentData->type() >= ComponentType::And) {
+    if (m_componentData->type() >= ComponentType::And && m_componentData->type() != ComponentType::Clock) {
         painter->drawText(bodyRect, Qt::AlignCenter, text);
     }
 
@@ -194,19 +286,28 @@ Pin* ComponentItem::getPinAt(const QPointF &localPos) {
 /** 捕获位置变化，将位置同步回后端数据 */
 QVariant ComponentItem::itemChange(GraphicsItemChange change, const QVariant &value) {
     if (change == ItemPositionHasChanged && m_componentData) {
-        // 将 this->pos() 改为 value.toPointF()
-        qDebug() << "itemChange called! New position:" << value.toPointF() << "Old position:" << this->pos();
         m_componentData->setPosition(value.toPointF());
+        // 让场景只更新与这个组件相连的导线，以及它的引脚在网格中的位置
+        if (auto graphicsScene = qobject_cast<GraphicsScene*>(scene())) {
+            graphicsScene->componentMoved(this);
+        }
     }
     return QGraphicsItem::itemChange(change, value);
 }
 
+/** 设置振荡标记，变化时重绘 */
+void ComponentItem::setOscillating(bool oscillating) {
+    if (m_oscillating == oscillating) return;
+    m_oscillating = oscillating;
+    update();
+}
+
 // ===============================================
 // === WireItem 实现
 // ===============================================
 
 /** 构造导线图形项 */
-WireItem::WireItem(Wire* data) : m_wireData(data) {
+WireItem::WireItem(Wire* data) : m_wireData(data), m_oscillating(false) {
     setPen(QPen(Qt::black, 2));
     setZValue(-1); // 确保导线在元件下面
 }
@@ -223,25 +324,481 @@ void WireItem::updatePosition() {
     }
 }
 
-/** 根据导线状态上色绘制 */
+/** 根据导线状态上色绘制（画笔只创建一次）；简化绘制时由 GraphicsScene::drawBackground 批量绘制，这里跳过 */
 void WireItem::paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget) {
-    if (!m_wireData) return;
-    bool state = m_wireData->getState();
-    QPen customPen;
-    customPen.setColor(state ? Qt::green : Qt::red);
-    customPen.setWidth(2);
-    painter->setPen(customPen);
+    if (!m_wireData || isLowDetail(painter)) return;
+    static const QPen highPen(Qt::green, 2);
+    static const QPen lowPen(Qt::red, 2);
+    static const QPen oscillatingPen(QColor("#FF9800"), 4);
+    painter->setPen(m_oscillating ? oscillatingPen : (m_wireData->getState() ? highPen : lowPen));
     painter->drawLine(line());
 }
 
+/** 设置振荡标记，变化时重绘 */
+void WireItem::setOscillating(bool oscillating) {
+    if (m_oscillating == oscillating) return;
+    m_oscillating = oscillating;
+    update();
+}
+
 // ===============================================
 // === GraphicsScene 实现
 // ===============================================
 
+/** 引脚网格的单元边长（像素），大于引脚的可点击范围，因此命中检测只需查 3×3 个单元 */
+static const qreal kPinGridCell = 32.0;
+/** 引脚的可点击半宽（与 ComponentItem::getPinAt 的可点击方框一致） */
+static const qreal kPinHitHalfSize = 4.0;
+/** 分批重建每个时间片的时长上限（毫秒），留出余量给同一帧内的绘制与输入 */
+static const int kRebuildSliceMs = 10;
+/** 分批重建时每创建这么多图形项检查一次耗时 */
+static const int kRebuildCheckInterval = 64;
+
+/** 场景坐标所在网格单元的键：高32位为列号，低32位为行号 */
+static quint64 pinGridKey(qint64 column, qint64 row)
+{
+    return (quint64(quint32(qint32(column))) << 32) | quint32(qint32(row));
+}
+/** 场景坐标所在网格单元的键 */
+static quint64 pinGridKey(const QPointF& scenePos)
+{
+    return pinGridKey(qFloor(scenePos.x() / kPinGridCell), qFloor(scenePos.y() / kPinGridCell));
+}
+
 /** 通过引擎构造场景，初始化交互状态 */
 GraphicsScene::GraphicsScene(Engine* engine, QObject* parent)
-    : QGraphicsScene(parent), m_engine(engine), m_tempLine(nullptr), m_startPin(nullptr), m_currentMode(Idle)
-{}
+    : QGraphicsScene(parent), m_engine(engine), m_tempLine(nullptr), m_startPin(nullptr), m_currentMode(Idle),
+    m_definitionToAdd(nullptr), m_simulationRunning(false), m_simulationPending(false), m_paused(false),
+    m_rebuildNext(0), m_rebuilding(false), m_bulkInserting(false), m_indexMethodBeforeBulk(BspTreeIndex)
+{
+    connect(&m_simulationWatcher, &QFutureWatcher<void>::finished, this, &GraphicsScene::onSimulationFinished);
+    m_rebuildTimer.setSingleShot(true);
+    m_rebuildTimer.setInterval(0);
+    connect(&m_rebuildTimer, &QTimer::timeout, this, &GraphicsScene::continueRebuild);
+}
+
+/**
+ * @brief 请求仿真：GUI线程准备（编译网表、读取输入源），线程池运行，完成后回到GUI线程提交。
+ * @details 每个标签页的引擎各自提交，多个标签页因此可以同时仿真。
+ */
+void GraphicsScene::requestSimulation()
+{
+    if (m_paused) return; // 单步模式下只由 stepSimulation() 推进
+    if (m_simulationRunning) {
+        m_simulationPending = true;
+        return;
+    }
+    m_engine->prepareSimulation();
+    m_simulationRunning = true;
+    Engine* engine = m_engine;
+    m_simulationWatcher.setFuture(QtConcurrent::run(QThreadPool::globalInstance(), [engine]() {
+        engine->runPreparedSimulation();
+    }));
+}
+
+/**
+ * @brief 阻塞等待当前仿真完成并提交；若期间有新的请求，则同步补跑一次，保证返回时引脚状态是最新的。
+ * @details 同时重绘时钟节拍积压的引脚：调用方随后可能删除元件，积压列表不能再持有它们的引脚。
+ */
+void GraphicsScene::waitForSimulation()
+{
+    flushPendingRepaint();
+    if (!m_simulationRunning) return;
+    m_simulationWatcher.waitForFinished();
+    m_simulationRunning = false;
+    m_engine->commitSimulation();
+    repaintChangedPins();
+    if (m_simulationPending) {
+        m_simulationPending = false;
+        m_engine->simulate();
+        repaintChangedPins();
+    }
+    updateOscillationHighlight();
+}
+
+/** 暂停或恢复自动仿真；恢复时补跑一次，使电路回到稳定状态 */
+void GraphicsScene::setPaused(bool paused)
+{
+    if (m_paused == paused) return;
+    waitForSimulation();
+    m_paused = paused;
+    if (!m_paused) { requestSimulation(); }
+}
+
+/** @return 是否暂停自动仿真 */
+bool GraphicsScene::isPaused() const { return m_paused; }
+
+/** 单步：等待后台仿真提交后，同步推进 ticks 个单位延迟节拍 */
+bool GraphicsScene::stepSimulation(int ticks)
+{
+    waitForSimulation();
+    m_engine->step(ticks);
+    repaintChangedPins();
+    return m_engine->lastRunConverged();
+}
+
+/** 仿真完成：提交结果、刷新画面，并处理运行期间积压的请求 */
+void GraphicsScene::onSimulationFinished()
+{
+    if (!m_simulationRunning) return; // 已由 waitForSimulation 提交
+    m_simulationRunning = false;
+    m_engine->commitSimulation();
+    repaintChangedPins();
+    updateOscillationHighlight();
+    if (m_simulationPending) {
+        m_simulationPending = false;
+        requestSimulation();
+    }
+}
+
+/**
+ * @brief 运行 count 个时钟节拍：每拍推进时钟并同步仿真到稳定。
+ * @details 由时钟调度器在 GUI 线程调用。各拍变化的引脚只累积起来，
+ * 等调度器按屏幕刷新率调用 flushPendingRepaint() 时才统一重绘。暂停时直接返回。
+ */
+void GraphicsScene::runClockTicks(int count)
+{
+    if (m_paused) return; // 暂停时电路只由 stepSimulation() 推进，时钟节拍一律忽略
+    if (m_simulationRunning) { waitForSimulation(); } // 先提交交互触发的后台仿真
+    for (int i = 0; i < count; ++i) {
+        m_engine->advanceClock();
+        m_engine->simulate();
+        for (Pin* pin : m_engine->lastChangedPins()) { m_pendingRepaint.insert(pin); }
+    }
+    if (count > 0) { updateOscillationHighlight(); }
+}
+
+/**
+ * @brief 按上一次提交的收敛诊断标出振荡环：仍在翻转的引脚所属元件，以及从这些输出引脚出发的导线。
+ * @details 收敛且没有旧标记时立即返回，正常仿真不付出额外代价；内部电路的引脚没有图形项，直接跳过。
+ */
+void GraphicsScene::updateOscillationHighlight()
+{
+    const SimulationResult& result = m_engine->lastSimulationResult();
+    if (result.converged && m_oscillatingComponents.isEmpty() && m_oscillatingWires.isEmpty()) return;
+    clearOscillationHighlight();
+    if (result.converged) return;
+
+    for (Pin* pin : result.oscillatingPins) {
+        ComponentItem* item = pin->owner()->getGraphicsItem();
+        if (!item || item->scene() != this) continue;
+        item->setOscillating(true);
+        m_oscillatingComponents.insert(item);
+        if (pin->type() != Pin::Output) continue;
+        for (WireItem* wireItem : m_wiresByComponent.value(pin->owner())) {
+            if (wireItem->wireData()->startPin() != pin) continue;
+            wireItem->setOscillating(true);
+            m_oscillatingWires.insert(wireItem);
+        }
+    }
+    emit oscillationDetected(result.oscillatingPins.size(), result.cyclePeriod, result.iterations);
+}
+
+/** 取消所有振荡标记 */
+void GraphicsScene::clearOscillationHighlight()
+{
+    for (ComponentItem* item : m_oscillatingComponents) { item->setOscillating(false); }
+    for (WireItem* wireItem : m_oscillatingWires) { wireItem->setOscillating(false); }
+    m_oscillatingComponents.clear();
+    m_oscillatingWires.clear();
+}
+
+/** 重绘时钟节拍积压的变化引脚 */
+void GraphicsScene::flushPendingRepaint()
+{
+    if (m_pendingRepaint.isEmpty()) return;
+    repaintPins(m_pendingRepaint.values());
+    m_pendingRepaint.clear();
+}
+
+/** 重绘上一次提交中状态变化的引脚 */
+void GraphicsScene::repaintChangedPins()
+{
+    repaintPins(m_engine->lastChangedPins());
+}
+
+/**
+ * @brief 失效引脚对应的图形项：引脚所属元件，以及从变化的输出引脚出发的导线。
+ * @details 导线颜色取自起点引脚，因此输入引脚的变化只需重绘元件本身；
+ * 一次切换只重绘它的扇出锥，而不是整个场景。内部电路（封装或展平）的引脚没有图形项，直接跳过。
+ */
+void GraphicsScene::repaintPins(const QVector<Pin*>& changed)
+{
+    if (changed.isEmpty()) return;
+
+    QSet<ComponentItem*> components;
+    for (Pin* pin : changed) {
+        ComponentItem* item = pin->owner()->getGraphicsItem();
+        if (!item || item->scene() != this) continue;
+        components.insert(item);
+        if (pin->type() != Pin::Output) continue;
+        for (WireItem* wireItem : m_wiresByComponent.value(pin->owner())) {
+            if (wireItem->wireData()->startPin() == pin) { wireItem->update(); }
+        }
+    }
+    for (ComponentItem* item : components) { item->update(); }
+}
+
+/**
+ * @brief 简化绘制时在元件下方批量画出导线：按状态分成两组，每组一次 drawLines 调用。
+ * @details 缩小后单根导线的单独绘制开销远大于线段本身，合批后每帧只切换两次画笔；
+ * 画笔是宽 1 像素的装饰笔，缩得再小也不会消失。正常缩放级别下导线仍由 WireItem::paint 逐根绘制。
+ */
+void GraphicsScene::drawBackground(QPainter* painter, const QRectF& rect)
+{
+    QGraphicsScene::drawBackground(painter, rect);
+    if (!isLowDetail(painter) || m_wiresByComponent.isEmpty()) return;
+
+    static const QPen highPen = [] { QPen pen(Qt::green, 0); pen.setCosmetic(true); return pen; }();
+    static const QPen lowPen = [] { QPen pen(Qt::red, 0); pen.setCosmetic(true); return pen; }();
+
+    // --- 经场景的BSP索引只取出与重绘区域相交的导线（不遍历全部导线） ---
+    m_lowDetailHigh.clear();
+    m_lowDetailLow.clear();
+    const QList<QGraphicsItem*> candidates = items(rect, Qt::IntersectsItemBoundingRect);
+    for (QGraphicsItem* item : candidates) {
+        if (item->type() != WireItem::Type) continue;
+        const WireItem* wireItem = static_cast<const WireItem*>(item);
+        (wireItem->wireData()->getState() ? m_lowDetailHigh : m_lowDetailLow).append(wireItem->line());
+    }
+
+    painter->save();
+    painter->setRenderHint(QPainter::Antialiasing, false);
+    painter->setPen(lowPen);
+    painter->drawLines(m_lowDetailLow.constData(), int(m_lowDetailLow.size()));
+    painter->setPen(highPen);
+    painter->drawLines(m_lowDetailHigh.constData(), int(m_lowDetailHigh.size()));
+    painter->restore();
+}
+
+/** 把引脚按当前场景坐标登记到网格（已登记的先从旧单元移除） */
+void GraphicsScene::indexPin(Pin* pin)
+{
+    indexPin(pin, pin->getScenePos());
+}
+
+/** 把引脚按给定的场景坐标登记到网格（批量重建时坐标已预先算好） */
+void GraphicsScene::indexPin(Pin* pin, const QPointF& scenePos)
+{
+    const quint64 key = pinGridKey(scenePos);
+    auto cell = m_pinCells.find(pin);
+    if (cell != m_pinCells.end()) {
+        if (cell.value() == key) return;
+        m_pinGrid[cell.value()].removeOne(pin);
+        cell.value() = key;
+    } else {
+        m_pinCells.insert(pin, key);
+    }
+    m_pinGrid[key].append(pin);
+}
+
+/** 把引脚从网格中移除 */
+void GraphicsScene::unindexPin(Pin* pin)
+{
+    auto cell = m_pinCells.find(pin);
+    if (cell == m_pinCells.end()) return;
+    auto bucket = m_pinGrid.find(cell.value());
+    if (bucket != m_pinGrid.end()) {
+        bucket.value().removeOne(pin);
+        if (bucket.value().isEmpty()) m_pinGrid.erase(bucket);
+    }
+    m_pinCells.erase(cell);
+}
+
+/**
+ * @brief 组件移动后：更新与它相连的导线几何，并重新登记它的引脚。
+ * @details 拖动时每帧的代价只与被拖动组件的导线数有关；引脚没有跨出网格单元时不改动网格，
+ * 尚未登记的引脚（如构造期间的 setPos）跳过。
+ */
+void GraphicsScene::componentMoved(ComponentItem* item)
+{
+    const auto attached = m_wiresByComponent.constFind(item->component());
+    if (attached != m_wiresByComponent.constEnd()) {
+        for (WireItem* wireItem : attached.value()) wireItem->updatePosition();
+    }
+    for (Pin* pin : item->component()->inputPins()) {
+        if (m_pinCells.contains(pin)) indexPin(pin);
+    }
+    for (Pin* pin : item->component()->outputPins()) {
+        if (m_pinCells.contains(pin)) indexPin(pin);
+    }
+}
+
+/**
+ * @brief 查引脚网格：只检查场景坐标周围 3×3 个单元中的引脚。
+ * @details 命中范围与 ComponentItem::getPinAt 相同（以引脚为中心的 8×8 方框）；多个候选时取最近的一个。
+ */
+Pin* GraphicsScene::pinAt(const QPointF& scenePos) const
+{
+    const qint64 column = qFloor(scenePos.x() / kPinGridCell);
+    const qint64 row = qFloor(scenePos.y() / kPinGridCell);
+    Pin* best = nullptr;
+    qreal bestDistance = 0;
+    for (qint64 dx = -1; dx <= 1; ++dx) {
+        for (qint64 dy = -1; dy <= 1; ++dy) {
+            const auto bucket = m_pinGrid.constFind(pinGridKey(column + dx, row + dy));
+            if (bucket == m_pinGrid.constEnd()) continue;
+            for (Pin* pin : bucket.value()) {
+                const QPointF delta = pin->getScenePos() - scenePos;
+                if (qAbs(delta.x()) > kPinHitHalfSize || qAbs(delta.y()) > kPinHitHalfSize) continue;
+                const qreal distance = delta.manhattanLength();
+                if (!best || distance < bestDistance) {
+                    best = pin;
+                    bestDistance = distance;
+                }
+            }
+        }
+    }
+    return best;
+}
+
+/** 加入组件图形项并登记引脚 */
+void GraphicsScene::addComponentItem(ComponentItem* item)
+{
+    addItem(item);
+    for (Pin* pin : item->component()->inputPins()) indexPin(pin);
+    for (Pin* pin : item->component()->outputPins()) indexPin(pin);
+}
+
+/** 加入导线图形项，并挂到两端组件的导线列表上 */
+void GraphicsScene::addWireItem(WireItem* item)
+{
+    addItem(item);
+    item->updatePosition();
+    registerWireItem(item);
+}
+
+/** 登记导线图形项到两端组件的导线列表 */
+void GraphicsScene::registerWireItem(WireItem* item)
+{
+    Wire* wire = item->wireData();
+    m_wiresByComponent[wire->startPin()->owner()].append(item);
+    if (wire->endPin()->owner() != wire->startPin()->owner()) {
+        m_wiresByComponent[wire->endPin()->owner()].append(item);
+    }
+}
+
+/**
+ * @brief 开始批量插入：关闭场景的 BSP 索引，并为各索引预留容量。
+ * @details 索引开启时每次 addItem 与每次改变几何都要更新 BSP 树；关闭后插入只是追加，
+ * endBulkInsert() 恢复索引时 Qt 对全部图形项一次性建树，总代价与图形项数成线性。
+ */
+void GraphicsScene::beginBulkInsert(int componentCount)
+{
+    m_indexMethodBeforeBulk = itemIndexMethod();
+    setItemIndexMethod(NoIndex);
+    m_wiresByComponent.reserve(componentCount);
+    m_pinCells.reserve(componentCount * 3);
+    m_bulkPinPositions.reserve(componentCount * 3);
+    m_bulkInserting = true;
+}
+
+/**
+ * @brief 批量加入一个组件：图形项的位置就是组件位置（顶层项、无变换），
+ * 因此各引脚的场景坐标直接由局部布局平移得到，登记网格的同时记下供导线使用。
+ */
+void GraphicsScene::bulkAddComponent(Component* component)
+{
+    addItem(new ComponentItem(component));
+    const QPointF origin = component->position();
+    for (Pin* pin : component->inputPins()) {
+        const QPointF scenePos = origin + pinLocalPos(pin);
+        m_bulkPinPositions.insert(pin, scenePos);
+        indexPin(pin, scenePos);
+    }
+    for (Pin* pin : component->outputPins()) {
+        const QPointF scenePos = origin + pinLocalPos(pin);
+        m_bulkPinPositions.insert(pin, scenePos);
+        indexPin(pin, scenePos);
+    }
+}
+
+/** 批量加入一条导线：几何取自预先算好的引脚坐标，并在加入场景之前设置 */
+void GraphicsScene::bulkAddWire(Wire* wire)
+{
+    WireItem* item = new WireItem(wire);
+    const auto start = m_bulkPinPositions.constFind(wire->startPin());
+    const auto end = m_bulkPinPositions.constFind(wire->endPin());
+    const QPointF startPos = start != m_bulkPinPositions.constEnd() ? start.value() : wire->startPin()->getScenePos();
+    const QPointF endPos = end != m_bulkPinPositions.constEnd() ? end.value() : wire->endPin()->getScenePos();
+    item->setLine(QLineF(startPos, endPos));
+    addItem(item);
+    registerWireItem(item);
+}
+
+/** 结束批量插入：丢弃引脚坐标缓存并恢复场景索引（由 Qt 一次性重建） */
+void GraphicsScene::endBulkInsert()
+{
+    if (!m_bulkInserting) return;
+    m_bulkInserting = false;
+    m_bulkPinPositions.clear();
+    m_bulkPinPositions.squeeze();
+    setItemIndexMethod(m_indexMethodBeforeBulk);
+}
+
+/** 把导线图形项从组件的导线列表中摘除；列表空了就删掉该组件的条目 */
+void GraphicsScene::unlinkWireItem(Component* component, WireItem* item)
+{
+    auto attached = m_wiresByComponent.find(component);
+    if (attached == m_wiresByComponent.end()) return;
+    attached.value().removeOne(item);
+    if (attached.value().isEmpty()) m_wiresByComponent.erase(attached);
+}
+
+/** 删除一条导线：从两端组件的列表中摘除，再删除图形项与后台数据 */
+void GraphicsScene::removeWire(WireItem* item)
+{
+    Wire* wire = item->wireData();
+    unlinkWireItem(wire->startPin()->owner(), item);
+    unlinkWireItem(wire->endPin()->owner(), item);
+    m_oscillatingWires.remove(item);
+    removeItem(item);
+    delete item;
+    m_engine->deleteWire(wire);
+}
+
+/**
+ * @brief 删除组件及其所有导线。
+ * @details 相连的导线直接取自组件→导线索引；每条导线只需从另一端组件的列表中摘除，
+ * 后台导线由 Engine::deleteWires() 一次批量删除。代价只与该组件的导线数有关。
+ */
+void GraphicsScene::removeComponent(ComponentItem* item)
+{
+    Component* comp = item->component();
+    const QVector<WireItem*> attached = m_wiresByComponent.take(comp);
+    QVector<Wire*> wires;
+    wires.reserve(attached.size());
+    for (WireItem* wireItem : attached) {
+        Wire* wire = wireItem->wireData();
+        Component* other = wire->startPin()->owner() == comp ? wire->endPin()->owner() : wire->startPin()->owner();
+        if (other != comp) { unlinkWireItem(other, wireItem); }
+        m_oscillatingWires.remove(wireItem);
+        wires.append(wire);
+        removeItem(wireItem);
+        delete wireItem;
+    }
+    m_engine->deleteWires(wires);
+
+    for (Pin* pin : comp->inputPins()) unindexPin(pin);
+    for (Pin* pin : comp->outputPins()) unindexPin(pin);
+    m_oscillatingComponents.remove(item);
+    removeItem(item);
+    delete item;
+    m_engine->deleteComponent(comp);
+}
+
+/** 删除所有图形项并清空全部场景索引 */
+void GraphicsScene::clearScene()
+{
+    cancelRebuild(); // 剩余的时间片不能再为已清空的场景创建图形项
+    clear();
+    m_tempLine = nullptr;
+    m_wiresByComponent.clear();
+    m_pinGrid.clear();
+    m_pinCells.clear();
+    m_oscillatingComponents.clear();
+    m_oscillatingWires.clear();
+}
 
 /** 设置场景交互模式 */
 void GraphicsScene::setMode(Mode mode) {
@@ -253,6 +810,25 @@ void GraphicsScene::setComponentTypeToAdd(ComponentType type) {
     m_typeToAdd = type;
 }
 
+/** 双击时钟元件：设置它的周期（节拍数） */
+void GraphicsScene::mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event)
+{
+    ComponentItem* compItem = qgraphicsitem_cast<ComponentItem*>(itemAt(event->scenePos(), QTransform()));
+    if (event->button() != Qt::LeftButton || !compItem || compItem->component()->type() != ComponentType::Clock) {
+        QGraphicsScene::mouseDoubleClickEvent(event);
+        return;
+    }
+    Clock* clock = static_cast<Clock*>(compItem->component());
+    bool ok = false;
+    const int period = QInputDialog::getInt(nullptr, "时钟周期", "周期（节拍数，前半为低、后半为高）：",
+                                            clock->period(), Clock::kMinPeriod, 1000000, 1, &ok);
+    if (!ok) return;
+    waitForSimulation();
+    clock->setPeriod(period);
+    compItem->update();
+    requestSimulation();
+}
+
 /** 处理按下事件：右键删除、左键放置/连线 */
 void GraphicsScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
 {
@@ -262,51 +838,19 @@ void GraphicsScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
     if (event->button() == Qt::RightButton) {
         QGraphicsItem* itemToDelete = itemAt(event->scenePos(), QTransform());
         if (!itemToDelete) return; // 如果没有点中任何东西，直接返回
+        waitForSimulation(); // 删除前等待后台仿真结束
 
         // --- 情况一：删除导线 ---
         if (auto wireItem = qgraphicsitem_cast<WireItem*>(itemToDelete)) {
-            // 1. 命令引擎删除后台数据
-            m_engine->deleteWire(wireItem->wireData());
-            // 2. 从场景中删除前台图形
-            removeItem(wireItem);
-            delete wireItem;
+            removeWire(wireItem);
         }
         // --- 情况二：删除元件 (这会同时删除所有与之相连的导线) ---
         else if (auto compItem = qgraphicsitem_cast<ComponentItem*>(itemToDelete)) {
-            Component* compData = compItem->component();
-
-            // 1. 找出所有需要被删除的后台Wire数据
-            QVector<Wire*> wiresToRemove;
-            for (Wire* wire : m_engine->getAllWires()) {
-                if (wire->startPin()->owner() == compData || wire->endPin()->owner() == compData) {
-                    wiresToRemove.append(wire);
-                }
-            }
-
-            // 2. 遍历场景，删除这些Wire数据对应的前台WireItem图形
-            for (Wire* wireData : wiresToRemove) {
-                for (QGraphicsItem* item : items()) {
-                    if (auto wireItem = qgraphicsitem_cast<WireItem*>(item)) {
-                        if (wireItem->wireData() == wireData) {
-                            removeItem(wireItem);
-                            delete wireItem;
-                            break; // 找到了就跳出内层循环
-                        }
-                    }
-                }
-                // 命令引擎删除后台Wire数据
-                m_engine->deleteWire(wireData);
-            }
-
-            // 3. 最后，删除元件本身
-            m_engine->deleteComponent(compData);
-            removeItem(compItem);
-            delete compItem;
+            removeComponent(compItem);
         }
 
         // 删除后，立即重新模拟并刷新界面
-        m_engine->simulate();
-        update();
+        requestSimulation();
         return; // 右键事件处理完毕
     }
 
@@ -319,13 +863,14 @@ void GraphicsScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
     }
 
     if (m_currentMode == AddingComponent) {
+        waitForSimulation(); // 添加元件前等待后台仿真结束
         Component* data = nullptr;
 
         // --- 【核心修改】 ---
         if (m_typeToAdd == ComponentType::Encapsulated) {
             // 如果要添加的是封装元件，我们不能用引擎的工厂函数创建
-            // 而是直接使用我们存储的 JSON 数据来构造
-            data = new EncapsulatedComponent(event->scenePos(), m_nameToAdd, m_jsonToAdd);
+            // 而是直接使用元件库解析好的共享定义来构造
+            data = new EncapsulatedComponent(event->scenePos(), m_definitionToAdd);
 
             // 重要：因为我们绕过了引擎的创建函数，所以必须手动将这个新元件注册到引擎中
             // (下一步我们将为 Engine 添加这个 registerComponent 函数)
@@ -337,12 +882,11 @@ void GraphicsScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
         // --- 【修改结束】 ---
 
         if(data) {
-            addItem(new ComponentItem(data));
+            addComponentItem(new ComponentItem(data));
             emit componentAdded();
         }
         setMode(Idle);
-        m_engine->simulate();
-        update();
+        requestSimulation();
         return;
     }
 
@@ -350,35 +894,30 @@ void GraphicsScene::mousePressEvent(QGraphicsSceneMouseEvent *event)
     if (compItem) {
         QPointF localPos = compItem->mapFromScene(event->scenePos());
         if (compItem->component()->type() == ComponentType::Input && localPos.x() < 50) {
+            // 输入源只在准备阶段读取，运行中切换无需等待
             static_cast<Input*>(compItem->component())->toggleState();
-            m_engine->simulate();
-            update();
-            return;
-        }
-        m_startPin = compItem->getPinAt(localPos);
-        if (m_startPin) {
-            m_tempLine = new QGraphicsLineItem(QLineF(m_startPin->getScenePos(), event->scenePos()));
-            m_tempLine->setPen(QPen(Qt::gray, 2, Qt::DashLine));
-            addItem(m_tempLine);
+            compItem->update(); // 暂停时不会仿真，先把输入源自身的新状态画出来
+            requestSimulation();
             return;
         }
     }
+    m_startPin = pinAt(event->scenePos());
+    if (m_startPin) {
+        m_tempLine = new QGraphicsLineItem(QLineF(m_startPin->getScenePos(), event->scenePos()));
+        m_tempLine->setPen(QPen(Qt::gray, 2, Qt::DashLine));
+        addItem(m_tempLine);
+        return;
+    }
 
     QGraphicsScene::mousePressEvent(event);
 }
 
-/** 拖动事件：更新临时连线或刷新导线位置 */
+/** 拖动事件：更新临时连线，或交给基类移动元件（相连导线由 componentMoved 逐个更新） */
 void GraphicsScene::mouseMoveEvent(QGraphicsSceneMouseEvent *event) {
     if (m_tempLine) {
         m_tempLine->setLine(QLineF(m_tempLine->line().p1(), event->scenePos()));
     } else {
         QGraphicsScene::mouseMoveEvent(event);
-        // 全局更新所有导线
-        for(QGraphicsItem* item : items()){
-            if(auto wireItem = qgraphicsitem_cast<WireItem*>(item)){
-                wireItem->updatePosition();
-            }
-        }
     }
 }
 
@@ -389,28 +928,18 @@ void GraphicsScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event) {
         delete m_tempLine;
         m_tempLine = nullptr;
 
-        ComponentItem* endCompItem = qgraphicsitem_cast<ComponentItem*>(itemAt(event->scenePos(), QTransform()));
-
-        // 【核心修改】
-        // 旧逻辑: if (endCompItem) { ... }
-        // 新逻辑: 先判断是否点中了元件，再判断是否点中了引脚
-        if (endCompItem) {
-            Pin* endPin = endCompItem->getPinAt(endCompItem->mapFromScene(event->scenePos()));
-
-            // 只有当终点确实是一个有效的引脚时，才尝试创建导线
-            if (endPin) {
-                Wire* newWireData = m_engine->createWire(m_startPin, endPin);
-                if(newWireData){
-                    WireItem* wireItem = new WireItem(newWireData);
-                    addItem(wireItem);
-                    wireItem->updatePosition();
-                    m_engine->simulate();
-                    update();
-                }
+        // 终点必须确实落在某个引脚上（查引脚网格）；点在元件主体或空白处时静默失败
+        Pin* endPin = pinAt(event->scenePos());
+        if (endPin) {
+            waitForSimulation(); // 连线前等待后台仿真结束
+            Wire* newWireData = m_engine->createWire(m_startPin, endPin);
+            if(newWireData){
+                addWireItem(new WireItem(newWireData));
+                requestSimulation();
+            } else {
+                QMessageBox::warning(nullptr, "非法连接", m_engine->lastError());
             }
-            // 如果 endPin 是 nullptr (即点在了元件上但不是引脚)，则什么也不做，静默失败。
         }
-        // 如果 endCompItem 是 nullptr (即点在了空白处)，也什么都不做，静默失败。
 
         m_startPin = nullptr;
         return;
@@ -421,34 +950,88 @@ void GraphicsScene::mouseReleaseEvent(QGraphicsSceneMouseEvent *event) {
 /** 根据引擎当前数据重建整张画布（打开文件后使用） */
 void GraphicsScene::rebuildSceneFromEngine()
 {
-    // 1. 清空当前画布上所有的图形项
-    clear();
+    // 1. 清空当前画布上所有的图形项与场景索引
+    clearScene();
+    const QVector<Component*>& components = m_engine->getAllComponents();
+    const QVector<Wire*>& wires = m_engine->getAllWires();
+    beginBulkInsert(components.size());
 
     // 2. 遍历引擎后台的所有元件数据
-    for (Component* compData : m_engine->getAllComponents().values()) {
-        // 为每一个后台元件，创建一个新的前台图形项
-        ComponentItem* item = new ComponentItem(compData);
-        addItem(item);
+    for (Component* compData : components) {
+        // 为每一个后台元件，创建一个新的前台图形项（同时算出并登记引脚坐标）
+        bulkAddComponent(compData);
     }
 
     // 3. 遍历引擎后台的所有导线数据
-    for (Wire* wireData : m_engine->getAllWires()) {
-        // 为每一条后台导线，创建一个新的前台图形项
-        WireItem* item = new WireItem(wireData);
-        addItem(item);
-        item->updatePosition(); // 创建后立即更新一次位置
+    for (Wire* wireData : wires) {
+        // 为每一条后台导线，用已算好的引脚坐标创建前台图形项并登记索引
+        bulkAddWire(wireData);
     }
 
+    // 4. 恢复场景索引，一次性建树
+    endBulkInsert();
+
     // （可选）给出调试信息
     qDebug() << "前台画布：已根据引擎状态成功重建。";
 }
-/** 设置下一个封装元件的内部JSON */
-void GraphicsScene::setJsonForNextComponent(const QJsonObject& json)
+
+/** 分批重建：清空场景后由零间隔定时器逐片创建图形项 */
+void GraphicsScene::rebuildSceneFromEngineInSlices()
+{
+    clearScene();
+    beginBulkInsert(m_engine->getAllComponents().size());
+    m_rebuildNext = 0;
+    m_rebuilding = true;
+    m_rebuildTimer.start();
+}
+
+/** 中止分批重建 */
+void GraphicsScene::cancelRebuild()
+{
+    if (!m_rebuilding) return;
+    m_rebuilding = false;
+    m_rebuildTimer.stop();
+    endBulkInsert();
+    emit rebuildFinished(false);
+}
+
+/** @return 是否正在分批重建 */
+bool GraphicsScene::isRebuilding() const { return m_rebuilding; }
+
+/**
+ * @brief 一个时间片：按元件→导线的顺序创建图形项，每 kRebuildCheckInterval 项检查一次耗时。
+ * @details 导线的几何依赖两端元件的图形项，因此所有元件都先于导线创建。
+ */
+void GraphicsScene::continueRebuild()
 {
-    m_jsonToAdd = json;
+    if (!m_rebuilding) return;
+    const QVector<Component*>& components = m_engine->getAllComponents();
+    const QVector<Wire*>& wires = m_engine->getAllWires();
+    const int total = components.size() + wires.size();
+
+    QElapsedTimer slice;
+    slice.start();
+    while (m_rebuildNext < total) {
+        if (m_rebuildNext < components.size()) {
+            bulkAddComponent(components[m_rebuildNext]);
+        } else {
+            bulkAddWire(wires[m_rebuildNext - components.size()]);
+        }
+        ++m_rebuildNext;
+        if (m_rebuildNext % kRebuildCheckInterval == 0 && slice.elapsed() >= kRebuildSliceMs) break;
+    }
+
+    emit rebuildProgress(m_rebuildNext, total);
+    if (m_rebuildNext < total) {
+        m_rebuildTimer.start();
+        return;
+    }
+    m_rebuilding = false;
+    endBulkInsert();
+    emit rebuildFinished(true);
 }
-/** 设置下一个封装元件的名称 */
-void GraphicsScene::setNameForNextComponent(const QString& name)
+/** 设置下一个封装元件的共享定义 */
+void GraphicsScene::setDefinitionForNextComponent(const EncapsulatedDefinition* definition)
 {
-    m_nameToAdd = name;
+    m_definitionToAdd = definition;
 }
@@ -1,9 +1,11 @@
 #ifndef GRAPHICS_H
 #define GRAPHICS_H
-#include <QJsonObject>        // 封装元件添加时传递内部电路定义
 #include <QGraphicsScene>     // 自定义场景基类
 #include <QGraphicsItem>      // 自定义组件图形项基类
 #include <QGraphicsLineItem>  // 导线图形项
+#include <QFutureWatcher>     // 监视在线程池中运行的仿真
+#include <QSet>               // 时钟节拍积压的待重绘引脚
+#include <QTimer>             // 分批重建场景的时间片
 #include "engine.h"          // 后端数据结构与引擎接口
 
 /** 前向声明：避免不必要的头文件耦合 */
@@ -19,6 +21,10 @@ class WireItem;
  */
 class ComponentItem : public QGraphicsItem {
 public:
+    /** 图形项类型标识，使 qgraphicsitem_cast 能区分组件与导线 */
+    enum { Type = UserType + 1 };
+    /** 返回图形项类型 */
+    int type() const override { return Type; }
     /** 通过后端组件数据构造图形项，并建立绑定 */
     ComponentItem(Component* data);
     /** 包围盒，用于视图刷新/选择判定 */
@@ -29,12 +35,16 @@ public:
     Component* component() const;
     /** 根据局部坐标命中检测，返回被点中的引脚 */
     Pin* getPinAt(const QPointF& localPos);
+    /** 标记/取消标记为振荡环的一部分（以橙色虚线框标出） */
+    void setOscillating(bool oscillating);
 protected:
-    /** 捕获位置变化，将几何同步回后端数据层 */
+    /** 捕获位置变化：同步回后端数据层，并通知场景更新相连的导线 */
     QVariant itemChange(GraphicsItemChange change, const QVariant &value) override;
 private:
     /** 后端组件数据（非拥有） */
     Component* m_componentData;
+    /** 是否属于未收敛的振荡环 */
+    bool m_oscillating;
 };
 
 // =============================================================
@@ -45,6 +55,10 @@ private:
  */
 class WireItem : public QGraphicsLineItem {
 public:
+    /** 图形项类型标识（与拖拽连线时的临时虚线区分开） */
+    enum { Type = UserType + 2 };
+    /** 返回图形项类型 */
+    int type() const override { return Type; }
     /** 通过后端导线数据构造 */
     WireItem(Wire* data);
     /** 根据后端引脚的场景坐标更新自身几何 */
@@ -53,9 +67,13 @@ public:
     Wire* wireData() const;
     /** 自定义绘制：根据状态选择颜色 */
     void paint(QPainter *painter, const QStyleOptionGraphicsItem *option, QWidget *widget = nullptr) override;
+    /** 标记/取消标记为振荡环的一部分（以橙色加粗绘制） */
+    void setOscillating(bool oscillating);
 private:
     /** 后端导线数据（非拥有） */
     Wire* m_wireData;
+    /** 是否属于未收敛的振荡环 */
+    bool m_oscillating;
 };
 
 // =============================================================
@@ -71,6 +89,16 @@ public:
     enum Mode { Idle, AddingComponent };
     /** 根据引擎状态重建整张场景（打开文件后使用） */
     void rebuildSceneFromEngine();
+    /**
+     * @brief 分批重建场景：每批最多占用约 10 毫秒创建图形项，其余时间交还事件循环，界面在大电路加载时仍可响应。
+     * @details 先创建全部元件再创建导线；每批结束发出 rebuildProgress()，全部完成或被取消时发出 rebuildFinished()。
+     * 重建期间调用方应禁止编辑该场景（例如把视图设为不可交互）。
+     */
+    void rebuildSceneFromEngineInSlices();
+    /** 中止分批重建，已创建的图形项保留（清空画布或关闭标签页前必须调用） */
+    void cancelRebuild();
+    /** 是否正在分批重建 */
+    bool isRebuilding() const;
     /** 通过后端引擎构造场景 */
     GraphicsScene(Engine* engine, QObject* parent = nullptr);
 
@@ -82,21 +110,108 @@ public:
     /** 获取绑定的后端引擎 */
     Engine* getEngine() const;
 
-    /** 设置下一个封装元件所用的内部电路 JSON */
-    void setJsonForNextComponent(const QJsonObject& json);
-    /** 设置下一个封装元件的显示名称 */
-    void setNameForNextComponent(const QString& name);
+    /** 设置下一个封装元件所用的共享定义（由元件库解析，场景不再读取 JSON） */
+    void setDefinitionForNextComponent(const EncapsulatedDefinition* definition);
+
+    /**
+     * @brief 请求一次仿真：在线程池中运行，完成后在GUI线程提交结果并刷新。
+     * @details 已有仿真在运行时只做标记，等它完成后再补跑一次。
+     */
+    void requestSimulation();
+    /** 等待正在运行的仿真完成并提交结果（修改电路之前必须调用） */
+    void waitForSimulation();
+    /**
+     * @brief 暂停/恢复自动仿真：暂停时编辑与切换输入不再触发仿真，只有 stepSimulation() 推进电路。
+     * @details 恢复时立即请求一次仿真，让电路回到稳定状态。
+     */
+    void setPaused(bool paused);
+    /** 是否处于暂停（单步）状态 */
+    bool isPaused() const;
+    /**
+     * @brief 同步推进 ticks 个单位延迟节拍并重绘变化的部分。
+     * @return 最后一拍是否已无变化（电路已稳定）
+     */
+    bool stepSimulation(int ticks = 1);
+
+    /** 删除所有图形项并清空场景索引（代替 QGraphicsScene::clear()） */
+    void clearScene();
+    /**
+     * @brief 返回场景坐标处的引脚（查引脚网格，只检查附近的网格单元）。
+     * @return 不在任何引脚的可点击范围内时返回 nullptr
+     */
+    Pin* pinAt(const QPointF& scenePos) const;
+    /** 组件图形项移动后更新相连导线的几何与其引脚在网格中的位置（由 ComponentItem::itemChange 调用） */
+    void componentMoved(ComponentItem* item);
+    /** 同步运行 count 个时钟节拍（推进时钟并仿真），变化的引脚累积到下一次 flushPendingRepaint()；暂停时忽略 */
+    void runClockTicks(int count);
+    /** 重绘时钟节拍积压的变化引脚（时钟调度器按屏幕刷新率调用） */
+    void flushPendingRepaint();
 signals:
     /** 当一个组件被放置到场景中时发出 */
     void componentAdded();
+    /** 分批重建的进度：已创建的图形项数与总数（元件 + 导线） */
+    void rebuildProgress(int created, int total);
+    /** 分批重建结束：completed 为 false 表示被取消 */
+    void rebuildFinished(bool completed);
+    /**
+     * @brief 自动仿真在迭代上限内未收敛，振荡环已在画布上标出。
+     * @param pinCount 仍在翻转的引脚数
+     * @param cyclePeriod 振荡周期（节拍数），未检测到时为 0
+     * @param iterations 本次仿真的迭代轮数
+     */
+    void oscillationDetected(int pinCount, int cyclePeriod, int iterations);
 protected:
     /** 处理放置组件、开始连线、右键删除等按下事件 */
     void mousePressEvent(QGraphicsSceneMouseEvent *event) override;
-    /** 处理临时连线拖拽与导线位置更新 */
+    /** 处理临时连线拖拽；元件拖动交给基类 */
     void mouseMoveEvent(QGraphicsSceneMouseEvent *event) override;
     /** 处理完成连线或清理临时连线 */
     void mouseReleaseEvent(QGraphicsSceneMouseEvent *event) override;
+    /** 双击时钟元件时设置其周期 */
+    void mouseDoubleClickEvent(QGraphicsSceneMouseEvent *event) override;
+    /** 缩小到简化绘制级别时，经场景索引取出可见导线，在元件下方按状态颜色批量绘制 */
+    void drawBackground(QPainter* painter, const QRectF& rect) override;
+private slots:
+    /** 工作线程中的仿真结束：提交引脚状态并刷新，必要时补跑 */
+    void onSimulationFinished();
+    /** 分批重建的一个时间片 */
+    void continueRebuild();
 private:
+    /** 加入一个组件图形项并登记它的引脚 */
+    void addComponentItem(ComponentItem* item);
+    /** 加入一个导线图形项并登记到两端组件的导线索引 */
+    void addWireItem(WireItem* item);
+    /** 把已在场景中的导线图形项登记到导线索引 */
+    void registerWireItem(WireItem* item);
+    /** 开始批量插入：关闭 BSP 索引并预留各索引的容量 */
+    void beginBulkInsert(int componentCount);
+    /** 批量插入一个组件：一次算出它所有引脚的场景坐标 */
+    void bulkAddComponent(Component* component);
+    /** 批量插入一条导线：使用预先算好的引脚坐标 */
+    void bulkAddWire(Wire* wire);
+    /** 结束批量插入：恢复 BSP 索引（一次性建树） */
+    void endBulkInsert();
+    /** 只重绘上一次提交中引脚状态变化的元件及其输出导线（而非整个场景） */
+    void repaintChangedPins();
+    /** 重绘给定引脚所属的元件及从其中输出引脚出发的导线 */
+    void repaintPins(const QVector<Pin*>& pins);
+    /** 删除导线：移除图形项、索引与后台数据 */
+    void removeWire(WireItem* item);
+    /** 删除组件及其所有导线：按组件→导线索引直接找到它们，不扫描整个场景 */
+    void removeComponent(ComponentItem* item);
+    /** 把引脚按当前场景坐标登记到网格 */
+    void indexPin(Pin* pin);
+    /** 把引脚按给定的场景坐标登记到网格 */
+    void indexPin(Pin* pin, const QPointF& scenePos);
+    /** 把引脚从网格中移除 */
+    void unindexPin(Pin* pin);
+    /** 把导线图形项从组件的导线列表中摘除（列表空了就删除条目） */
+    void unlinkWireItem(Component* component, WireItem* item);
+    /** 按上一次提交的收敛诊断更新振荡高亮（自动仿真与时钟节拍提交后调用） */
+    void updateOscillationHighlight();
+    /** 取消所有振荡高亮 */
+    void clearOscillationHighlight();
+
     /** 绑定的后端引擎（非拥有） */
     Engine* m_engine;
     /** 临时绘制的虚线用于拖拽连线 */
@@ -110,12 +225,47 @@ private:
     /** 待添加的组件类型 */
     ComponentType m_typeToAdd;
 
-    // 【新增】用于临时存储下一个要创建的封装元件的 JSON 定义
-    /** 待添加封装元件的内部电路 JSON */
-    QJsonObject m_jsonToAdd;
+    /** 待添加封装元件的共享定义（非拥有，由定义注册表持有） */
+    const EncapsulatedDefinition* m_definitionToAdd;
+
+    /** 监视当前在线程池中运行的仿真 */
+    QFutureWatcher<void> m_simulationWatcher;
+    /** 是否有已准备、尚未提交的仿真 */
+    bool m_simulationRunning;
+    /** 运行期间是否又收到了仿真请求 */
+    bool m_simulationPending;
+    /** 是否暂停自动仿真（单步模式） */
+    bool m_paused;
+
+    /** 时钟节拍中状态变化、尚未重绘的引脚 */
+    QSet<Pin*> m_pendingRepaint;
+    /** 简化绘制时按状态分组的导线线段（成员复用容量，避免每帧分配） */
+    QVector<QLineF> m_lowDetailHigh;
+    QVector<QLineF> m_lowDetailLow;
+
+    /** 驱动分批重建的零间隔单次定时器 */
+    QTimer m_rebuildTimer;
+    /** 下一个要创建的图形项：先是元件下标，之后是导线下标加元件数 */
+    int m_rebuildNext;
+    /** 是否正在分批重建 */
+    bool m_rebuilding;
+    /** 是否处于批量插入（BSP 索引已关闭） */
+    bool m_bulkInserting;
+    /** 批量插入前的场景索引方式 */
+    ItemIndexMethod m_indexMethodBeforeBulk;
+    /** 批量插入期间各引脚的场景坐标（组件加入时算出，供导线直接取用） */
+    QHash<const Pin*, QPointF> m_bulkPinPositions;
 
-    /** 待添加封装元件的名称 */
-    QString m_nameToAdd;
+    // --- 场景索引：让命中检测与删除只触及相关的图形项 ---
+    /** 组件 → 与之相连的导线图形项 */
+    QHash<Component*, QVector<WireItem*>> m_wiresByComponent;
+    /** 引脚网格：网格单元键 → 位于该单元内的引脚 */
+    QHash<quint64, QVector<Pin*>> m_pinGrid;
+    /** 引脚当前所在的网格单元键（移动/删除时据此从旧单元移除） */
+    QHash<Pin*, quint64> m_pinCells;
+    /** 当前标为振荡的元件与导线图形项（删除图形项时同步移除） */
+    QSet<ComponentItem*> m_oscillatingComponents;
+    QSet<WireItem*> m_oscillatingWires;
 };
 inline Engine* GraphicsScene::getEngine() const {
         return m_engine;
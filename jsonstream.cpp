@@ -0,0 +1,494 @@
+#include "jsonstream.h"
+
+#include <QIODevice>    // 按块读写的数据来源/去处
+#include <QJsonArray>   // readValue 物化数组
+#include <QJsonObject>  // readValue 物化对象
+#include <QLocale>      // 浮点数的最短往返格式
+
+/** 每次从设备读取/向设备写入的块大小 */
+static const qint64 kStreamChunkSize = 64 * 1024;
+/** 物化子树时允许的最大嵌套深度（防止恶意文件耗尽栈） */
+static const int kMaxReadDepth = 512;
+
+// ===============================================
+// === JsonStreamReader
+// ===============================================
+
+JsonStreamReader::JsonStreamReader(QIODevice* device) : m_device(device) {}
+
+/**
+ * @brief 保证缓冲区中还有未读字节；已消费的部分随之丢弃。
+ * @return 设备已读完时返回 false
+ */
+bool JsonStreamReader::fill()
+{
+    if (m_pos < m_buffer.size()) return true;
+    m_consumedBefore += m_buffer.size();
+    m_buffer.resize(kStreamChunkSize);
+    const qint64 read = m_device ? m_device->read(m_buffer.data(), kStreamChunkSize) : -1;
+    m_buffer.resize(read > 0 ? int(read) : 0);
+    m_pos = 0;
+    return read > 0;
+}
+
+/** 跳过空白，返回下一个字节（不消费），到达末尾返回 -1 */
+int JsonStreamReader::peekNonSpace()
+{
+    while (fill()) {
+        const char ch = m_buffer[m_pos];
+        if (ch != ' ' && ch != '\t' && ch != '\n' && ch != '\r') return uchar(ch);
+        ++m_pos;
+    }
+    return -1;
+}
+
+/** 记录第一个错误（带字节位置），此后读取器停在 Invalid */
+JsonStreamReader::Token JsonStreamReader::fail(const QString& reason)
+{
+    if (m_error.isEmpty()) {
+        m_error = QString("JSON 第 %1 字节处：%2").arg(bytesConsumed()).arg(reason);
+    }
+    return Invalid;
+}
+
+/** 一个值（标量或闭合的对象/数组）结束：顶层结束则等待文档末尾，否则等待逗号或闭合符 */
+void JsonStreamReader::finishValue()
+{
+    m_expect = m_stack.isEmpty() ? ExpectDone : ExpectCommaOrEnd;
+}
+
+/**
+ * @brief 读取下一个记号。
+ * @details 按 m_expect 状态机校验逗号、冒号与括号配对；出错后一直返回 Invalid。
+ */
+JsonStreamReader::Token JsonStreamReader::readNext()
+{
+    if (hasError()) return Invalid;
+    int ch = peekNonSpace();
+
+    // --- 1. 处理值之间的逗号与闭合符 ---
+    if (m_expect == ExpectDone) {
+        return ch < 0 ? EndOfDocument : fail("顶层值之后还有多余内容");
+    }
+    if (m_expect == ExpectCommaOrEnd) {
+        if (ch == ',') {
+            ++m_pos;
+            m_expect = m_stack.last() == '{' ? ExpectKey : ExpectValue;
+            ch = peekNonSpace();
+        } else if (ch != '}' && ch != ']') {
+            return fail("缺少逗号或闭合括号");
+        }
+    }
+    if (ch < 0) return fail("文件意外结束");
+
+    if (ch == '}' || ch == ']') {
+        const bool closesObject = ch == '}';
+        const bool allowed = closesObject ? (m_expect == ExpectKeyOrEnd || m_expect == ExpectCommaOrEnd)
+                                          : (m_expect == ExpectValueOrEnd || m_expect == ExpectCommaOrEnd);
+        if (!allowed || m_stack.isEmpty() || m_stack.last() != (closesObject ? '{' : '[')) {
+            return fail("括号不匹配");
+        }
+        ++m_pos;
+        m_stack.removeLast();
+        finishValue();
+        return closesObject ? EndObject : EndArray;
+    }
+
+    // --- 2. 对象中的键 ---
+    if (m_expect == ExpectKey || m_expect == ExpectKeyOrEnd) {
+        if (ch != '"') return fail("需要一个字符串键");
+        ++m_pos;
+        if (!readString(m_key)) return Invalid;
+        if (peekNonSpace() != ':') return fail("键之后缺少冒号");
+        ++m_pos;
+        m_expect = ExpectValue;
+        return Key;
+    }
+
+    // --- 3. 值 ---
+    if (ch == '{' || ch == '[') {
+        ++m_pos;
+        m_stack.append(char(ch));
+        m_expect = ch == '{' ? ExpectKeyOrEnd : ExpectValueOrEnd;
+        return ch == '{' ? BeginObject : BeginArray;
+    }
+    if (ch == '"') {
+        ++m_pos;
+        QString text;
+        if (!readString(text)) return Invalid;
+        m_scalar = text;
+    } else if (!readLiteral(m_scalar)) {
+        return Invalid;
+    }
+    finishValue();
+    return Scalar;
+}
+
+/** 把一个 Unicode 码点按 UTF-8 追加到 out */
+static void appendUtf8(QByteArray& out, uint codePoint)
+{
+    if (codePoint < 0x80) {
+        out.append(char(codePoint));
+    } else if (codePoint < 0x800) {
+        out.append(char(0xC0 | (codePoint >> 6)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    } else if (codePoint < 0x10000) {
+        out.append(char(0xE0 | (codePoint >> 12)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    } else {
+        out.append(char(0xF0 | (codePoint >> 18)));
+        out.append(char(0x80 | ((codePoint >> 12) & 0x3F)));
+        out.append(char(0x80 | ((codePoint >> 6) & 0x3F)));
+        out.append(char(0x80 | (codePoint & 0x3F)));
+    }
+}
+
+/**
+ * @brief 读取字符串内容直到结束引号，处理全部转义（含 \\uXXXX 代理对）。
+ * @details 字符串可以跨越读缓冲区边界；未转义的字节原样按 UTF-8 收集。
+ */
+bool JsonStreamReader::readString(QString& result)
+{
+    QByteArray utf8;
+    auto readHex4 = [this](uint& value) {
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (!fill()) return false;
+            const char hex = m_buffer[m_pos++];
+            value <<= 4;
+            if (hex >= '0' && hex <= '9') value |= uint(hex - '0');
+            else if (hex >= 'a' && hex <= 'f') value |= uint(hex - 'a' + 10);
+            else if (hex >= 'A' && hex <= 'F') value |= uint(hex - 'A' + 10);
+            else return false;
+        }
+        return true;
+    };
+
+    while (true) {
+        if (!fill()) { fail("字符串没有结束"); return false; }
+        // 快速路径：整段复制到下一个引号或反斜杠为止
+        const char* begin = m_buffer.constData() + m_pos;
+        const char* end = m_buffer.constData() + m_buffer.size();
+        const char* stop = begin;
+        while (stop < end && *stop != '"' && *stop != '\\' && uchar(*stop) >= 0x20) ++stop;
+        utf8.append(begin, int(stop - begin));
+        m_pos += stop - begin;
+        if (stop == end) continue;
+
+        const char ch = m_buffer[m_pos++];
+        if (ch == '"') break;
+        if (ch != '\\') { fail("字符串中含有未转义的控制字符"); return false; }
+        if (!fill()) { fail("字符串没有结束"); return false; }
+        const char escape = m_buffer[m_pos++];
+        switch (escape) {
+        case '"': utf8.append('"'); break;
+        case '\\': utf8.append('\\'); break;
+        case '/': utf8.append('/'); break;
+        case 'b': utf8.append('\b'); break;
+        case 'f': utf8.append('\f'); break;
+        case 'n': utf8.append('\n'); break;
+        case 'r': utf8.append('\r'); break;
+        case 't': utf8.append('\t'); break;
+        case 'u': {
+            uint codePoint = 0;
+            if (!readHex4(codePoint)) { fail("无效的 \\u 转义"); return false; }
+            // 高代理项后面必须紧跟一个 \uXXXX 低代理项
+            if (codePoint >= 0xD800 && codePoint < 0xDC00) {
+                uint low = 0;
+                if (!fill() || m_buffer[m_pos] != '\\') { fail("不完整的代理对"); return false; }
+                ++m_pos;
+                if (!fill() || m_buffer[m_pos] != 'u') { fail("不完整的代理对"); return false; }
+                ++m_pos;
+                if (!readHex4(low) || low < 0xDC00 || low >= 0xE000) { fail("不完整的代理对"); return false; }
+                codePoint = 0x10000 + ((codePoint - 0xD800) << 10) + (low - 0xDC00);
+            }
+            appendUtf8(utf8, codePoint);
+            break;
+        }
+        default:
+            fail("未知的转义字符");
+            return false;
+        }
+    }
+    result = QString::fromUtf8(utf8);
+    return true;
+}
+
+/**
+ * @brief 读取裸字面量：true/false/null 或数字。
+ * @details 不含小数点与指数、且在 qint64 范围内的数字保存为整数，其余保存为 double（与 QJsonDocument 一致）。
+ */
+bool JsonStreamReader::readLiteral(QJsonValue& result)
+{
+    QByteArray token;
+    while (fill()) {
+        const char ch = m_buffer[m_pos];
+        const bool partOfToken = (ch >= '0' && ch <= '9') || (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z')
+                                 || ch == '-' || ch == '+' || ch == '.';
+        if (!partOfToken) break;
+        token.append(ch);
+        ++m_pos;
+        if (token.size() > 64) break;
+    }
+
+    if (token == "true") { result = true; return true; }
+    if (token == "false") { result = false; return true; }
+    if (token == "null") { result = QJsonValue(); return true; }
+
+    // JSON 数字：-?(0|[1-9][0-9]*)(\.[0-9]+)?([eE][+-]?[0-9]+)?
+    int i = 0;
+    bool isInteger = true;
+    auto digits = [&]() { const int start = i; while (i < token.size() && token[i] >= '0' && token[i] <= '9') ++i; return i > start; };
+    if (i < token.size() && token[i] == '-') ++i;
+    const int intStart = i;
+    if (!digits() || (token[intStart] == '0' && i - intStart > 1)) { fail("无效的字面量"); return false; }
+    if (i < token.size() && token[i] == '.') {
+        ++i; isInteger = false;
+        if (!digits()) { fail("无效的数字"); return false; }
+    }
+    if (i < token.size() && (token[i] == 'e' || token[i] == 'E')) {
+        ++i; isInteger = false;
+        if (i < token.size() && (token[i] == '+' || token[i] == '-')) ++i;
+        if (!digits()) { fail("无效的数字"); return false; }
+    }
+    if (i != token.size()) { fail("无效的数字"); return false; }
+
+    bool ok = false;
+    if (isInteger) {
+        const qint64 integer = token.toLongLong(&ok);
+        if (ok) { result = QJsonValue(integer); return true; }
+    }
+    const double number = token.toDouble(&ok);
+    if (!ok) { fail("无效的数字"); return false; }
+    result = number;
+    return true;
+}
+
+/**
+ * @brief 把以 first 开头的值读成 QJsonValue。
+ * @details 用显式栈代替递归，嵌套超过 kMaxReadDepth 视为错误。
+ */
+QJsonValue JsonStreamReader::readValue(Token first, bool* ok)
+{
+    if (ok) *ok = false;
+    if (first == Scalar) {
+        if (ok) *ok = true;
+        return m_scalar;
+    }
+    if (first != BeginObject && first != BeginArray) {
+        fail("需要一个值");
+        return QJsonValue();
+    }
+
+    // 每层保存正在构造的容器和（对象层）等待赋值的键
+    struct Frame { bool isObject; QJsonObject object; QJsonArray array; QString pendingKey; };
+    QVector<Frame> frames;
+    frames.append(Frame{first == BeginObject, {}, {}, {}});
+    QJsonValue finished;
+    bool haveFinished = false;
+
+    while (!frames.isEmpty()) {
+        const Token token = readNext();
+        if (token == Key) {
+            frames.last().pendingKey = m_key;
+            continue;
+        }
+        if (token == BeginObject || token == BeginArray) {
+            if (frames.size() >= kMaxReadDepth) { fail("嵌套层次过深"); return QJsonValue(); }
+            frames.append(Frame{token == BeginObject, {}, {}, {}});
+            continue;
+        }
+        if (token == EndObject || token == EndArray) {
+            Frame done = frames.takeLast();
+            finished = done.isObject ? QJsonValue(done.object) : QJsonValue(done.array);
+            haveFinished = true;
+        } else if (token == Scalar) {
+            finished = m_scalar;
+            haveFinished = true;
+        } else {
+            fail("值没有结束");
+            return QJsonValue();
+        }
+        if (haveFinished && !frames.isEmpty()) {
+            Frame& parent = frames.last();
+            if (parent.isObject) { parent.object.insert(parent.pendingKey, finished); }
+            else { parent.array.append(finished); }
+            haveFinished = false;
+        }
+    }
+    if (ok) *ok = true;
+    return finished;
+}
+
+/** 跳过以 first 开头的值：只数括号层次，不构造任何对象 */
+bool JsonStreamReader::skipValue(Token first)
+{
+    if (first == Scalar) return true;
+    if (first != BeginObject && first != BeginArray) return false;
+    int depth = 1;
+    while (depth > 0) {
+        const Token token = readNext();
+        if (token == BeginObject || token == BeginArray) ++depth;
+        else if (token == EndObject || token == EndArray) --depth;
+        else if (token == Invalid || token == EndOfDocument) return false;
+    }
+    return true;
+}
+
+// ===============================================
+// === JsonStreamWriter
+// ===============================================
+
+JsonStreamWriter::JsonStreamWriter(QIODevice* device) : m_device(device) {}
+
+JsonStreamWriter::~JsonStreamWriter() { flush(); }
+
+/** 写出缓冲区中的内容 */
+bool JsonStreamWriter::flush()
+{
+    if (!m_buffer.isEmpty()) {
+        if (!m_device || m_device->write(m_buffer) != m_buffer.size()) { m_ok = false; }
+        m_buffer.clear();
+    }
+    return m_ok;
+}
+
+/** 换行并缩进到当前层次 */
+void JsonStreamWriter::newline()
+{
+    m_buffer.append('\n');
+    m_buffer.append(QByteArray(4 * m_hasItems.size(), ' '));
+    if (m_buffer.size() >= kStreamChunkSize) { flush(); }
+}
+
+/** 值之前：键之后直接接值；数组元素前补逗号并换行 */
+void JsonStreamWriter::prepareValue()
+{
+    if (m_afterKey) {
+        m_afterKey = false;
+        return;
+    }
+    if (!m_hasItems.isEmpty()) {
+        if (m_hasItems.last()) m_buffer.append(',');
+        m_hasItems.last() = true;
+        newline();
+    }
+}
+
+void JsonStreamWriter::beginObject()
+{
+    prepareValue();
+    m_buffer.append('{');
+    m_hasItems.append(false);
+}
+
+void JsonStreamWriter::endObject()
+{
+    m_hasItems.removeLast();
+    newline();
+    m_buffer.append('}');
+    if (m_hasItems.isEmpty()) { m_buffer.append('\n'); }
+}
+
+void JsonStreamWriter::beginArray()
+{
+    prepareValue();
+    m_buffer.append('[');
+    m_hasItems.append(false);
+}
+
+void JsonStreamWriter::endArray()
+{
+    m_hasItems.removeLast();
+    newline();
+    m_buffer.append(']');
+    if (m_hasItems.isEmpty()) { m_buffer.append('\n'); }
+}
+
+void JsonStreamWriter::writeKey(const QString& key)
+{
+    if (m_hasItems.last()) m_buffer.append(',');
+    m_hasItems.last() = true;
+    newline();
+    writeString(key);
+    m_buffer.append(": ");
+    m_afterKey = true;
+}
+
+/** 写出带转义的字符串：引号、反斜杠与控制字符转义，其余字符按 UTF-8 原样写出 */
+void JsonStreamWriter::writeString(const QString& text)
+{
+    static const char hexDigits[] = "0123456789abcdef";
+    const QByteArray utf8 = text.toUtf8();
+    m_buffer.append('"');
+    for (char ch : utf8) {
+        switch (ch) {
+        case '"': m_buffer.append("\\\""); break;
+        case '\\': m_buffer.append("\\\\"); break;
+        case '\b': m_buffer.append("\\b"); break;
+        case '\f': m_buffer.append("\\f"); break;
+        case '\n': m_buffer.append("\\n"); break;
+        case '\r': m_buffer.append("\\r"); break;
+        case '\t': m_buffer.append("\\t"); break;
+        default:
+            if (uchar(ch) < 0x20) {
+                m_buffer.append("\\u00");
+                m_buffer.append(hexDigits[uchar(ch) >> 4]);
+                m_buffer.append(hexDigits[uchar(ch) & 0xF]);
+            } else {
+                m_buffer.append(ch);
+            }
+        }
+    }
+    m_buffer.append('"');
+}
+
+/**
+ * @brief 写出一个完整的值。
+ * @details 整数值的 double 按整数写出；其余浮点数用最短往返格式，与 QJsonDocument 输出一致。
+ */
+void JsonStreamWriter::writeValue(const QJsonValue& value)
+{
+    switch (value.type()) {
+    case QJsonValue::Object: {
+        const QJsonObject object = value.toObject();
+        beginObject();
+        for (auto it = object.constBegin(); it != object.constEnd(); ++it) {
+            writeKey(it.key());
+            writeValue(it.value());
+        }
+        endObject();
+        return;
+    }
+    case QJsonValue::Array: {
+        const QJsonArray array = value.toArray();
+        beginArray();
+        for (const QJsonValue& element : array) { writeValue(element); }
+        endArray();
+        return;
+    }
+    default:
+        break;
+    }
+
+    prepareValue();
+    switch (value.type()) {
+    case QJsonValue::Bool:
+        m_buffer.append(value.toBool() ? "true" : "false");
+        break;
+    case QJsonValue::Double: {
+        const double number = value.toDouble();
+        const qint64 integer = value.toInteger();
+        if (double(integer) == number) { m_buffer.append(QByteArray::number(integer)); }
+        else { m_buffer.append(QByteArray::number(number, 'g', QLocale::FloatingPointShortest)); }
+        break;
+    }
+    case QJsonValue::String:
+        writeString(value.toString());
+        break;
+    default:
+        m_buffer.append("null");
+        break;
+    }
+}
@@ -0,0 +1,134 @@
+#ifndef JSONSTREAM_H
+#define JSONSTREAM_H
+#include <QByteArray>   // 读写缓冲区
+#include <QJsonValue>   // 标量值与按需物化的子树
+#include <QString>      // 键名与错误信息
+#include <QVector>      // 嵌套层次栈
+
+class QIODevice;
+
+/**
+ * @file jsonstream.h
+ * @brief 流式（SAX 风格）JSON 读写器：不必把整个文档读入内存、也不必先建好整棵 QJsonObject 树。
+ * @details Engine 用它边解析边创建组件和导线，峰值内存只比最终网表多出一个读缓冲区；
+ * 保存时按“定义 → 组件 → 导线”的顺序直接写出，加载时定义总是先于引用它的组件到达。
+ */
+
+/**
+ * @brief 拉取式 JSON 读取器：每次 readNext() 返回一个记号。
+ * @details 设备按块读取（64 KiB），只在缓冲区里保留尚未消费的数据。
+ * 对于单个元件、导线这类小对象，可以用 readValue() 把它物化为 QJsonValue 后照常处理。
+ */
+class JsonStreamReader {
+public:
+    /** 记号类型 */
+    enum Token {
+        Invalid,        // 语法错误或读取失败，原因见 errorString()
+        BeginObject,    // {
+        EndObject,      // }
+        BeginArray,     // [
+        EndArray,       // ]
+        Key,            // 对象中的键，键名见 key()
+        Scalar,         // 字符串、数字、布尔或 null，值见 scalar()
+        EndOfDocument   // 顶层值已完整读完
+    };
+
+    /** @param device 已以只读方式打开的设备（不持有） */
+    explicit JsonStreamReader(QIODevice* device);
+
+    /** 读取下一个记号 */
+    Token readNext();
+    /** 最近一个 Key 记号的键名 */
+    const QString& key() const { return m_key; }
+    /** 最近一个 Scalar 记号的值 */
+    const QJsonValue& scalar() const { return m_scalar; }
+
+    /**
+     * @brief 把以 first 开头的整个值读成 QJsonValue（对象/数组会递归物化）。
+     * @param first 刚由 readNext() 得到的值起始记号（BeginObject/BeginArray/Scalar）
+     * @param ok [out] 出错时置为 false
+     */
+    QJsonValue readValue(Token first, bool* ok = nullptr);
+    /** 跳过以 first 开头的整个值，不做物化；成功返回 true */
+    bool skipValue(Token first);
+
+    /** 是否已出错 */
+    bool hasError() const { return !m_error.isEmpty(); }
+    /** 错误描述（含出错位置） */
+    const QString& errorString() const { return m_error; }
+    /** 已从设备读入并消费的字节数（用于进度显示） */
+    qint64 bytesConsumed() const { return m_consumedBefore + m_pos; }
+
+private:
+    /** 读取器接下来期望看到的内容 */
+    enum Expect { ExpectValue, ExpectKeyOrEnd, ExpectKey, ExpectValueOrEnd, ExpectCommaOrEnd, ExpectDone };
+
+    /** 保证缓冲区中至少还有一个未读字节；到达设备末尾时返回 false */
+    bool fill();
+    /** 跳过空白后查看下一个字节，末尾返回 -1 */
+    int peekNonSpace();
+    /** 读取一个字符串（已消费开头的引号） */
+    bool readString(QString& result);
+    /** 读取数字、true/false/null 等裸字面量 */
+    bool readLiteral(QJsonValue& result);
+    /** 一个值结束后更新期望状态 */
+    void finishValue();
+    /** 记录错误并返回 Invalid */
+    Token fail(const QString& reason);
+
+    QIODevice* m_device;          // 数据来源
+    QByteArray m_buffer;          // 当前读缓冲区
+    qint64 m_pos = 0;             // 缓冲区内的读取位置
+    qint64 m_consumedBefore = 0;  // 之前各缓冲区已消费的字节数
+    QVector<char> m_stack;        // 嵌套层次：'{' 或 '['
+    Expect m_expect = ExpectValue;
+    QString m_key;
+    QJsonValue m_scalar;
+    QString m_error;
+};
+
+/**
+ * @brief 流式 JSON 写出器：逐个写出键和值，按块写入设备。
+ * @details 输出格式与 QJsonDocument::Indented 一致（4 空格缩进），因此与旧存档的差异只在键的顺序上。
+ */
+class JsonStreamWriter {
+public:
+    /** @param device 已以只写方式打开的设备（不持有） */
+    explicit JsonStreamWriter(QIODevice* device);
+    /** 析构时写出缓冲区中剩余的内容 */
+    ~JsonStreamWriter();
+
+    /** 开始一个对象（作为数组元素、键的值或顶层值） */
+    void beginObject();
+    /** 结束当前对象 */
+    void endObject();
+    /** 开始一个数组 */
+    void beginArray();
+    /** 结束当前数组 */
+    void endArray();
+    /** 在当前对象中写出一个键，随后必须写出它的值 */
+    void writeKey(const QString& key);
+    /** 写出一个完整的值（对象/数组会递归写出） */
+    void writeValue(const QJsonValue& value);
+
+    /** 把缓冲区写入设备；设备写入失败时返回 false */
+    bool flush();
+    /** 迄今为止是否所有写入都成功 */
+    bool ok() const { return m_ok; }
+
+private:
+    /** 在值之前写出逗号、换行与缩进 */
+    void prepareValue();
+    /** 写出带转义的字符串 */
+    void writeString(const QString& text);
+    /** 换行并按层次缩进 */
+    void newline();
+
+    QIODevice* m_device;
+    QByteArray m_buffer;
+    QVector<bool> m_hasItems;     // 每层是否已写出过元素（决定是否需要逗号）
+    bool m_afterKey = false;      // 刚写完键，值紧跟在 ": " 之后
+    bool m_ok = true;
+};
+
+#endif // JSONSTREAM_H
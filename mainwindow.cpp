@@ -1,6 +1,10 @@
 #include "mainwindow.h"     // 主窗口声明
 #include "engine.h"         // 使用 Engine 接口
 #include "graphics.h"       // 使用 GraphicsScene/Item
+#include "clockscheduler.h" // 时钟节拍调度
+#include "waveform.h"       // 波形录制与 VCD 导出
+#include "componentlibrary.h" // 带索引缓存的自定义元件库
+#include "circuitloader.h"  // 后台打开电路文件
 #include "ui_mainwindow.h"  // Qt Designer 生成的UI类
 #include <QActionGroup>       // 互斥动作组
 #include <QMessageBox>        // 弹窗提示
@@ -16,6 +20,12 @@
 #include <QDir>               // 目录访问
 #include <QToolBar>           // 工具栏
 #include <QMenu>              // 右键菜单
+#include <QProgressDialog>    // 打开文件的进度与取消
+
+/** 打开文件进度条的刻度数 */
+static const int kOpenProgressSteps = 1000;
+/** 打开文件超过这么久（毫秒）才弹出进度对话框 */
+static const int kOpenProgressDelayMs = 300;
 /**
  * @file mainwindow.cpp
  * @brief 主窗口实现：多标签页管理、文件读写、自定义元件封装与加载。
@@ -55,9 +65,23 @@ MainWindow::MainWindow(QWidget *parent)
     m_addComponentActionGroup->addAction(ui->actionAdd_NorGate);
     m_addComponentActionGroup->addAction(ui->actionAdd_XorGate);
     m_addComponentActionGroup->addAction(ui->actionAdd_XnorGate);
+    m_addComponentActionGroup->addAction(ui->actionAdd_Clock);
     m_addComponentActionGroup->setExclusive(true);
 
+    // 仿真模式按钮互斥，但允许都不勾选（即迭代求稳）
+    m_simulationModeActionGroup = new QActionGroup(this);
+    m_simulationModeActionGroup->addAction(ui->actionEvent_Driven);
+    m_simulationModeActionGroup->addAction(ui->actionLevelized);
+    m_simulationModeActionGroup->setExclusionPolicy(QActionGroup::ExclusionPolicy::ExclusiveOptional);
+    connect(m_simulationModeActionGroup, &QActionGroup::triggered,
+            this, &MainWindow::onSimulationModeActionTriggered);
+
 
+    // 运行/暂停互斥；单步只在暂停时可用
+    m_runPauseActionGroup = new QActionGroup(this);
+    m_runPauseActionGroup->addAction(ui->actionRun_Simulation);
+    m_runPauseActionGroup->addAction(ui->actionPause_Simulation);
+    m_runPauseActionGroup->setExclusive(true);
 
     // 3. 设置TabWidget的功能
     ui->toolBar_2->setContextMenuPolicy(Qt::CustomContextMenu);
@@ -67,7 +91,14 @@ MainWindow::MainWindow(QWidget *parent)
             this, &MainWindow::onCustomComponentToolbarContextMenuRequested);
     connect(ui->tabWidget, &QTabWidget::tabCloseRequested, this, &MainWindow::onTabClose);
     connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onComponentPlaced);
-    // 程序启动时，扫描元件库并填充到现有工具栏
+    connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::onCurrentTabChanged);
+
+    // 时钟调度器始终驱动当前标签页
+    m_clockScheduler = new ClockScheduler(this);
+    connect(m_clockScheduler, &ClockScheduler::ticksPerSecondMeasured, this, &MainWindow::onClockRateMeasured);
+    m_waveformRecorder = nullptr;
+    // 程序启动时，读取元件库索引并填充到现有工具栏（元件文件在首次使用时才解析）
+    m_componentLibrary = new ComponentLibrary(QCoreApplication::applicationDirPath() + "/components");
     populateCustomComponentToolbar();
     // 4. 启动时自动创建一个空白标签页
     onNewTab();
@@ -77,6 +108,8 @@ MainWindow::MainWindow(QWidget *parent)
 /** 析构：释放UI（标签页中Engine由关闭时释放） */
 MainWindow::~MainWindow()
 {
+    delete m_waveformRecorder; // 仍挂在引擎上时会自行摘下
+    delete m_componentLibrary;
     delete ui;
     // 由于 Engine 和 Scene 的生命周期已与Tab页绑定，此处无需再手动清理
 }
@@ -110,9 +143,17 @@ Engine* MainWindow::currentEngine() {
 /** 新建一个标签页：创建独立 Engine 与 Scene 并安装到视图 */
 void MainWindow::onNewTab()
 {
-    // 1. 为新标签页创建一套独立的 Engine 和 Scene
-    Engine* engine = new Engine();
+    addCircuitTab(new Engine(), QString("电路 %1").arg(ui->tabWidget->count() + 1));
+}
+
+/** 为给定引擎创建场景与视图，作为新的当前标签页 */
+GraphicsScene* MainWindow::addCircuitTab(Engine* engine, const QString& tabName)
+{
+    // 1. 让引擎跟随当前的仿真设置，并为它创建 Scene
+    engine->setSimulationMode(selectedSimulationMode());
+    engine->setFlattenHierarchy(ui->actionFlatten_Hierarchy->isChecked());
     GraphicsScene* scene = new GraphicsScene(engine, this); // 将 engine 传入
+    scene->setPaused(ui->actionPause_Simulation->isChecked());
 
     // 2. 将 Scene 安装到一个 QGraphicsView 中
     QGraphicsView* view = new QGraphicsView(scene);
@@ -135,7 +176,6 @@ void MainWindow::onNewTab()
     view->setResizeAnchor(QGraphicsView::AnchorViewCenter);
 
     // 3. 把这个 view 添加为一个新的标签页
-    QString tabName = QString("电路 %1").arg(ui->tabWidget->count() + 1);
     int index = ui->tabWidget->addTab(view, tabName);
 
     // 4. 自动切换到这个新创建的标签页
@@ -143,6 +183,13 @@ void MainWindow::onNewTab()
 
     // 5. 连接 componentAdded 信号，以便在放置元件后取消工具栏按钮的选中状态
     connect(scene, &GraphicsScene::componentAdded, this, &MainWindow::onComponentPlaced);
+    // 6. 仿真未收敛时在状态栏说明振荡情况（画布上已用橙色标出振荡环）
+    connect(scene, &GraphicsScene::oscillationDetected, this, [this](int pinCount, int cyclePeriod, int iterations) {
+        const QString period = cyclePeriod > 0 ? QString("，振荡周期 %1 拍").arg(cyclePeriod) : QString("，未检测到固定周期");
+        ui->statusbar->showMessage(QString("电路在 %1 次迭代内未稳定：%2 个引脚仍在翻转%3（已用橙色标出）")
+                                       .arg(iterations).arg(pinCount).arg(period), 5000);
+    });
+    return scene;
 }
 
 /** 关闭指定索引的标签页，并释放其 Engine */
@@ -157,7 +204,10 @@ void MainWindow::onTabClose(int index)
         GraphicsScene* scene = qobject_cast<GraphicsScene*>(view->scene());
         Engine* engine = scene->getEngine();
 
-        // 3. 释放后台数据（Engine是我们手动new的，必须手动delete）
+        // 3. 停止分批重建、等待后台仿真结束，再释放后台数据（Engine是我们手动new的，必须手动delete）
+        if (m_clockScheduler->scene() == scene) { m_clockScheduler->setScene(nullptr); }
+        scene->cancelRebuild();
+        scene->waitForSimulation();
         delete engine;
 
         // 4. 关闭并删除标签页
@@ -251,19 +301,207 @@ void MainWindow::on_actionAdd_XnorGate_triggered()
     }
 }
 
+/** 工具栏：添加时钟源 */
+void MainWindow::on_actionAdd_Clock_triggered()
+{
+    GraphicsScene* scene = currentScene();
+    if (scene) {
+        scene->setComponentTypeToAdd(ComponentType::Clock);
+        scene->setMode(GraphicsScene::AddingComponent);
+    }
+}
+
 /** 清空当前画布与引擎数据 */
 void MainWindow::on_actionClear_triggered(){
     Engine* engine = currentEngine();
     GraphicsScene* scene = currentScene();
+    if (scene) {
+        scene->waitForSimulation();
+    }
     if (engine) {
         engine->clearAll();
     }
     if(scene){
-        scene->clear(); // clear()会删除场景中的所有图形项
+        scene->clearScene(); // 删除场景中的所有图形项，并清空场景索引
         scene->update(); // 立即刷新视图
     }
 }
 
+/** 切换仿真模式：同步到所有已打开的标签页，并立即重新仿真 */
+void MainWindow::onSimulationModeActionTriggered()
+{
+    SimulationMode mode = selectedSimulationMode();
+    for (int i = 0; i < ui->tabWidget->count(); ++i) {
+        QGraphicsView* view = qobject_cast<QGraphicsView*>(ui->tabWidget->widget(i));
+        if (!view) continue;
+        GraphicsScene* scene = qobject_cast<GraphicsScene*>(view->scene());
+        if (!scene) continue;
+        scene->waitForSimulation();
+        scene->getEngine()->setSimulationMode(mode);
+        scene->requestSimulation();
+    }
+    switch (mode) {
+    case SimulationMode::EventDriven: ui->statusbar->showMessage("仿真模式：活动驱动", 3000); break;
+    case SimulationMode::Levelized: ui->statusbar->showMessage("仿真模式：分层求值", 3000); break;
+    case SimulationMode::Iterative: ui->statusbar->showMessage("仿真模式：迭代求稳", 3000); break;
+    }
+}
+
+/** 切换展平层次：同步到所有已打开的标签页，并立即重新仿真 */
+void MainWindow::on_actionFlatten_Hierarchy_toggled(bool checked)
+{
+    for (int i = 0; i < ui->tabWidget->count(); ++i) {
+        QGraphicsView* view = qobject_cast<QGraphicsView*>(ui->tabWidget->widget(i));
+        if (!view) continue;
+        GraphicsScene* scene = qobject_cast<GraphicsScene*>(view->scene());
+        if (!scene) continue;
+        scene->waitForSimulation();
+        scene->getEngine()->setFlattenHierarchy(checked);
+        scene->requestSimulation();
+    }
+    ui->statusbar->showMessage(checked ? "封装层次：展平仿真" : "封装层次：逐层仿真", 3000);
+}
+
+/** 运行：恢复所有画布的自动仿真，并立即仿真到稳定 */
+void MainWindow::on_actionRun_Simulation_triggered()
+{
+    setAllScenesPaused(false);
+    ui->actionStep->setEnabled(false);
+    ui->actionRun_Clock->setEnabled(true);
+    ui->statusbar->showMessage("自动仿真已恢复", 3000);
+}
+
+/** 暂停：停止自动仿真与时钟，之后只能单步推进 */
+void MainWindow::on_actionPause_Simulation_triggered()
+{
+    ui->actionRun_Clock->setChecked(false); // 触发 toggled(false)，停止时钟调度器
+    ui->actionRun_Clock->setEnabled(false); // 暂停期间不能重新开启时钟，否则单步失去意义
+    setAllScenesPaused(true);
+    ui->actionStep->setEnabled(true);
+    ui->statusbar->showMessage("已暂停：点击“单步”逐拍推进电路");
+}
+
+/** 单步：当前画布推进一个单位延迟节拍，并报告电路是否已经稳定 */
+void MainWindow::on_actionStep_triggered()
+{
+    GraphicsScene* scene = currentScene();
+    if (!scene) return;
+    const bool stable = scene->stepSimulation(1);
+    ui->statusbar->showMessage(stable ? "单步：电路已稳定" : "单步：电路仍在变化");
+}
+
+/** 把暂停状态同步到所有已打开的标签页 */
+void MainWindow::setAllScenesPaused(bool paused)
+{
+    for (int i = 0; i < ui->tabWidget->count(); ++i) {
+        QGraphicsView* view = qobject_cast<QGraphicsView*>(ui->tabWidget->widget(i));
+        if (!view) continue;
+        GraphicsScene* scene = qobject_cast<GraphicsScene*>(view->scene());
+        if (scene) { scene->setPaused(paused); }
+    }
+}
+
+/** 开始/停止时钟：调度器按目标频率推进当前标签页的时钟节拍 */
+void MainWindow::on_actionRun_Clock_toggled(bool checked)
+{
+    if (checked) {
+        m_clockScheduler->setScene(currentScene());
+        m_clockScheduler->start();
+        ui->statusbar->showMessage(QString("时钟运行中：目标 %1 节拍/秒").arg(m_clockScheduler->targetRate()));
+    } else {
+        m_clockScheduler->stop();
+        ui->statusbar->showMessage("时钟已停止", 3000);
+    }
+}
+
+/** 设置时钟目标频率（1 节拍/秒 ~ 1,000,000 节拍/秒） */
+void MainWindow::on_actionClock_Rate_triggered()
+{
+    bool ok = false;
+    const int rate = QInputDialog::getInt(this, "时钟频率", "目标频率（节拍/秒）：",
+                                          int(m_clockScheduler->targetRate()), 1, 1000000, 100, &ok);
+    if (!ok) return;
+    m_clockScheduler->setTargetRate(rate);
+    ui->statusbar->showMessage(QString("时钟目标频率：%1 节拍/秒").arg(rate), 3000);
+}
+
+/**
+ * @brief 录制波形：勾选时给当前画布的引擎挂上记录器；取消勾选时摘下并询问 VCD 保存路径。
+ * @details 记录器不随标签页关闭而销毁，因此关闭画布后仍可停止录制并导出已记录的部分。
+ */
+void MainWindow::on_actionRecord_Waveform_toggled(bool checked)
+{
+    if (checked) {
+        GraphicsScene* scene = currentScene();
+        if (!scene) {
+            ui->actionRecord_Waveform->setChecked(false);
+            return;
+        }
+        scene->waitForSimulation(); // 以已提交的电平作为波形起点
+        m_waveformRecorder = new WaveformRecorder();
+        scene->getEngine()->setWaveformRecorder(m_waveformRecorder);
+        ui->statusbar->showMessage(QString("波形录制中：%1 个信号").arg(m_waveformRecorder->signalCount()));
+        return;
+    }
+
+    if (!m_waveformRecorder) return;
+    // 1. 停止记录：等待仿真提交后从引擎上摘下（引擎已随标签页释放时无需处理）
+    for (int i = 0; i < ui->tabWidget->count(); ++i) {
+        QGraphicsView* view = qobject_cast<QGraphicsView*>(ui->tabWidget->widget(i));
+        GraphicsScene* scene = view ? qobject_cast<GraphicsScene*>(view->scene()) : nullptr;
+        if (scene && scene->getEngine()->waveformRecorder() == m_waveformRecorder) {
+            scene->waitForSimulation();
+            scene->getEngine()->setWaveformRecorder(nullptr);
+        }
+    }
+
+    // 2. 导出
+    static QString lastUsedDir = "";
+    QString filePath = QFileDialog::getSaveFileName(
+        this, "导出波形",
+        lastUsedDir.isEmpty() ? "waveform.vcd" : lastUsedDir + "/waveform.vcd",
+        "VCD 波形文件 (*.vcd)");
+    if (filePath.isEmpty()) {
+        ui->statusbar->showMessage("已停止录制，波形未导出", 3000);
+    } else {
+        if (!filePath.endsWith(".vcd", Qt::CaseInsensitive)) { filePath += ".vcd"; }
+        lastUsedDir = QFileInfo(filePath).path();
+        QFile file(filePath);
+        if (!file.open(QIODevice::WriteOnly)) {
+            QMessageBox::critical(this, "导出错误", "无法写入文件: " + file.errorString());
+        } else if (!m_waveformRecorder->exportVcd(&file)) {
+            QMessageBox::critical(this, "导出错误", m_waveformRecorder->errorString());
+        } else {
+            ui->statusbar->showMessage(QString("波形已导出：%1 个时刻，%2 次翻转")
+                                           .arg(m_waveformRecorder->currentTime())
+                                           .arg(m_waveformRecorder->changeCount()), 3000);
+        }
+    }
+    delete m_waveformRecorder;
+    m_waveformRecorder = nullptr;
+}
+
+/** 状态栏显示实际频率与目标频率 */
+void MainWindow::onClockRateMeasured(double ticksPerSecond)
+{
+    ui->statusbar->showMessage(QString("时钟：%1 节拍/秒（目标 %2）")
+                                   .arg(qRound64(ticksPerSecond)).arg(m_clockScheduler->targetRate()));
+}
+
+/** 切换标签页后，时钟调度器改为驱动新的当前画布 */
+void MainWindow::onCurrentTabChanged()
+{
+    m_clockScheduler->setScene(currentScene());
+}
+
+/** @return 当前勾选的仿真模式；都不勾选时为迭代求稳 */
+SimulationMode MainWindow::selectedSimulationMode() const
+{
+    if (ui->actionEvent_Driven->isChecked()) return SimulationMode::EventDriven;
+    if (ui->actionLevelized->isChecked()) return SimulationMode::Levelized;
+    return SimulationMode::Iterative;
+}
+
 /** 元件放置后：取消工具栏选中并恢复状态栏 */
 void MainWindow::onComponentPlaced()
 {
@@ -284,7 +522,7 @@ void MainWindow::onComponentPlaced()
     ui->statusbar->showMessage("准备就绪");
 }
 
-/** 保存当前电路为JSON文件 */
+/** 保存当前电路：.tcb 为紧凑二进制存档，其余为JSON文件 */
 void MainWindow::on_actionSave_triggered()
 {
     Engine* engine = currentEngine();
@@ -298,31 +536,25 @@ void MainWindow::on_actionSave_triggered()
         this,
         "保存电路文件",
         lastUsedDir.isEmpty() ? "untitled.json" : lastUsedDir + "/untitled.json",
-        "JSON 文件 (*.json)"
+        "JSON 文件 (*.json);;二进制电路文件 (*.tcb)"
         );
 
     if (filePath.isEmpty()) {
         ui->statusbar->showMessage("保存操作已取消", 3000);
         return;
     }
-    // 确保文件后缀是 .json
-    if (!filePath.endsWith(".json", Qt::CaseInsensitive)) {
+    // 确保文件后缀是 .json 或 .tcb（保存格式由后缀决定）
+    if (!filePath.endsWith(".json", Qt::CaseInsensitive) && !filePath.endsWith(".tcb", Qt::CaseInsensitive)) {
         filePath += ".json";
     }
     lastUsedDir = QFileInfo(filePath).path();
 
-    // 从当前引擎获取电路数据
-    QJsonObject circuitJson = engine->saveCircuitToJson();
-    QJsonDocument saveDoc(circuitJson);
-
-    // 写入文件
-    QFile saveFile(filePath);
-    if (!saveFile.open(QIODevice::WriteOnly)) {
-        QMessageBox::critical(this, "保存错误", "无法打开文件进行写入！\n" + saveFile.errorString());
+    // 先等待后台仿真提交，保存最新状态，再由引擎按后缀写入文件
+    currentScene()->waitForSimulation();
+    if (!engine->saveCircuitToFile(filePath)) {
+        QMessageBox::critical(this, "保存错误", engine->lastError());
         return;
     }
-    saveFile.write(saveDoc.toJson());
-    saveFile.close();
 
     ui->statusbar->showMessage("文件已成功保存到: " + filePath, 5000);
 }
@@ -330,7 +562,7 @@ void MainWindow::on_actionSave_triggered()
 
 
 
-/** 打开JSON文件到新标签页，并重建场景 */
+/** 打开电路文件（.json 或 .tcb）到新标签页，并重建场景 */
 void MainWindow::on_actionOpen_triggered()
 {
     // 1. 打开文件对话框，让用户选择文件
@@ -338,7 +570,7 @@ void MainWindow::on_actionOpen_triggered()
         this,
         "打开电路文件",
         "", // 默认目录
-        "JSON 文件 (*.json);;所有文件 (*.*)"
+        "电路文件 (*.json *.tcb);;JSON 文件 (*.json);;二进制电路文件 (*.tcb);;所有文件 (*.*)"
         );
 
     // 如果用户取消了选择，直接返回
@@ -347,57 +579,73 @@ void MainWindow::on_actionOpen_triggered()
         return;
     }
 
-    // 2. 读取文件内容
-    QFile loadFile(filePath);
-    if (!loadFile.open(QIODevice::ReadOnly)) {
-        QMessageBox::critical(this, "打开错误", "无法打开文件进行读取！");
-        return;
-    }
-    QByteArray fileData = loadFile.readAll();
-    loadFile.close();
-
-    // 3. 解析JSON数据
-    QJsonDocument loadDoc = QJsonDocument::fromJson(fileData);
-    if (loadDoc.isNull() || !loadDoc.isObject()) {
-        QMessageBox::critical(this, "解析错误", "文件不是一个有效的JSON对象！");
-        return;
-    }
-    QJsonObject circuitJson = loadDoc.object();
-
-    // 4. 【核心修改】创建一个新的标签页用于承载打开的文件
-    onNewTab();
-
-    // 5. 获取这个刚刚创建的新标签页的 Engine 和 Scene
-    Engine* engine = currentEngine();
-    GraphicsScene* scene = currentScene();
+    // 2. 读取、解析与构建引擎交给工作线程；界面只显示进度，可随时取消
+    //    引擎先跟随当前的仿真设置，加载后的首次仿真就在工作线程上按所选模式完成
+    Engine* engine = new Engine();
+    engine->setSimulationMode(selectedSimulationMode());
+    engine->setFlattenHierarchy(ui->actionFlatten_Hierarchy->isChecked());
+    CircuitLoader* loader = new CircuitLoader(filePath, engine, this);
+    QProgressDialog* progress = new QProgressDialog("正在读取 " + QFileInfo(filePath).fileName() + " ...",
+                                                    "取消", 0, kOpenProgressSteps, this);
+    progress->setMinimumDuration(kOpenProgressDelayMs); // 小文件瞬间完成，不弹出对话框
+    progress->setAutoClose(false);
+    progress->setAutoReset(false);
+    connect(progress, &QProgressDialog::canceled, loader, &CircuitLoader::cancel);
+    connect(loader, &CircuitLoader::progress, progress, [progress](qint64 bytesRead, qint64 totalBytes) {
+        if (totalBytes > 0) { progress->setValue(int(bytesRead * kOpenProgressSteps / totalBytes)); }
+    });
+    connect(loader, &CircuitLoader::finished, this, [this, loader, progress](bool loaded) {
+        onCircuitLoaded(loader, progress, loaded);
+    });
+    ui->statusbar->showMessage("正在后台打开 " + filePath);
+    loader->start();
+}
 
-    // 健壮性检查，虽然 onNewTab 之后这里应该总是有值的
-    if (!engine || !scene) {
-        QMessageBox::critical(this, "内部错误", "无法创建新的画布来加载文件。");
-        // 关闭刚刚创建的空标签页
-        onTabClose(ui->tabWidget->currentIndex());
+/**
+ * @brief 后台加载结束：失败或取消时释放引擎；成功时为它新建标签页，再分批创建图形项。
+ * @details 分批创建期间视图不可交互，进度对话框改为显示已创建的图形项数，此时取消会关闭这个标签页。
+ */
+void MainWindow::onCircuitLoaded(CircuitLoader* loader, QProgressDialog* progress, bool loaded)
+{
+    const QString filePath = loader->filePath();
+    Engine* engine = loader->engine();
+    const bool canceled = loader->wasCanceled();
+    loader->deleteLater();
+
+    if (!loaded) {
+        progress->deleteLater();
+        if (canceled) {
+            ui->statusbar->showMessage("打开操作已取消", 3000);
+        } else {
+            QMessageBox::critical(this, "加载失败", "文件内容格式错误或数据不兼容，无法加载。\n" + engine->lastError());
+        }
+        delete engine;
         return;
     }
 
-    // 6. 调用引擎的加载功能，将JSON数据加载到新引擎中
-    if (engine->loadCircuitFromJson(circuitJson)) {
-        // 如果后台引擎成功加载...
-        // ...命令前台画布根据引擎的新状态重绘
-        scene->rebuildSceneFromEngine();
-
-        // 7. 【体验优化】将新标签页的标题设置为文件名
-        // 【修改】使用 baseName() 替代 fileName() 来移除后缀
-        QString fileName = QFileInfo(filePath).baseName();
-        ui->tabWidget->setTabText(ui->tabWidget->currentIndex(), fileName);
-
-        // 给出成功反馈
-        ui->statusbar->showMessage("电路已成功从 " + filePath + " 加载到新画布", 5000);
-
-    } else {
-        // 如果加载失败，给出提示并关闭刚刚创建的空标签页
-        QMessageBox::critical(this, "加载失败", "文件内容格式错误或数据不兼容，无法加载。");
-        onTabClose(ui->tabWidget->currentIndex());
-    }
+    // 1. 新建标签页承载已加载的引擎，标题为文件名（去掉后缀）
+    GraphicsScene* scene = addCircuitTab(engine, QFileInfo(filePath).baseName());
+    QGraphicsView* view = qobject_cast<QGraphicsView*>(ui->tabWidget->currentWidget());
+    view->setInteractive(false);
+
+    // 2. 进度对话框改为跟踪图形项的创建；取消则关闭这个标签页
+    disconnect(progress, &QProgressDialog::canceled, nullptr, nullptr);
+    progress->setLabelText("正在创建图形项 ...");
+    progress->setValue(0);
+    connect(progress, &QProgressDialog::canceled, this, [this, view]() {
+        onTabClose(ui->tabWidget->indexOf(view));
+    });
+    connect(scene, &GraphicsScene::rebuildProgress, progress, [progress](int created, int total) {
+        progress->setValue(total > 0 ? int(qint64(created) * kOpenProgressSteps / total) : kOpenProgressSteps);
+    });
+    connect(scene, &GraphicsScene::rebuildFinished, this, [this, scene, view, progress, filePath](bool completed) {
+        disconnect(scene, &GraphicsScene::rebuildProgress, progress, nullptr);
+        disconnect(scene, &GraphicsScene::rebuildFinished, this, nullptr);
+        progress->deleteLater();
+        view->setInteractive(true);
+        ui->statusbar->showMessage(completed ? "电路已成功从 " + filePath + " 加载到新画布" : "打开操作已取消", 5000);
+    });
+    scene->rebuildSceneFromEngineInSlices();
 }
 
 
@@ -414,7 +662,7 @@ void MainWindow::on_actionEncapsulate_triggered()
 
     // 1. 检查电路是否包含至少一个输入和输出
     bool hasInput = false, hasOutput = false;
-    for (Component* comp : engine->getAllComponents().values()) {
+    for (Component* comp : engine->getAllComponents()) {
         if (comp->type() == ComponentType::Input) hasInput = true;
         if (comp->type() == ComponentType::Output) hasOutput = true;
     }
@@ -422,6 +670,12 @@ void MainWindow::on_actionEncapsulate_triggered()
         QMessageBox::warning(this, "封装错误", "电路必须至少包含一个输入(Input)和一个输出(Output)元件，才能定义封装后的引脚。");
         return;
     }
+    for (Component* comp : engine->getAllComponents()) {
+        if (comp->type() == ComponentType::Clock) {
+            QMessageBox::warning(this, "封装错误", "时钟只能放在顶层画布上，请先删除电路中的时钟元件再封装。");
+            return;
+        }
+    }
 
     // 2. 弹出窗口让用户命名，并使用当前标签页的标题作为默认名
     QString defaultName = ui->tabWidget->tabText(ui->tabWidget->currentIndex());
@@ -434,7 +688,7 @@ void MainWindow::on_actionEncapsulate_triggered()
     }
 
     // 3. 创建元件库目录 (如果不存在)
-    QString libPath = QCoreApplication::applicationDirPath() + "/components";
+    QString libPath = m_componentLibrary->directory();
     QDir dir(libPath);
     if (!dir.exists()) {
         dir.mkpath(".");
@@ -448,6 +702,7 @@ void MainWindow::on_actionEncapsulate_triggered()
         return;
     }
 
+    currentScene()->waitForSimulation();
     QJsonObject circuitJson = engine->saveCircuitToJson();
     saveFile.write(QJsonDocument(circuitJson).toJson());
     saveFile.close();
@@ -460,58 +715,64 @@ void MainWindow::on_actionEncapsulate_triggered()
 
 // in mainwindow.cpp
 
-/** 扫描应用目录下 components/，重建自定义元件的工具栏按钮 */
+/**
+ * @brief 同步元件库并增量更新工具栏。
+ * @details 元件库只重新读取修改过的文件；已删除的元件移除按钮，新元件按名称顺序插入按钮，其余按钮保持不动。
+ */
 void MainWindow::populateCustomComponentToolbar()
 {
-    // --- 1. 清理旧的自定义按钮 ---
-    QList<QAction*> actionsToRemove;
-    for (QAction *action : ui->toolBar_2->actions()) {
-        // 通过我们设置的自定义属性来识别
-        if (action->property("isCustom").toBool()) {
-            actionsToRemove.append(action);
+    m_componentLibrary->refresh();
+    const QVector<ComponentLibrary::Entry>& entries = m_componentLibrary->entries();
+
+    // --- 1. 移除已不在库中的按钮 ---
+    for (auto it = m_customComponentActions.begin(); it != m_customComponentActions.end();) {
+        if (m_componentLibrary->entry(it.key())) {
+            ++it;
+            continue;
         }
+        ui->toolBar_2->removeAction(it.value());
+        m_addComponentActionGroup->removeAction(it.value());
+        delete it.value();
+        it = m_customComponentActions.erase(it);
     }
 
-    for (QAction *action : actionsToRemove) {
-        ui->toolBar_2->removeAction(action);
-        m_addComponentActionGroup->removeAction(action);
-        delete action;
-    }
-
-    // --- 2. 扫描文件并重建按钮 ---
-    QString libPath = QCoreApplication::applicationDirPath() + "/components";
-    QDir dir(libPath);
-    if (!dir.exists()) return; // 如果文件夹不存在，就没什么可做的了
-
-    QStringList filters;
-    filters << "*.json";
-    QFileInfoList fileList = dir.entryInfoList(filters, QDir::Files | QDir::NoDotAndDotDot);
-
     // 如果存在自定义元件，就在内置元件和自定义元件之间加一条分割线
-    // (仅在第一次添加，或者清理后重新添加时)
-    if (!fileList.isEmpty() && actionsToRemove.isEmpty()) {
+    // (仅在第一次添加，或者全部删除后重新添加时)
+    if (!entries.isEmpty() && m_customComponentActions.isEmpty()) {
         ui->toolBar_2->addSeparator();
     }
 
-    for (const QFileInfo &fileInfo : fileList) {
-        QAction *action = new QAction(this);
-        action->setText(fileInfo.baseName()); // 文件名作为按钮文字
-        action->setCheckable(true);
-        action->setData(fileInfo.absoluteFilePath()); // 存储完整路径
+    // --- 2. 从后往前补上新元件的按钮：插在下一个已有按钮之前，保持按名称排序 ---
+    QAction* next = nullptr;
+    for (int i = entries.size() - 1; i >= 0; --i) {
+        const ComponentLibrary::Entry& entry = entries[i];
+        QAction* action = m_customComponentActions.value(entry.name);
+        if (!action) {
+            action = new QAction(this);
+            action->setText(entry.name); // 文件名作为按钮文字
+            action->setCheckable(true);
+            action->setData(entry.name); // 存储元件名，由元件库解析
 
-        // 【核心标记】给这个 Action 打上 "isCustom" 标签，值为 true
-        action->setProperty("isCustom", true);
+            // 【核心标记】给这个 Action 打上 "isCustom" 标签，值为 true
+            action->setProperty("isCustom", true);
 
-        ui->toolBar_2->addAction(action);
-        m_addComponentActionGroup->addAction(action);
+            ui->toolBar_2->insertAction(next, action);
+            m_addComponentActionGroup->addAction(action);
+            m_customComponentActions.insert(entry.name, action);
 
-        connect(action, &QAction::triggered, this, &MainWindow::onCustomComponentActionTriggered);
+            connect(action, &QAction::triggered, this, &MainWindow::onCustomComponentActionTriggered);
+        }
+        // 引脚数来自索引缓存；从未解析过的元件暂不显示
+        action->setToolTip(entry.inputCount < 0
+                               ? entry.name
+                               : QString("%1（%2 输入 / %3 输出）").arg(entry.name).arg(entry.inputCount).arg(entry.outputCount));
+        next = action;
     }
 }
 
 // in mainwindow.cpp
 
-/** 点击自定义元件按钮：读取JSON并设置场景为添加封装元件模式 */
+/** 点击自定义元件按钮：从元件库取得共享定义（首次使用时解析）并设置场景为添加封装元件模式 */
 void MainWindow::onCustomComponentActionTriggered()
 {
     QAction* action = qobject_cast<QAction*>(sender());
@@ -520,26 +781,20 @@ void MainWindow::onCustomComponentActionTriggered()
     GraphicsScene* scene = currentScene();
     if (!scene) return;
 
-    QString filePath = action->data().toString();
-
-    QFile loadFile(filePath);
-    if (!loadFile.open(QIODevice::ReadOnly)) {
-        QMessageBox::warning(this, "错误", "无法读取元件文件: " + filePath);
-        action->setChecked(false); // 弹起按钮
-        return;
-    }
-    QJsonDocument loadDoc = QJsonDocument::fromJson(loadFile.readAll());
-    if (loadDoc.isNull() || !loadDoc.isObject()) {
-        QMessageBox::warning(this, "错误", "元件文件格式无效: " + filePath);
+    const QString name = action->data().toString();
+    const EncapsulatedDefinition* definition = m_componentLibrary->definition(name);
+    if (!definition) {
+        QMessageBox::warning(this, "错误", m_componentLibrary->lastError());
         action->setChecked(false); // 弹起按钮
         return;
     }
+    const ComponentLibrary::Entry* entry = m_componentLibrary->entry(name);
+    action->setToolTip(QString("%1（%2 输入 / %3 输出）").arg(name).arg(entry->inputCount).arg(entry->outputCount));
 
-    // 设置场景进入“添加封装元件”模式，并把 JSON 数据传递过去
-    scene->setNameForNextComponent(action->text());
+    // 设置场景进入“添加封装元件”模式，并把共享定义传递过去
     scene->setMode(GraphicsScene::AddingComponent);
     scene->setComponentTypeToAdd(ComponentType::Encapsulated);
-    scene->setJsonForNextComponent(loadDoc.object());
+    scene->setDefinitionForNextComponent(definition);
 }
 /** 在自定义元件工具栏上右键：提供删除该库元件的操作 */
 void MainWindow::onCustomComponentToolbarContextMenuRequested(const QPoint &pos)
@@ -565,15 +820,14 @@ void MainWindow::onCustomComponentToolbarContextMenuRequested(const QPoint &pos)
                                           QMessageBox::Yes | QMessageBox::No);
 
             if (reply == QMessageBox::Yes) {
-                // 4. 从 Action 中获取文件路径并执行删除
-                QString filePath = action->data().toString();
-                QFile file(filePath);
-                if (file.remove()) {
-                    ui->statusbar->showMessage(QString("元件 '%1' 已成功删除。").arg(action->text()), 3000);
+                // 4. 由元件库删除文件并移出索引
+                const QString name = action->data().toString();
+                if (m_componentLibrary->remove(name)) {
+                    ui->statusbar->showMessage(QString("元件 '%1' 已成功删除。").arg(name), 3000);
                     // 5. 【关键】调用刷新函数，UI 上的按钮就会消失
                     populateCustomComponentToolbar();
                 } else {
-                    QMessageBox::critical(this, "删除失败", "无法从硬盘删除文件，请检查文件权限。");
+                    QMessageBox::critical(this, "删除失败", m_componentLibrary->lastError());
                 }
             }
         }
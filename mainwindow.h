@@ -15,6 +15,11 @@
 class Engine;
 class GraphicsScene;
 class QActionGroup;
+class ClockScheduler;
+class WaveformRecorder;
+class ComponentLibrary;
+class CircuitLoader;
+class QProgressDialog;
 
 
 QT_BEGIN_NAMESPACE
@@ -55,10 +60,32 @@ private slots:
     void on_actionAdd_XorGate_triggered();
     /** 添加同或门 */
     void on_actionAdd_XnorGate_triggered();
+    /** 添加时钟源 */
+    void on_actionAdd_Clock_triggered();
     /** 新建标签页 */
     void on_actionNew_Tab_triggered();
     /** 清空当前画布 */
     void on_actionClear_triggered();
+    /** 切换所有画布的仿真模式（活动驱动 / 分层求值 / 都不勾选为迭代求稳） */
+    void onSimulationModeActionTriggered();
+    /** 切换所有画布是否展平封装层次 */
+    void on_actionFlatten_Hierarchy_toggled(bool checked);
+    /** 恢复所有画布的自动仿真 */
+    void on_actionRun_Simulation_triggered();
+    /** 暂停所有画布的自动仿真（进入单步模式） */
+    void on_actionPause_Simulation_triggered();
+    /** 把当前画布推进一个单位延迟节拍 */
+    void on_actionStep_triggered();
+    /** 开始/停止按目标频率推进当前画布的时钟 */
+    void on_actionRun_Clock_toggled(bool checked);
+    /** 设置时钟调度器的目标频率 */
+    void on_actionClock_Rate_triggered();
+    /** 开始录制当前画布的波形 / 停止录制并导出为 VCD */
+    void on_actionRecord_Waveform_toggled(bool checked);
+    /** 在状态栏显示时钟调度器实际达到的频率 */
+    void onClockRateMeasured(double ticksPerSecond);
+    /** 切换标签页：时钟调度器改为驱动新的当前画布 */
+    void onCurrentTabChanged();
     /** 在元件放置后重置工具栏按钮状态 */
     void onComponentPlaced();
     // ... 其他功能按钮的槽函数声明 ...
@@ -87,8 +114,28 @@ private:
     Ui::MainWindow *ui;
 
     QActionGroup *m_addComponentActionGroup;
-    /** 扫描自定义库并填充到工具栏 */
+    /** 运行/暂停按钮组（互斥） */
+    QActionGroup *m_runPauseActionGroup;
+    /** 把暂停状态同步到所有标签页 */
+    void setAllScenesPaused(bool paused);
+    /** 时钟调度器（驱动当前标签页） */
+    ClockScheduler *m_clockScheduler;
+    /** 正在录制的波形（挂在开始录制时的画布引擎上；标签页关闭后仍可导出） */
+    WaveformRecorder *m_waveformRecorder;
+    /** 仿真模式按钮组（最多勾选一个） */
+    QActionGroup *m_simulationModeActionGroup;
+    /** 根据仿真模式按钮的勾选状态得出当前仿真模式 */
+    SimulationMode selectedSimulationMode() const;
+    /** 自定义元件库（带索引缓存，元件在首次使用时解析） */
+    ComponentLibrary *m_componentLibrary;
+    /** 工具栏上的自定义元件按钮（元件名 → 按钮） */
+    QHash<QString, QAction*> m_customComponentActions;
+    /** 同步元件库并增量更新工具栏：只增删有变化的按钮 */
     void populateCustomComponentToolbar();
+    /** 为给定引擎新建标签页（场景 + 视图）并切换过去 */
+    GraphicsScene* addCircuitTab(Engine* engine, const QString& tabName);
+    /** 后台打开文件结束：成功时新建标签页并分批创建图形项 */
+    void onCircuitLoaded(CircuitLoader* loader, QProgressDialog* progress, bool loaded);
     /** 获取当前标签页的场景指针 */
     GraphicsScene* currentScene();
     /** 获取当前标签页的引擎指针 */
@@ -0,0 +1,155 @@
+#include "engine.h"            // 仿真引擎（不依赖图形界面）
+
+#include <QCoreApplication>    // 无界面的应用对象
+#include <QCommandLineParser>  // 命令行参数解析
+#include <QFile>               // 读取输入向量文件
+#include <QTextStream>         // 按行读取输入向量、输出结果
+
+/**
+ * @file simcli.cpp
+ * @brief 命令行仿真器 turing-sim：加载电路存档，逐行施加输入向量，打印输出状态。
+ * @details 输入向量每行一组，由字符 0/1 组成（空白与下划线会被忽略，# 开头为注释），
+ * 位序与封装引脚顺序一致（输入元件按 Y 坐标排序）；每组输入仿真 N 步后输出一行，位序同样按输出元件的 Y 坐标排序。
+ * 一步 = 在当前时钟节拍下求稳，再让时钟前进一拍；时钟节拍跨输入组连续计数，因此 -n 就是每组输入经历的时钟拍数。
+ * 退出码：0 成功；1 参数、文件或向量格式错误；2 有输入组在迭代上限内未稳定（振荡）。
+ */
+
+/**
+ * @brief 把一行文本解析为输入向量。
+ * @param line 一行文本
+ * @param vector [out] 解析结果
+ * @return 只含 0/1（及可忽略字符）时返回 true
+ */
+static bool parseVector(const QString& line, QVector<bool>& vector)
+{
+    vector.clear();
+    for (QChar ch : line) {
+        if (ch == '0' || ch == '1') {
+            vector.append(ch == '1');
+        } else if (!ch.isSpace() && ch != '_') {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief 解析 --mode 参数。
+ * @return 成功返回 true
+ */
+static bool parseMode(const QString& text, SimulationMode& mode)
+{
+    if (text == "iterative") { mode = SimulationMode::Iterative; return true; }
+    if (text == "event") { mode = SimulationMode::EventDriven; return true; }
+    if (text == "levelized") { mode = SimulationMode::Levelized; return true; }
+    return false;
+}
+
+/**
+ * @brief 程序入口：解析参数、加载电路，然后按行处理输入向量。
+ */
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("turing-sim");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Turingv2 命令行仿真器：加载电路存档，施加输入向量并打印输出。");
+    parser.addHelpOption();
+    parser.addPositionalArgument("circuit", "电路存档（.json 或二进制 .tcb）");
+    QCommandLineOption inputsOption({"i", "inputs"}, "输入向量文件（每行一组 0/1，省略或为 - 时读标准输入）", "file", "-");
+    QCommandLineOption stepsOption({"n", "steps"}, "每组输入运行的时钟步数（每步求稳一次后时钟前进一拍）", "N", "1");
+    QCommandLineOption modeOption({"m", "mode"}, "仿真模式：iterative、event 或 levelized", "mode", "iterative");
+    QCommandLineOption flattenOption("flatten", "展平封装层次后仿真");
+    QCommandLineOption iterationsOption("max-iterations", "每步的迭代上限", "N",
+                                        QString::number(Engine::kDefaultMaxIterations));
+    parser.addOptions({inputsOption, stepsOption, modeOption, flattenOption, iterationsOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    QTextStream out(stdout);
+    if (parser.positionalArguments().size() != 1) {
+        err << "用法错误：需要且只需要一个电路存档参数\n";
+        return 1;
+    }
+
+    // --- 1. 解析数值参数 ---
+    bool stepsOk = false;
+    bool iterationsOk = false;
+    const int steps = parser.value(stepsOption).toInt(&stepsOk);
+    const int maxIterations = parser.value(iterationsOption).toInt(&iterationsOk);
+    SimulationMode mode;
+    if (!stepsOk || steps < 1 || !iterationsOk || maxIterations < 1 || !parseMode(parser.value(modeOption), mode)) {
+        err << "参数错误：--steps、--max-iterations 须为正整数，--mode 须为 iterative/event/levelized\n";
+        return 1;
+    }
+
+    // --- 2. 加载电路 ---
+    const QString circuitPath = parser.positionalArguments().first();
+    Engine engine;
+    engine.setSimulationMode(mode);
+    engine.setFlattenHierarchy(parser.isSet(flattenOption));
+    engine.setMaxIterations(maxIterations);
+    if (!engine.loadCircuitFromFile(circuitPath)) {
+        err << "加载电路失败：" << circuitPath << "：" << engine.lastError() << "\n";
+        return 1;
+    }
+    const QVector<Component*> inputs = engine.orderedInputs();
+    const QVector<Component*> outputs = engine.orderedOutputs();
+
+    // --- 3. 打开输入向量 ---
+    QFile vectorFile;
+    const QString vectorPath = parser.value(inputsOption);
+    bool opened = false;
+    if (vectorPath == "-") {
+        opened = vectorFile.open(stdin, QIODevice::ReadOnly);
+    } else {
+        vectorFile.setFileName(vectorPath);
+        opened = vectorFile.open(QIODevice::ReadOnly);
+    }
+    if (!opened) {
+        err << "无法打开输入向量文件：" << vectorPath << "\n";
+        return 1;
+    }
+    QTextStream vectors(&vectorFile);
+
+    // --- 4. 逐行施加输入、仿真、打印输出 ---
+    int lineNumber = 0;
+    int unstableCount = 0;
+    QVector<bool> vector;
+    QString line;
+    while (vectors.readLineInto(&line)) {
+        ++lineNumber;
+        const QString trimmed = line.trimmed();
+        if (trimmed.isEmpty() || trimmed.startsWith('#')) continue;
+        if (!parseVector(trimmed, vector) || vector.size() != inputs.size()) {
+            err << "第 " << lineNumber << " 行：需要 " << inputs.size() << " 位 0/1 输入\n";
+            return 1;
+        }
+        for (int k = 0; k < inputs.size(); ++k) {
+            static_cast<Input*>(inputs[k])->setState(vector[k]);
+        }
+        // 每步：按当前时钟电平求稳，再推进时钟；报告第一个未稳定的步，全部稳定时为最后一步
+        SimulationResult diagnosis;
+        for (int step = 0; step < steps; ++step) {
+            const SimulationResult stepResult = engine.simulate();
+            if (diagnosis.converged) diagnosis = stepResult;
+            engine.advanceClock();
+        }
+        if (!diagnosis.converged) {
+            ++unstableCount;
+            err << "第 " << lineNumber << " 行：电路在 " << maxIterations << " 次迭代内未稳定，"
+                << diagnosis.oscillatingPins.size() << " 个引脚仍在翻转";
+            if (diagnosis.cyclePeriod > 0) err << "（振荡周期 " << diagnosis.cyclePeriod << " 拍）";
+            err << "\n";
+        }
+
+        QString result;
+        for (Component* output : outputs) {
+            result += output->inputPins()[0]->getState() ? '1' : '0';
+        }
+        out << result << "\n";
+    }
+    out.flush();
+    return unstableCount > 0 ? 2 : 0;
+}
@@ -0,0 +1,414 @@
+#include "waveform.h"
+#include "engine.h"       // Engine / Component / Pin
+
+#include <QIODevice>      // VCD 的输出设备
+#include <QTemporaryFile> // 溢出文件
+#include <QtEndian>       // 溢出记录头的字节序
+#include <QDebug>
+#include <algorithm>      // std::sort
+
+/** 单个轨迹块的目标大小：写满后封闭，作为溢出与淘汰的单位 */
+static const int kChunkBytes = 64 * 1024;
+/** 导出 VCD 时攒够这么多字节再写一次设备 */
+static const int kVcdFlushBytes = 64 * 1024;
+/** 溢出记录头：8 字节起始时刻 + 4 字节长度 */
+static const int kSpillHeaderBytes = 12;
+
+// ===============================================
+// === 变长整数与命名辅助
+// ===============================================
+
+/** 以 LEB128 变长整数追加到 out（每字节 7 位，高位为延续标志） */
+static void appendVarint(QByteArray& out, quint64 value)
+{
+    while (value >= 0x80) {
+        out.append(char((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.append(char(value));
+}
+
+/**
+ * @brief 从 data[pos] 读取一个变长整数并前移 pos。
+ * @return 数据截断或超过 64 位时返回 false
+ */
+static bool readVarint(const QByteArray& data, int& pos, quint64& value)
+{
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (pos >= data.size()) return false;
+        const uchar byte = uchar(data[pos++]);
+        value |= quint64(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return true;
+    }
+    return false;
+}
+
+/** 组件类型的英文名（VCD 标识符只允许 ASCII） */
+static const char* vcdTypeName(ComponentType type)
+{
+    switch (type) {
+    case ComponentType::Input:        return "Input";
+    case ComponentType::Output:       return "Output";
+    case ComponentType::And:          return "And";
+    case ComponentType::Or:           return "Or";
+    case ComponentType::Not:          return "Not";
+    case ComponentType::Nand:         return "Nand";
+    case ComponentType::Nor:          return "Nor";
+    case ComponentType::Xor:          return "Xor";
+    case ComponentType::Xnor:         return "Xnor";
+    case ComponentType::Encapsulated: return "Block";
+    case ComponentType::Clock:        return "Clock";
+    }
+    return "Part";
+}
+
+/** VCD 短标识符：以 '!'..'~' 共 94 个可打印字符表示的信号编号 */
+static QByteArray vcdCode(quint32 index)
+{
+    QByteArray code;
+    do {
+        code.append(char('!' + index % 94));
+        index /= 94;
+    } while (index > 0);
+    return code;
+}
+
+// ===============================================
+// === WaveformRecorder
+// ===============================================
+
+WaveformRecorder::WaveformRecorder(qint64 memoryBudget)
+    : m_memoryBudget(qMax<qint64>(memoryBudget, kChunkBytes))
+{
+}
+
+/** 析构：先从引擎上摘下，溢出文件随 QScopedPointer 删除 */
+WaveformRecorder::~WaveformRecorder()
+{
+    if (m_engine) { m_engine->setWaveformRecorder(nullptr); }
+}
+
+/** 开关溢出到磁盘；只影响之后被淘汰的块 */
+void WaveformRecorder::setSpillToDisk(bool enabled) { m_spillToDisk = enabled; }
+
+/** @return 内存中的轨迹字节数（已封闭的块 + 正在写入的块） */
+qint64 WaveformRecorder::memoryBytes() const { return m_closedBytes + m_current.data.size(); }
+
+/**
+ * @brief 挂到引擎上（由 Engine::setWaveformRecorder 调用）。
+ * @details 已挂在别的引擎上时先从那里摘下；然后把所有顶层输出引脚的当前电平登记为它们的起点。
+ */
+void WaveformRecorder::attach(Engine* engine)
+{
+    if (m_engine && m_engine != engine) { m_engine->setWaveformRecorder(nullptr); }
+    m_engine = engine;
+    m_pinSignals.clear();
+    if (!engine) return;
+    for (Component* component : engine->getAllComponents()) {
+        for (Pin* pin : component->outputPins()) { signalFor(pin, pin->getState()); }
+    }
+}
+
+/** 从引擎上摘下（由 Engine 调用）：已记录的轨迹保留，仍可导出 */
+void WaveformRecorder::detach()
+{
+    m_engine = nullptr;
+    m_pinSignals.clear();
+}
+
+/** 组件即将被删除：释放它的引脚映射，避免被新分配到同一地址的引脚误用 */
+void WaveformRecorder::forgetComponent(const Component* component)
+{
+    for (const Pin* pin : component->outputPins()) { m_pinSignals.remove(pin); }
+}
+
+/** 引擎即将清空：释放全部引脚映射 */
+void WaveformRecorder::forgetAllPins() { m_pinSignals.clear(); }
+
+/**
+ * @brief 返回引脚的信号编号，首次见到时登记。
+ * @details 只有顶层组件的输出引脚才记录；封装内部的引脚不缓存结果，
+ * 因为它们可能随封装元件一起释放，地址被之后的顶层引脚复用。
+ * @param valueBeforeChange 登记时刻之前的电平（作为该信号的起点）
+ */
+quint32 WaveformRecorder::signalFor(Pin* pin, bool valueBeforeChange)
+{
+    if (pin->type() != Pin::Output) return kNotRecorded;
+    const auto it = m_pinSignals.constFind(pin);
+    if (it != m_pinSignals.constEnd()) return it.value();
+
+    Component* owner = pin->owner();
+    if (!m_engine || m_engine->componentById(owner->id()) != owner) return kNotRecorded;
+
+    // --- 新信号：名称形如 And12_out0；组件ID被复用时追加序号区分 ---
+    QString name = QString("%1%2_out%3").arg(vcdTypeName(owner->type())).arg(owner->id()).arg(pin->index());
+    if (m_signalNames.contains(name)) {
+        int suffix = 2;
+        while (m_signalNames.contains(name + "_" + QString::number(suffix))) { ++suffix; }
+        name += "_" + QString::number(suffix);
+    }
+    m_signalNames.insert(name);
+
+    const quint32 id = quint32(m_signals.size());
+    m_signals.append(Signal{name, valueBeforeChange, m_time});
+    m_baseValues.append(valueBeforeChange ? 1 : 0);
+    m_pinSignals.insert(pin, id);
+    return id;
+}
+
+/**
+ * @brief 记录一次提交。
+ * @details 时间先加 1；没有顶层输出翻转时不写任何字节。与上一个采样相同（同样的时间增量、同样的信号）
+ * 时只累加重复次数，因此时钟驱动的周期性电路几乎不占空间。
+ */
+void WaveformRecorder::recordCommit(const QVector<Pin*>& changedPins)
+{
+    ++m_time;
+
+    // --- 1. 收集本次翻转的已记录信号（按编号升序，便于差分编码） ---
+    m_scratch.clear();
+    for (Pin* pin : changedPins) {
+        const quint32 id = signalFor(pin, !pin->getState());
+        if (id != kNotRecorded) m_scratch.append(id);
+    }
+    if (m_scratch.isEmpty()) return;
+    std::sort(m_scratch.begin(), m_scratch.end());
+    m_changeCount += m_scratch.size();
+
+    // --- 2. 与上一个采样相同：只累加游程 ---
+    const quint64 delta = m_time - m_lastRecordTime;
+    m_lastRecordTime = m_time;
+    if (m_hasLast && delta == m_lastDelta && m_scratch == m_lastIds) {
+        ++m_runLength;
+        return;
+    }
+
+    // --- 3. 新采样：先写出积压的游程，再写本采样；块写满后封闭 ---
+    flushRun();
+    writeRecord(delta, m_scratch);
+    m_lastIds = m_scratch;
+    m_lastDelta = delta;
+    m_hasLast = true;
+    if (m_current.data.size() >= kChunkBytes) closeChunk();
+}
+
+/** 写出积压的重复次数：varint((次数 << 1) | 1) */
+void WaveformRecorder::flushRun()
+{
+    if (m_runLength == 0) return;
+    appendVarint(m_current.data, (m_runLength << 1) | 1);
+    m_runLength = 0;
+}
+
+/** 写出一个采样：varint(时间增量 << 1)、varint(信号数)、各信号编号与前一个的差 */
+void WaveformRecorder::writeRecord(quint64 delta, const QVector<quint32>& ids)
+{
+    appendVarint(m_current.data, delta << 1);
+    appendVarint(m_current.data, quint64(ids.size()));
+    quint32 previous = 0;
+    for (quint32 id : ids) {
+        appendVarint(m_current.data, id - previous);
+        previous = id;
+    }
+}
+
+/**
+ * @brief 解码一个块。
+ * @details visit(时刻, 信号编号) 对每个采样（包括游程展开出的重复采样）各调用一次。
+ */
+template <typename Visit>
+bool WaveformRecorder::decodeChunk(quint64 startTime, const QByteArray& data, Visit visit) const
+{
+    quint64 time = startTime;
+    quint64 lastDelta = 0;
+    QVector<quint32> ids;
+    int pos = 0;
+    while (pos < data.size()) {
+        quint64 head = 0;
+        if (!readVarint(data, pos, head)) return false;
+        if (head & 1) {
+            // --- 游程：按上一个采样的增量重复 ---
+            if (ids.isEmpty()) return false;
+            for (quint64 repeat = head >> 1; repeat > 0; --repeat) {
+                time += lastDelta;
+                visit(time, ids);
+            }
+            continue;
+        }
+        quint64 count = 0;
+        if (!readVarint(data, pos, count) || count == 0 || count > quint64(data.size())) return false;
+        lastDelta = head >> 1;
+        time += lastDelta;
+        ids.resize(int(count));
+        quint64 id = 0;
+        for (quint64 i = 0; i < count; ++i) {
+            quint64 step = 0;
+            if (!readVarint(data, pos, step)) return false;
+            id += step;
+            if (id >= quint64(m_signals.size())) return false;
+            ids[int(i)] = quint32(id);
+        }
+        visit(time, ids);
+    }
+    return true;
+}
+
+/**
+ * @brief 从头解码溢出文件中的所有块，之后把文件位置移回末尾以便继续追加。
+ * @return 文件损坏（长度不符或记录无效）时返回 false，已解码的部分照常回调
+ */
+template <typename Visit>
+bool WaveformRecorder::readSpillFile(Visit visit)
+{
+    if (!m_spillFile || !m_spillFile->seek(0)) return m_spillFile.isNull();
+    bool intact = true;
+    char header[kSpillHeaderBytes];
+    qint64 got = 0;
+    while ((got = m_spillFile->read(header, kSpillHeaderBytes)) == kSpillHeaderBytes) {
+        const quint64 startTime = qFromLittleEndian<quint64>(header);
+        const quint32 size = qFromLittleEndian<quint32>(header + 8);
+        const QByteArray data = m_spillFile->read(size);
+        if (data.size() != int(size) || !decodeChunk(startTime, data, visit)) {
+            intact = false;
+            break;
+        }
+    }
+    if (got > 0 && got != kSpillHeaderBytes) intact = false;
+    m_spillFile->seek(m_spillFile->size());
+    return intact;
+}
+
+/**
+ * @brief 封闭当前块并开启新块；内存超出预算时淘汰最旧的块。
+ * @details 新块从最后一个采样的时刻开始，且不引用上一块的采样，因此每个块都能独立解码。
+ */
+void WaveformRecorder::closeChunk()
+{
+    flushRun();
+    if (m_current.data.isEmpty()) return;
+    m_closedBytes += m_current.data.size();
+    m_chunks.append(m_current);
+    m_current = Chunk{m_lastRecordTime, QByteArray()};
+    m_current.data.reserve(kChunkBytes + 64);
+    m_hasLast = false;
+
+    while (!m_chunks.isEmpty() && memoryBytes() > m_memoryBudget) { evictOldestChunk(); }
+}
+
+/**
+ * @brief 淘汰最旧的块：优先追加到溢出文件；不允许溢出或文件不可写时，
+ * 把它解码进起点快照后丢弃（波形从此只能从更晚的时刻开始导出）。
+ */
+void WaveformRecorder::evictOldestChunk()
+{
+    const Chunk oldest = m_chunks.takeFirst();
+    m_closedBytes -= oldest.data.size();
+
+    if (m_spillToDisk) {
+        if (!m_spillFile) {
+            m_spillFile.reset(new QTemporaryFile);
+            if (!m_spillFile->open()) {
+                qWarning() << "无法创建波形溢出文件，之后的旧波形将被丢弃:" << m_spillFile->errorString();
+                m_spillFile.reset();
+                m_spillToDisk = false;
+            }
+        }
+        if (m_spillFile) {
+            char header[kSpillHeaderBytes];
+            qToLittleEndian<quint64>(oldest.startTime, header);
+            qToLittleEndian<quint32>(quint32(oldest.data.size()), header + 8);
+            if (m_spillFile->write(header, kSpillHeaderBytes) == kSpillHeaderBytes
+                && m_spillFile->write(oldest.data) == oldest.data.size()) {
+                m_spilledBytes += kSpillHeaderBytes + oldest.data.size();
+                return;
+            }
+            // --- 写入失败：已溢出的部分并入起点快照，之后不再溢出 ---
+            qWarning() << "写入波形溢出文件失败，之后的旧波形将被丢弃:" << m_spillFile->errorString();
+            m_spillToDisk = false;
+            readSpillFile([this](quint64 time, const QVector<quint32>& ids) { foldIntoBase(time, ids); });
+            m_spillFile.reset();
+            m_spilledBytes = 0;
+        }
+    }
+
+    // --- 丢弃：把块内的翻转并入起点快照 ---
+    decodeChunk(oldest.startTime, oldest.data, [this](quint64 time, const QVector<quint32>& ids) { foldIntoBase(time, ids); });
+}
+
+/** 把一个采样并入起点快照：起点前移到该采样的时刻 */
+void WaveformRecorder::foldIntoBase(quint64 time, const QVector<quint32>& ids)
+{
+    for (quint32 id : ids) { m_baseValues[int(id)] ^= 1; }
+    m_baseTime = time;
+}
+
+/**
+ * @brief 导出 VCD：先写信号声明与起点电平，再依次解码溢出文件、内存中的块。
+ * @details 起点之后才出现的信号在 $dumpvars 中记为 x。时间单位标成 1 ns，实际含义是一次提交。
+ */
+bool WaveformRecorder::exportVcd(QIODevice* device)
+{
+    m_error.clear();
+    if (!device) {
+        m_error = "没有可写入的设备。";
+        return false;
+    }
+    flushRun(); // 积压的游程写进当前块；之后的相同采样另起一条游程记录，解码结果不变
+
+    QByteArray out;
+    out.reserve(kVcdFlushBytes + 256);
+    bool ok = true;
+    auto flush = [&](bool force) {
+        if (!ok || (!force && out.size() < kVcdFlushBytes)) return;
+        if (device->write(out) != out.size()) {
+            m_error = "写入波形文件失败: " + device->errorString();
+            ok = false;
+        }
+        out.clear();
+    };
+
+    // --- 1. 头部与信号声明 ---
+    QVector<QByteArray> codes(m_signals.size());
+    out += "$version Turingv2 $end\n";
+    out += "$comment 1 个时间单位 = 1 次仿真提交（一个时钟节拍或一次单步） $end\n";
+    out += "$timescale 1 ns $end\n";
+    out += "$scope module top $end\n";
+    for (int i = 0; i < m_signals.size(); ++i) {
+        codes[i] = vcdCode(quint32(i));
+        out.append("$var wire 1 ").append(codes[i]).append(' ').append(m_signals[i].name.toLatin1()).append(" $end\n");
+        flush(false);
+    }
+    out += "$upscope $end\n$enddefinitions $end\n";
+
+    // --- 2. 起点电平 ---
+    QVector<char> values = m_baseValues;
+    out.append('#').append(QByteArray::number(m_baseTime)).append("\n$dumpvars\n");
+    for (int i = 0; i < m_signals.size(); ++i) {
+        out.append(m_signals[i].firstTime > m_baseTime ? 'x' : char('0' + values[i])).append(codes[i]).append('\n');
+        flush(false);
+    }
+    out += "$end\n";
+
+    // --- 3. 翻转：每个采样一行时刻，随后是各信号的新电平 ---
+    auto emitSample = [&](quint64 time, const QVector<quint32>& ids) {
+        out.append('#').append(QByteArray::number(time)).append('\n');
+        for (quint32 id : ids) {
+            values[int(id)] ^= 1;
+            out.append(char('0' + values[int(id)])).append(codes[int(id)]).append('\n');
+        }
+        flush(false);
+    };
+    if (!readSpillFile(emitSample)) {
+        qWarning() << "波形溢出文件已损坏，导出的波形在损坏处截断";
+    }
+    for (const Chunk& chunk : m_chunks) {
+        if (!ok) break;
+        decodeChunk(chunk.startTime, chunk.data, emitSample);
+    }
+    if (ok) decodeChunk(m_current.startTime, m_current.data, emitSample);
+
+    out.append('#').append(QByteArray::number(m_time)).append('\n');
+    flush(true);
+    return ok;
+}
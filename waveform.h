@@ -0,0 +1,138 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+#include <QByteArray>   // 编码后的轨迹块
+#include <QHash>        // 引脚 → 信号编号
+#include <QSet>         // 已用的信号名
+#include <QString>      // 信号名与错误信息
+#include <QVector>      // 信号表、轨迹块环形缓冲
+#include <QScopedPointer> // 延迟创建的溢出文件
+
+class Engine;
+class Component;
+class Pin;
+class QIODevice;
+class QTemporaryFile;
+
+/**
+ * @file waveform.h
+ * @brief 波形记录器：记录引擎每次提交仿真时的引脚变化，压缩保存，并可导出为 VCD。
+ */
+
+/**
+ * @brief 波形记录器：挂在 Engine 上，每次 commitSimulation() 记录一个采样时刻。
+ * @details 只记录顶层元件的输出引脚（输入引脚只是其驱动者的镜像）。引脚是二值的，因此每个采样只需记下
+ * “哪些信号翻转了”：时间增量与升序信号编号的差分都用变长整数编码；与上一个采样完全相同的采样
+ * （例如只有时钟在翻转）合并为一个重复次数（游程编码）。
+ * 编码结果按块存放在环形缓冲中，超过内存预算时最旧的块写入临时文件（或在禁用溢出时丢弃，
+ * 同时把它解码进“起点快照”，使剩余部分仍可独立解码）。
+ */
+class WaveformRecorder {
+public:
+    /** 默认内存预算（字节） */
+    static const qint64 kDefaultMemoryBudget = 64 * 1024 * 1024;
+
+    /** @param memoryBudget 内存中保留的轨迹块总字节数上限 */
+    explicit WaveformRecorder(qint64 memoryBudget = kDefaultMemoryBudget);
+    /** 析构时从引擎上摘下并删除溢出文件 */
+    ~WaveformRecorder();
+
+    /** 超出内存预算时是否把最旧的块写入临时文件（默认开启；关闭则丢弃最旧的历史） */
+    void setSpillToDisk(bool enabled);
+    /** 当前采样时刻（挂上引擎时为 0，每次提交加 1） */
+    quint64 currentTime() const { return m_time; }
+    /** 已登记的信号数 */
+    int signalCount() const { return m_signals.size(); }
+    /** 已记录的翻转次数 */
+    qint64 changeCount() const { return m_changeCount; }
+    /** 轨迹占用的内存字节数（不含已溢出到磁盘的部分） */
+    qint64 memoryBytes() const;
+    /** 已溢出到磁盘的字节数 */
+    qint64 spilledBytes() const { return m_spilledBytes; }
+
+    /**
+     * @brief 把整个轨迹导出为 VCD（时间单位为一次提交，即一个时钟节拍或一次单步）。
+     * @return 写入失败时返回 false，原因见 errorString()
+     */
+    bool exportVcd(QIODevice* device);
+    /** 最近一次失败的原因 */
+    const QString& errorString() const { return m_error; }
+
+    // --- 以下由 Engine 调用 ---
+    /** 挂到引擎上：登记所有顶层输出引脚及其当前电平作为轨迹起点 */
+    void attach(Engine* engine);
+    /** 从引擎上摘下（引擎析构或换用别的记录器时） */
+    void detach();
+    /** 记录一次提交：changedPins 为本次状态翻转的引脚 */
+    void recordCommit(const QVector<Pin*>& changedPins);
+    /** 组件即将被删除：忘掉它的引脚（信号及其历史保留） */
+    void forgetComponent(const Component* component);
+    /** 引擎即将清空：忘掉所有引脚 */
+    void forgetAllPins();
+
+private:
+    /** 一个信号：名称、登记时的电平与时刻 */
+    struct Signal {
+        QString name;
+        bool initialValue;
+        quint64 firstTime;
+    };
+    /** 一个编码块：起始时刻与记录字节 */
+    struct Chunk {
+        quint64 startTime;
+        QByteArray data;
+    };
+
+    /** 返回引脚的信号编号；首次见到时登记（非顶层引脚返回 kNotRecorded） */
+    quint32 signalFor(Pin* pin, bool valueBeforeChange);
+    /** 写出尚未落盘的重复次数 */
+    void flushRun();
+    /** 写出一个采样：时间增量 + 翻转的信号 */
+    void writeRecord(quint64 delta, const QVector<quint32>& ids);
+    /** 封闭当前块，并在超出预算时处理最旧的块 */
+    void closeChunk();
+    /** 把最旧的块写入溢出文件或并入起点快照 */
+    void evictOldestChunk();
+    /** 把一个采样并入起点快照 */
+    void foldIntoBase(quint64 time, const QVector<quint32>& ids);
+    /** 依次解码溢出文件中的块（文件损坏时返回 false） */
+    template <typename Visit>
+    bool readSpillFile(Visit visit);
+    /**
+     * @brief 解码一个块，对每个采样调用 visit(时刻, 翻转的信号)。
+     * @return 数据损坏（截断或信号编号越界）时返回 false
+     */
+    template <typename Visit>
+    bool decodeChunk(quint64 startTime, const QByteArray& data, Visit visit) const;
+
+    /** 非顶层引脚在引脚表中的标记 */
+    static const quint32 kNotRecorded = 0xFFFFFFFFu;
+
+    Engine* m_engine = nullptr;
+    QVector<Signal> m_signals;
+    QHash<const Pin*, quint32> m_pinSignals;
+    QSet<QString> m_signalNames;
+    quint64 m_time = 0;
+    qint64 m_changeCount = 0;
+
+    // --- 编码状态 ---
+    QVector<Chunk> m_chunks;          // 已封闭的块（最旧的在前）
+    Chunk m_current{0, QByteArray()}; // 正在写入的块
+    qint64 m_closedBytes = 0;         // 已封闭块的总字节数
+    qint64 m_memoryBudget;
+    quint64 m_lastRecordTime = 0;     // 上一个采样的时刻
+    QVector<quint32> m_lastIds;       // 上一个采样翻转的信号
+    quint64 m_lastDelta = 0;          // 上一个采样的时间增量
+    bool m_hasLast = false;           // 当前块中是否已有可重复的采样
+    quint64 m_runLength = 0;          // 尚未写出的重复次数
+    QVector<quint32> m_scratch;       // 本次提交翻转的信号（复用容量）
+
+    // --- 起点快照与溢出文件 ---
+    quint64 m_baseTime = 0;           // 现存轨迹的起点时刻
+    QVector<char> m_baseValues;       // 起点时刻各信号的电平
+    bool m_spillToDisk = true;
+    QScopedPointer<QTemporaryFile> m_spillFile;
+    qint64 m_spilledBytes = 0;
+    QString m_error;
+};
+
+#endif // WAVEFORM_H